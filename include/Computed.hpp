@@ -0,0 +1,566 @@
+#ifndef COMPUTED_HPP
+#define COMPUTED_HPP
+
+#include "ObserverPattern.hpp"
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+class ComputedGraph;                                            // forward declaration
+class ComputedSource;                                           // forward declaration
+
+class ComputedNode                                              // vertex of the graph of computed values, for implementation of Computed only
+{
+    // ComputedGraph marks, queues and refreshes nodes
+    friend class ComputedGraph;
+    public:
+        ComputedNode();                                         // constructor, stale until first read
+        virtual ~ComputedNode();                                // destrctor, virtual, unlink from inputs, dependents and sources
+        unsigned getRank() const;                               // 0 without computed inputs, else one more than the highest input
+        bool isStale() const;                                   // whether the next read checks inputs or recomputes
+        std::uint64_t getComputations() const;                  // times the value was computed
+
+    protected:
+        enum State { Clean, Check, Dirty };                     // up to date, an input may have changed, an input changed
+
+        bool link(ComputedNode *input);                         // depend on input, false if already or a cycle
+        bool link(ComputedSource *source, std::uint64_t bits);  // depend on the messages bits of source, false if already
+        void refresh();                                         // bring the value up to date, inputs first, at most one compute per change
+        void settled();                                         // the value is known to observers, nothing to notify
+        virtual bool recompute() = 0;                           // compute the value, whether it changed, pure virtual
+        virtual bool observed() const = 0;                      // whether observers wait for changes, refreshed eagerly then, pure virtual
+        virtual void changed() = 0;                             // notify observers of the change, pure virtual
+
+    private:
+        ComputedNode(const ComputedNode&) = delete;             // disable copy from left value
+        ComputedNode(const ComputedNode&&) = delete;            // disable copy from right value
+        ComputedNode& operator=(const ComputedNode&) = delete;  // disable assign from left value
+        ComputedNode& operator=(const ComputedNode&&) = delete; // disable assign from right value
+
+        bool reaches(const ComputedNode *node) const;           // whether node is this or depends on it
+        void raise(unsigned rank);                              // rank of this at least rank, dependents above
+
+        std::vector<ComputedNode*> m_inputs;                    // computed values this depends on
+        std::vector<ComputedNode*> m_dependents;                // computed values depending on this
+        std::vector<ComputedSource*> m_sources;                 // subjects this depends on
+        unsigned m_rank;                                        // topological order, inputs first
+        State m_state;                                          // up to date or not
+        bool m_queued;                                          // in the queue of the graph
+        std::uint64_t m_computedAt;                             // tick of the last refresh
+        std::uint64_t m_changedAt;                              // tick the value last changed
+        std::uint64_t m_notifiedAt;                             // m_changedAt observers know of
+        std::uint64_t m_computations;                           // times the value was computed
+};
+
+class ComputedSource                                            // one subject computed values depend on, observed once for all, for implementation of Computed only
+{
+    // ComputedGraph finds and releases sources, ComputedNode links itself
+    friend class ComputedGraph;
+    friend class ComputedNode;
+    public:
+        virtual ~ComputedSource();                              // destrctor, virtual
+
+    protected:
+        explicit ComputedSource(const void *subject);           // constructor, subject is the key in the graph
+        void changed(long msg);                                 // the subject notified msg
+        void forget();                                          // the subject stopped, no longer found by the graph
+
+    private:
+        ComputedSource(const ComputedSource&) = delete;         // disable copy from left value
+        ComputedSource& operator=(const ComputedSource&) = delete; // disable assign from left value
+
+        const void *m_subject;                                  // key in the graph, nullptr once forgotten
+        std::vector<std::pair<ComputedNode*, std::uint64_t>> m_dependents; // nodes and the MessageMask bits they depend on
+};
+
+template<typename T>
+class ComputedSourceOf final : public ComputedSource, public Observer<T> // observes one subject for every computed value of it
+{
+    public:
+        explicit ComputedSourceOf(T *subject);                  // constructor, start observing subject
+        ~ComputedSourceOf();                                    // destrctor, stop observing
+        bool update(long msg) override;                         // mark dependents, then propagate
+
+    protected:
+        void detached() override;                               // subject destroyed or stopped, forget it
+};
+
+class ComputedGraph                                             // computed values of the current thread, marked on change, refreshed in rank order
+{
+    public:
+        static ComputedGraph& current();                        // graph of the current thread
+        template<typename T>
+        ComputedSource* source(T *subject);                     // the source observing subject, created on first use
+        void changed(ComputedSource *source, long msg);         // one tick, mark the dependents of msg, then propagate
+        void mark(ComputedNode *node, ComputedNode::State state); // node and its dependents are stale, observed ones queued
+        void forget(ComputedNode *node);                        // node destroyed, drop it from the queue
+        void forget(ComputedSource *source);                    // subject stopped, a new source is created for its address
+        void release(ComputedSource *source);                   // no node depends on source, deleted once propagation ends
+        std::uint64_t getTick() const;                          // changes of sources so far
+
+    private:
+        ComputedGraph();                                        // constructor, by current only
+        ComputedGraph(const ComputedGraph&) = delete;           // disable copy from left value
+        ComputedGraph& operator=(const ComputedGraph&) = delete; // disable assign from left value
+
+        void propagate();                                       // refresh queued nodes lowest rank first, notify those changed
+        static bool later(const ComputedNode *a, const ComputedNode *b); // order of the queue, a min-heap of ranks
+
+        std::unordered_map<const void*, ComputedSource*> m_sources; // sources by subject address
+        std::vector<ComputedNode*> m_queue;                     // observed nodes marked, heap by rank
+        std::vector<ComputedNode*> m_marking;                   // nodes left to mark, reused
+        std::vector<ComputedSource*> m_released;                // sources deleted when propagation ends
+        std::uint64_t m_tick;                                   // changes of sources so far
+        bool m_propagating;                                     // propagate running, nested changes only mark
+};
+
+template<typename V>
+class Computed : public Subject<Computed<V>>, public ComputedNode // value derived from subjects and other computed values, memoized
+{
+    public:
+        typedef std::function<V()> Function;                    // computes the value, reads the subjects and computed values depended on
+
+        explicit Computed(Function compute);                    // constructor, computed on first read
+        virtual ~Computed();                                    // destrctor, virtual
+        template<typename T>
+        bool dependOn(T *source, MessageMask messages = MessageMask()); // stale once source notifies one of messages, false if nullptr or already
+        template<typename W>
+        bool dependOn(Computed<W> *input);                      // stale once input changes, false if nullptr, already or a cycle
+        const V& get() const;                                   // value, recomputed first if stale
+
+        static const long ValueChanged = 0;                     // notified when the value changes
+
+    protected:
+        bool attach(ObserverImpl *observer, MessageMask messages) override; // bring the value up to date, then store observer
+        void attachAll(const typename Subject<Computed<V>>::Subscribed *observers, std::size_t count) override; // bring the value up to date, then store observers
+
+    private:
+        bool recompute() override;                              // invoke the function, whether the value changed
+        bool observed() const override;                         // whether any observer is attached
+        void changed() override;                                // notify ValueChanged
+
+        Function m_compute;                                     // computes the value
+        V m_value;                                              // memoized value
+};
+
+
+
+inline ComputedNode::ComputedNode():
+    m_rank(0), m_state(Dirty), m_queued(false), m_computedAt(0), m_changedAt(0), m_notifiedAt(0), m_computations(0) {}
+
+inline ComputedNode::~ComputedNode()
+{
+    // MUST be destroyed on the thread of its graph
+    ComputedGraph &graph = ComputedGraph::current();
+    graph.forget(this);
+    for (auto it = m_inputs.begin(); it != m_inputs.end(); ++it)
+    {
+        std::vector<ComputedNode*> &dependents = (*it)->m_dependents;
+        dependents.erase(std::find(dependents.begin(), dependents.end(), this));
+    }
+    for (auto it = m_dependents.begin(); it != m_dependents.end(); ++it)
+    {
+        std::vector<ComputedNode*> &inputs = (*it)->m_inputs;
+        inputs.erase(std::find(inputs.begin(), inputs.end(), this));
+        graph.mark(*it, Dirty);                                 // lost an input, computed again on next read
+    }
+    for (auto it = m_sources.begin(); it != m_sources.end(); ++it)
+    {
+        std::vector<std::pair<ComputedNode*, std::uint64_t>> &dependents = (*it)->m_dependents;
+        for (auto dependent = dependents.begin(); dependent != dependents.end(); ++dependent)
+        {
+            if (dependent->first == this)
+            {
+                dependents.erase(dependent);
+                break;
+            }
+        }
+        if (dependents.empty())
+        {
+            graph.release(*it);
+        }
+    }
+}
+
+inline unsigned ComputedNode::getRank() const
+{
+    return m_rank;
+}
+
+inline bool ComputedNode::isStale() const
+{
+    return m_state != Clean;
+}
+
+inline std::uint64_t ComputedNode::getComputations() const
+{
+    return m_computations;
+}
+
+inline bool ComputedNode::link(ComputedNode *input)
+{
+    if (reaches(input) || std::find(m_inputs.begin(), m_inputs.end(), input) != m_inputs.end())
+    {
+        return false;                                           // a cycle, or already
+    }
+    m_inputs.push_back(input);
+    input->m_dependents.push_back(this);
+    raise(input->m_rank + 1);
+    ComputedGraph::current().mark(this, Dirty);
+    return true;
+}
+
+inline bool ComputedNode::link(ComputedSource *source, std::uint64_t bits)
+{
+    if (std::find(m_sources.begin(), m_sources.end(), source) != m_sources.end())
+    {
+        return false;                                           // already
+    }
+    m_sources.push_back(source);
+    source->m_dependents.push_back(std::make_pair(this, bits));
+    ComputedGraph::current().mark(this, Dirty);
+    return true;
+}
+
+inline void ComputedNode::refresh()
+{
+    if (m_state == Clean)
+    {
+        return;                                                 // most reads
+    }
+    // order matters, every input MUST be clean before this is, marking stops at nodes already stale
+    const std::uint64_t tick = ComputedGraph::current().getTick();
+    for (auto it = m_inputs.begin(); it != m_inputs.end(); ++it)
+    {
+        (*it)->refresh();
+        if ((*it)->m_changedAt > m_computedAt)
+        {
+            m_state = Dirty;
+        }
+    }
+    if (m_state == Dirty)
+    {
+        ++m_computations;
+        if (recompute())
+        {
+            m_changedAt = tick;
+        }
+    }
+    m_computedAt = tick;
+    m_state = Clean;
+}
+
+inline void ComputedNode::settled()
+{
+    m_notifiedAt = m_changedAt;
+}
+
+inline bool ComputedNode::reaches(const ComputedNode *node) const
+{
+    if (node == this)
+    {
+        return true;
+    }
+    for (auto it = m_dependents.begin(); it != m_dependents.end(); ++it)
+    {
+        if ((*it)->reaches(node))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+inline void ComputedNode::raise(unsigned rank)
+{
+    if (m_rank >= rank)
+    {
+        return;
+    }
+    m_rank = rank;
+    for (auto it = m_dependents.begin(); it != m_dependents.end(); ++it)
+    {
+        (*it)->raise(rank + 1);
+    }
+}
+
+
+
+inline ComputedSource::ComputedSource(const void *subject): m_subject(subject) {}
+
+inline ComputedSource::~ComputedSource() {}
+
+inline void ComputedSource::changed(long msg)
+{
+    ComputedGraph::current().changed(this, msg);
+}
+
+inline void ComputedSource::forget()
+{
+    ComputedGraph::current().forget(this);
+}
+
+
+
+template<typename T>
+ComputedSourceOf<T>::ComputedSourceOf(T *subject): ComputedSource(subject)
+{
+    Observer<T>::startObserve(subject);
+}
+
+template<typename T>
+ComputedSourceOf<T>::~ComputedSourceOf()
+{
+    Observer<T>::stopObserve();
+}
+
+template<typename T>
+bool ComputedSourceOf<T>::update(long msg)
+{
+    // one observer for all dependents, every one is marked before any is refreshed
+    changed(msg);
+    return true;
+}
+
+template<typename T>
+void ComputedSourceOf<T>::detached()
+{
+    forget();                                                   // kept for the nodes linked to it, deleted with the last
+}
+
+
+
+inline ComputedGraph::ComputedGraph(): m_tick(0), m_propagating(false) {}
+
+inline ComputedGraph& ComputedGraph::current()
+{
+    static thread_local ComputedGraph graph;
+    return graph;
+}
+
+template<typename T>
+ComputedSource* ComputedGraph::source(T *subject)
+{
+    auto it = m_sources.find(subject);
+    if (it != m_sources.end())
+    {
+        return it->second;
+    }
+    ComputedSource *source = new ComputedSourceOf<T>(subject);
+    m_sources[subject] = source;
+    return source;
+}
+
+inline void ComputedGraph::changed(ComputedSource *source, long msg)
+{
+    ++m_tick;
+    const std::uint64_t bit = MessageMask::bitOf(msg);
+    for (auto it = source->m_dependents.begin(); it != source->m_dependents.end(); ++it)
+    {
+        if (it->second & bit)
+        {
+            mark(it->first, ComputedNode::Dirty);
+        }
+    }
+    propagate();
+}
+
+inline void ComputedGraph::mark(ComputedNode *node, ComputedNode::State state)
+{
+    // only clean nodes are walked through, dependents of a stale node are stale already
+    if (node->m_state >= state)
+    {
+        return;
+    }
+    const bool clean = node->m_state == ComputedNode::Clean;
+    node->m_state = state;
+    if (!clean)
+    {
+        return;
+    }
+    m_marking.push_back(node);
+    while (!m_marking.empty())
+    {
+        ComputedNode *stale = m_marking.back();
+        m_marking.pop_back();
+        if (!stale->m_queued && stale->observed())
+        {
+            stale->m_queued = true;
+            m_queue.push_back(stale);
+            std::push_heap(m_queue.begin(), m_queue.end(), &ComputedGraph::later);
+        }
+        for (auto it = stale->m_dependents.begin(); it != stale->m_dependents.end(); ++it)
+        {
+            if ((*it)->m_state == ComputedNode::Clean)
+            {
+                (*it)->m_state = ComputedNode::Check;
+                m_marking.push_back(*it);
+            }
+        }
+    }
+}
+
+inline void ComputedGraph::forget(ComputedNode *node)
+{
+    if (!node->m_queued)
+    {
+        return;
+    }
+    m_queue.erase(std::find(m_queue.begin(), m_queue.end(), node));
+    std::make_heap(m_queue.begin(), m_queue.end(), &ComputedGraph::later);
+    node->m_queued = false;
+}
+
+inline void ComputedGraph::forget(ComputedSource *source)
+{
+    if (source->m_subject)
+    {
+        m_sources.erase(source->m_subject);
+        source->m_subject = nullptr;
+    }
+}
+
+inline void ComputedGraph::release(ComputedSource *source)
+{
+    forget(source);
+    if (m_propagating)
+    {
+        m_released.push_back(source);                           // its update may be on the stack
+        return;
+    }
+    delete source;
+}
+
+inline std::uint64_t ComputedGraph::getTick() const
+{
+    return m_tick;
+}
+
+inline void ComputedGraph::propagate()
+{
+    if (m_propagating)
+    {
+        return;                                                 // nested change, the outer loop refreshes what it queued
+    }
+
+    struct PropagateGuard                                       // end propagation even if a compute or an update throws
+    {
+        ComputedGraph *m_graph;
+        ~PropagateGuard()
+        {
+            m_graph->m_propagating = false;
+            std::vector<ComputedSource*> released;
+            released.swap(m_graph->m_released);
+            for (auto it = released.begin(); it != released.end(); ++it)
+            {
+                delete *it;
+            }
+        }
+    } propagateGuard = { this };
+    m_propagating = true;
+
+    // lowest rank first, inputs are refreshed and notified before what depends on them
+    while (!m_queue.empty())
+    {
+        std::pop_heap(m_queue.begin(), m_queue.end(), &ComputedGraph::later);
+        ComputedNode *node = m_queue.back();
+        m_queue.pop_back();
+        node->m_queued = false;
+        node->refresh();
+        if (node->m_changedAt > node->m_notifiedAt)
+        {
+            node->m_notifiedAt = node->m_changedAt;
+            node->changed();                                    // MUST be the last access to node, an update may destroy it
+        }
+    }
+}
+
+inline bool ComputedGraph::later(const ComputedNode *a, const ComputedNode *b)
+{
+    return a->m_rank > b->m_rank;
+}
+
+
+
+template<typename V>
+Computed<V>::Computed(Function compute): m_compute(std::move(compute)), m_value() {}
+
+template<typename V>
+Computed<V>::~Computed() {}
+
+template<typename V>
+template<typename T>
+bool Computed<V>::dependOn(T *source, MessageMask messages)
+{
+    if (!source)
+    {
+        return false;                                           // nullptr, invalid argument
+    }
+    return link(ComputedGraph::current().source(source), messages.bits());
+}
+
+template<typename V>
+template<typename W>
+bool Computed<V>::dependOn(Computed<W> *input)
+{
+    if (!input)
+    {
+        return false;                                           // nullptr, invalid argument
+    }
+    return link(static_cast<ComputedNode*>(input));
+}
+
+template<typename V>
+const V& Computed<V>::get() const
+{
+    // memoized, refresh is a no-op unless an input changed since the last read
+    const_cast<Computed*>(this)->refresh();
+    return m_value;
+}
+
+template<typename V>
+bool Computed<V>::attach(ObserverImpl *observer, MessageMask messages)
+{
+    // order matters, a stale node is never queued again by mark, the observer MUST start from a clean one
+    get();
+    settled();
+    return Subject<Computed<V>>::attach(observer, messages);
+}
+
+template<typename V>
+void Computed<V>::attachAll(const typename Subject<Computed<V>>::Subscribed *observers, std::size_t count)
+{
+    get();
+    settled();
+    Subject<Computed<V>>::attachAll(observers, count);
+}
+
+template<typename V>
+bool Computed<V>::recompute()
+{
+    V value = m_compute();
+    if (getComputations() > 1 && value == m_value)
+    {
+        return false;                                           // unchanged, dependents are not recomputed
+    }
+    m_value = std::move(value);
+    return true;
+}
+
+template<typename V>
+bool Computed<V>::observed() const
+{
+    return !this->getObservers().empty();
+}
+
+template<typename V>
+void Computed<V>::changed()
+{
+    this->notify(ValueChanged);
+}
+
+#endif // COMPUTED_HPP
@@ -0,0 +1,372 @@
+#ifndef COROUTINE_HPP
+#define COROUTINE_HPP
+
+// C++20 only, the rest of the library stays C++11
+
+#if __cplusplus < 202002L && !(defined(_MSVC_LANG) && _MSVC_LANG >= 202002L)
+#error "Coroutine.hpp needs C++20"
+#endif
+
+#include "ObserverPattern.hpp"
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <optional>
+#include <vector>
+
+enum class Resumption                                           // where a coroutine waiting for a message resumes
+{
+    Inline,                                                     // inside update, on the notifying thread, before notify returns
+    Posted                                                      // on the executor, notify returns without waiting for it
+};
+
+template<typename T>
+class AwaitableObserver : public Observer<T>                    // lets coroutines co_await the messages of one subject
+{
+    private:
+        struct Waiter                                           // one coroutine waiting, lives in its frame
+        {
+            Waiter *m_prev;                                     // previous in the list of waiters
+            Waiter *m_next;                                     // next in the list of waiters
+            std::uint64_t m_bits;                               // messages waited for
+            std::coroutine_handle<> m_handle;                   // coroutine suspended, null if running
+            std::optional<long> m_msg;                          // message resumed with, empty if closed
+            std::deque<long> *m_queue;                          // messages while running, nullptr unless a stream
+        };
+
+    public:
+        class Next                                              // awaitable of next, resumes at the next matching notify
+        {
+            public:
+                ~Next();                                        // destrctor, unlink if the coroutine is destroyed while waiting
+                bool await_ready() const noexcept;              // never ready, a message is always in the future
+                bool await_suspend(std::coroutine_handle<> handle); // wait for the message, false if closed
+                std::optional<long> await_resume() const;       // the message, empty if closed
+
+            private:
+                friend class AwaitableObserver;
+                Next(AwaitableObserver *observer, std::uint64_t bits); // constructor, by next only
+                Next(const Next&) = delete;                     // disable copy from left value, linked by address
+                Next& operator=(const Next&) = delete;          // disable assign from left value
+
+                AwaitableObserver *m_observer;                  // observer notified
+                Waiter m_waiter;                                // linked while suspended
+        };
+
+        class Stream                                            // asynchronous sequence of messages, none missed between awaits
+        {
+            public:
+                class Next                                      // awaitable of next, takes the oldest message queued
+                {
+                    public:
+                        bool await_ready() const noexcept;      // never ready, queued messages are taken in await_suspend
+                        bool await_suspend(std::coroutine_handle<> handle); // take a queued message or wait, false if not waiting
+                        std::optional<long> await_resume() const; // the message, empty if closed and drained
+
+                    private:
+                        friend class Stream;
+                        explicit Next(Stream *stream);          // constructor, by next only
+                        Stream *m_stream;                       // stream awaited
+                };
+
+                Stream(AwaitableObserver &observer, MessageMask messages = MessageMask()); // constructor, start queueing
+                ~Stream();                                      // destrctor, stop queueing
+                Next next();                                    // co_await it for the oldest message, empty once closed and drained
+                std::size_t getQueued() const;                  // messages queued, not taken yet
+
+            private:
+                Stream(const Stream&) = delete;                 // disable copy from left value, linked by address
+                Stream& operator=(const Stream&) = delete;      // disable assign from left value
+
+                AwaitableObserver *m_observer;                  // observer notified
+                std::deque<long> m_queue;                       // messages not taken yet
+                Waiter m_waiter;                                // linked as long as the stream lives
+        };
+
+        explicit AwaitableObserver(Resumption resumption = Resumption::Inline, Executor *executor = nullptr); // constructor, ThreadPool::instance() if Posted without executor, at the first resume
+        virtual ~AwaitableObserver();                           // destrctor, close
+        bool update(long msg) override final;                   // resume coroutines waiting for msg, whether any waited
+        Next next(MessageMask messages = MessageMask());        // co_await it for the next message of messages
+        void close();                                           // resume every coroutine waiting with an empty message
+        Resumption getResumption() const;                       // where coroutines resume
+        std::size_t getWaiting() const;                         // coroutines waiting, streams included
+
+    protected:
+        bool init() override;                                   // reopen, invoked after start observing
+        bool uninit() override;                                 // close, invoked before stop observing
+
+    private:
+        AwaitableObserver(const AwaitableObserver&) = delete;   // disable copy from left value
+        AwaitableObserver(const AwaitableObserver&&) = delete;  // disable copy from right value
+        AwaitableObserver& operator=(const AwaitableObserver&) = delete; // disable assign from left value
+        AwaitableObserver& operator=(const AwaitableObserver&&) = delete; // disable assign from right value
+
+        void link(Waiter *waiter);                              // add to waiters, locked
+        void unlink(Waiter *waiter);                            // remove from waiters, locked
+        void resume(std::vector<std::coroutine_handle<>> &handles); // resume outside the lock, inline or posted
+
+        const Resumption m_resumption;                          // where coroutines resume
+        Executor *const m_executor;                             // executor of Posted, nullptr for ThreadPool::instance()
+        mutable std::mutex m_lock;                              // guard the waiters, streams and m_closed
+        Waiter m_waiters;                                       // sentinel of the circular list of waiters
+        std::size_t m_waiting;                                  // waiters linked
+        bool m_closed;                                          // closed, no coroutine suspends any more
+};
+
+
+
+template<typename T>
+AwaitableObserver<T>::Next::Next(AwaitableObserver *observer, std::uint64_t bits):
+    m_observer(observer), m_waiter{ nullptr, nullptr, bits, nullptr, std::nullopt, nullptr } {}
+
+template<typename T>
+AwaitableObserver<T>::Next::~Next()
+{
+    std::lock_guard<std::mutex> lock(m_observer->m_lock);
+    if (m_waiter.m_next)
+    {
+        m_observer->unlink(&m_waiter);                          // frame destroyed while suspended
+    }
+}
+
+template<typename T>
+bool AwaitableObserver<T>::Next::await_ready() const noexcept
+{
+    return false;
+}
+
+template<typename T>
+bool AwaitableObserver<T>::Next::await_suspend(std::coroutine_handle<> handle)
+{
+    std::lock_guard<std::mutex> lock(m_observer->m_lock);
+    if (m_observer->m_closed)
+    {
+        return false;                                           // resume at once with an empty message
+    }
+    m_waiter.m_handle = handle;
+    m_observer->link(&m_waiter);
+    return true;
+}
+
+template<typename T>
+std::optional<long> AwaitableObserver<T>::Next::await_resume() const
+{
+    return m_waiter.m_msg;
+}
+
+template<typename T>
+AwaitableObserver<T>::Stream::Stream(AwaitableObserver &observer, MessageMask messages):
+    m_observer(&observer), m_waiter{ nullptr, nullptr, messages.bits(), nullptr, std::nullopt, &m_queue }
+{
+    std::lock_guard<std::mutex> lock(m_observer->m_lock);
+    if (!m_observer->m_closed)
+    {
+        m_observer->link(&m_waiter);
+    }
+}
+
+template<typename T>
+AwaitableObserver<T>::Stream::~Stream()
+{
+    // MUST not be destroyed while a coroutine awaits it
+    std::lock_guard<std::mutex> lock(m_observer->m_lock);
+    if (m_waiter.m_next)
+    {
+        m_observer->unlink(&m_waiter);
+    }
+}
+
+template<typename T>
+typename AwaitableObserver<T>::Stream::Next AwaitableObserver<T>::Stream::next()
+{
+    return Next(this);
+}
+
+template<typename T>
+AwaitableObserver<T>::Stream::Next::Next(Stream *stream): m_stream(stream) {}
+
+template<typename T>
+bool AwaitableObserver<T>::Stream::Next::await_ready() const noexcept
+{
+    return false;
+}
+
+template<typename T>
+bool AwaitableObserver<T>::Stream::Next::await_suspend(std::coroutine_handle<> handle)
+{
+    // checked under the lock, a message queued between ready and suspend is never missed
+    Stream &stream = *m_stream;
+    std::lock_guard<std::mutex> lock(stream.m_observer->m_lock);
+    if (!stream.m_queue.empty())
+    {
+        stream.m_waiter.m_msg = stream.m_queue.front();
+        stream.m_queue.pop_front();
+        return false;
+    }
+    if (!stream.m_waiter.m_next)
+    {
+        stream.m_waiter.m_msg.reset();                          // closed and drained
+        return false;
+    }
+    stream.m_waiter.m_handle = handle;
+    return true;
+}
+
+template<typename T>
+std::optional<long> AwaitableObserver<T>::Stream::Next::await_resume() const
+{
+    return m_stream->m_waiter.m_msg;
+}
+
+template<typename T>
+std::size_t AwaitableObserver<T>::Stream::getQueued() const
+{
+    std::lock_guard<std::mutex> lock(m_observer->m_lock);
+    return m_queue.size();
+}
+
+template<typename T>
+AwaitableObserver<T>::AwaitableObserver(Resumption resumption, Executor *executor):
+    m_resumption(resumption), m_executor(executor),
+    m_waiters{ &m_waiters, &m_waiters, 0, nullptr, std::nullopt, nullptr }, m_waiting(0), m_closed(false) {}
+
+template<typename T>
+AwaitableObserver<T>::~AwaitableObserver()
+{
+    Observer<T>::stopObserve();
+    close();
+}
+
+template<typename T>
+bool AwaitableObserver<T>::update(long msg)
+{
+    // handles are collected under the lock and resumed after it, a coroutine resumed inline
+    // may await again, it then waits for the next notify
+    std::vector<std::coroutine_handle<>> handles;
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        const std::uint64_t bit = MessageMask::bitOf(msg);
+        for (Waiter *waiter = m_waiters.m_next; waiter != &m_waiters;)
+        {
+            Waiter *next = waiter->m_next;
+            if (waiter->m_bits & bit)
+            {
+                if (waiter->m_handle)
+                {
+                    waiter->m_msg = msg;
+                    handles.push_back(waiter->m_handle);
+                    waiter->m_handle = nullptr;
+                    if (!waiter->m_queue)
+                    {
+                        unlink(waiter);                         // one message per next
+                    }
+                }
+                else if (waiter->m_queue)
+                {
+                    waiter->m_queue->push_back(msg);            // stream consumer busy, never misses a message
+                }
+            }
+            waiter = next;
+        }
+    }
+    resume(handles);
+    return !handles.empty();
+}
+
+template<typename T>
+typename AwaitableObserver<T>::Next AwaitableObserver<T>::next(MessageMask messages)
+{
+    return Next(this, messages.bits());
+}
+
+template<typename T>
+void AwaitableObserver<T>::close()
+{
+    std::vector<std::coroutine_handle<>> handles;
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_closed = true;
+        while (m_waiters.m_next != &m_waiters)
+        {
+            Waiter *waiter = m_waiters.m_next;
+            if (waiter->m_handle)
+            {
+                waiter->m_msg.reset();
+                handles.push_back(waiter->m_handle);
+                waiter->m_handle = nullptr;
+            }
+            unlink(waiter);                                     // a stream still hands out what it queued
+        }
+    }
+    resume(handles);
+}
+
+template<typename T>
+Resumption AwaitableObserver<T>::getResumption() const
+{
+    return m_resumption;
+}
+
+template<typename T>
+std::size_t AwaitableObserver<T>::getWaiting() const
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    return m_waiting;
+}
+
+template<typename T>
+bool AwaitableObserver<T>::init()
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    m_closed = false;
+    return true;
+}
+
+template<typename T>
+bool AwaitableObserver<T>::uninit()
+{
+    close();
+    return true;
+}
+
+template<typename T>
+void AwaitableObserver<T>::link(Waiter *waiter)
+{
+    waiter->m_prev = m_waiters.m_prev;
+    waiter->m_next = &m_waiters;
+    m_waiters.m_prev->m_next = waiter;
+    m_waiters.m_prev = waiter;
+    ++m_waiting;
+}
+
+template<typename T>
+void AwaitableObserver<T>::unlink(Waiter *waiter)
+{
+    waiter->m_prev->m_next = waiter->m_next;
+    waiter->m_next->m_prev = waiter->m_prev;
+    waiter->m_prev = waiter->m_next = nullptr;
+    --m_waiting;
+}
+
+template<typename T>
+void AwaitableObserver<T>::resume(std::vector<std::coroutine_handle<>> &handles)
+{
+    for (auto it = handles.begin(); it != handles.end(); ++it)
+    {
+        if (m_resumption == Resumption::Inline)
+        {
+            it->resume();                                       // in waiting order
+        }
+        else
+        {
+            // the shared pool starts its threads on first use, so only a Posted observer that resumes starts it
+            Executor *executor = m_executor ? m_executor : &ThreadPool::instance();
+            const std::coroutine_handle<> handle = *it;
+            executor->execute([handle] { handle.resume(); });
+        }
+    }
+}
+
+#endif // COROUTINE_HPP
@@ -0,0 +1,380 @@
+#ifndef EVENTHUB_HPP
+#define EVENTHUB_HPP
+
+#include "ObserverPattern.hpp"
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+class EventHub                                                  // subscriptions of integer ids in one compressed table, not thread-safe
+{
+    public:
+        typedef std::uint32_t SubjectId;                        // dense, one row per id up to the largest
+        typedef std::uint32_t ObserverId;                       // any value
+
+        struct Subscription                                     // one subject and one observer, for bulk changes
+        {
+            SubjectId m_subject;                                // the subject
+            ObserverId m_observer;                              // the observer
+        };
+        struct Publication                                      // one message of a subject, for batched publish
+        {
+            SubjectId m_subject;                                // the subject
+            long m_msg;                                         // message id
+        };
+        class Row                                               // observers of one subject, sorted by id
+        {
+            public:
+                Row(const ObserverId *begin, const ObserverId *end);
+                const ObserverId* begin() const;                // first observer
+                const ObserverId* end() const;                  // past the last observer
+                std::size_t size() const;                       // number of observers
+                bool empty() const;                             // no observers
+
+            private:
+                const ObserverId *m_begin;                      // first observer
+                const ObserverId *m_end;                        // past the last observer
+        };
+
+        EventHub();                                             // constructor, no subjects
+        void reserve(std::size_t subjects, std::size_t subscriptions); // capacity of the table
+        void subscribe(SubjectId subject, ObserverId observer, MessageMask messages = MessageMask()); // staged until commit
+        void unsubscribe(SubjectId subject, ObserverId observer); // staged until commit
+        void subscribe(const Subscription *subscriptions, std::size_t count, MessageMask messages = MessageMask()); // bulk, staged until commit
+        void unsubscribe(const Subscription *subscriptions, std::size_t count); // bulk, staged until commit
+        void removeSubject(SubjectId subject);                  // drop all subscriptions of subject, staged until commit
+        void removeObserver(ObserverId observer);               // drop all subscriptions of observer, staged until commit
+        void commit();                                          // merge staged changes into the table, O(table + changes log changes)
+        template<typename F>
+        std::size_t publish(SubjectId subject, long msg, F deliver); // commit, invoke deliver(observer, subject, msg) per match, number invoked
+        template<typename F>
+        std::size_t publishBatch(const Publication *publications, std::size_t count, F deliver); // publish many, walks the table in subject order
+        Row getObservers(SubjectId subject);                    // commit, observers of subject, invalidated by the next commit
+        std::size_t getSubjectCount() const;                    // rows in the table
+        std::size_t getSubscriptionCount() const;               // subscriptions in the table, staged ones excluded
+        std::size_t getPendingCount() const;                    // changes staged
+
+    private:
+        EventHub(const EventHub&) = delete;                     // disable copy from left value
+        EventHub& operator=(const EventHub&) = delete;          // disable assign from left value
+
+        struct Change                                           // staged subscribe or unsubscribe
+        {
+            SubjectId m_subject;                                // the subject
+            ObserverId m_observer;                              // the observer
+            std::uint64_t m_messages;                           // MessageMask bits, subscribe only
+            std::uint64_t m_sequence;                           // order of staging, the last change of a pair wins
+            bool m_subscribe;                                   // subscribe or unsubscribe
+        };
+        typedef std::pair<std::uint32_t, std::uint64_t> Removal; // id and sequence of removeSubject or removeObserver
+
+        template<typename F>
+        std::size_t publishRow(SubjectId subject, long msg, F &deliver) const; // one row, table committed
+        static void latestOnly(std::vector<Removal> &removals); // sort by id, keep the latest of each
+        static std::uint64_t removedAt(const std::vector<Removal> &removals, std::uint32_t id); // sequence of removal of id, 0 if none
+        void append(ObserverId observer, std::uint64_t messages); // one subscription at the end of the new row
+
+        std::vector<std::uint32_t> m_offsets;                   // row of subject s is [m_offsets[s], m_offsets[s + 1])
+        std::vector<ObserverId> m_observers;                    // observers of all rows, sorted within a row
+        std::vector<std::uint64_t> m_messages;                  // MessageMask bits, parallel to m_observers
+        std::vector<Change> m_changes;                          // staged changes
+        std::vector<Removal> m_removedSubjects;                 // staged removeSubject
+        std::vector<Removal> m_removedObservers;                // staged removeObserver
+        std::vector<ObserverId> m_nextObservers;                // table being built by commit, capacity kept
+        std::vector<std::uint64_t> m_nextMessages;              // table being built by commit, capacity kept
+        std::uint64_t m_sequence;                               // last sequence given
+        unsigned m_publishing;                                  // depth of nested publish, commit waits until 0
+};
+
+
+
+inline EventHub::Row::Row(const ObserverId *begin, const ObserverId *end): m_begin(begin), m_end(end) {}
+
+inline const EventHub::ObserverId* EventHub::Row::begin() const
+{
+    return m_begin;
+}
+
+inline const EventHub::ObserverId* EventHub::Row::end() const
+{
+    return m_end;
+}
+
+inline std::size_t EventHub::Row::size() const
+{
+    return static_cast<std::size_t>(m_end - m_begin);
+}
+
+inline bool EventHub::Row::empty() const
+{
+    return m_begin == m_end;
+}
+
+
+
+inline EventHub::EventHub(): m_offsets(1, 0), m_sequence(0), m_publishing(0) {}
+
+inline void EventHub::reserve(std::size_t subjects, std::size_t subscriptions)
+{
+    m_offsets.reserve(subjects + 1);
+    m_observers.reserve(subscriptions);
+    m_messages.reserve(subscriptions);
+}
+
+inline void EventHub::subscribe(SubjectId subject, ObserverId observer, MessageMask messages)
+{
+    Change change = { subject, observer, messages.bits(), ++m_sequence, true };
+    m_changes.push_back(change);
+}
+
+inline void EventHub::unsubscribe(SubjectId subject, ObserverId observer)
+{
+    Change change = { subject, observer, 0, ++m_sequence, false };
+    m_changes.push_back(change);
+}
+
+inline void EventHub::subscribe(const Subscription *subscriptions, std::size_t count, MessageMask messages)
+{
+    m_changes.reserve(m_changes.size() + count);
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        subscribe(subscriptions[i].m_subject, subscriptions[i].m_observer, messages);
+    }
+}
+
+inline void EventHub::unsubscribe(const Subscription *subscriptions, std::size_t count)
+{
+    m_changes.reserve(m_changes.size() + count);
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        unsubscribe(subscriptions[i].m_subject, subscriptions[i].m_observer);
+    }
+}
+
+inline void EventHub::removeSubject(SubjectId subject)
+{
+    m_removedSubjects.push_back(Removal(subject, ++m_sequence));
+}
+
+inline void EventHub::removeObserver(ObserverId observer)
+{
+    m_removedObservers.push_back(Removal(observer, ++m_sequence));
+}
+
+inline void EventHub::commit()
+{
+    if (m_publishing || (m_changes.empty() && m_removedSubjects.empty() && m_removedObservers.empty()))
+    {
+        return;                                                 // rows MUST not move during publish
+    }
+
+    std::sort(m_changes.begin(), m_changes.end(), [](const Change &a, const Change &b)
+    {
+        if (a.m_subject != b.m_subject)
+        {
+            return a.m_subject < b.m_subject;
+        }
+        return a.m_observer != b.m_observer ? a.m_observer < b.m_observer : a.m_sequence < b.m_sequence;
+    });
+    latestOnly(m_removedSubjects);
+    latestOnly(m_removedObservers);
+
+    std::size_t subjects = m_offsets.size() - 1;
+    if (!m_changes.empty() && m_changes.back().m_subject >= subjects)
+    {
+        subjects = static_cast<std::size_t>(m_changes.back().m_subject) + 1;
+    }
+
+    // merge each old row, sorted by observer, with the changes of its subject, sorted the same way
+    m_nextObservers.clear();
+    m_nextMessages.clear();
+    m_nextObservers.reserve(m_observers.size() + m_changes.size());
+    m_nextMessages.reserve(m_observers.size() + m_changes.size());
+    const std::size_t rows = m_offsets.size() - 1;
+    m_offsets.resize(subjects + 1, static_cast<std::uint32_t>(m_observers.size()));
+    auto change = m_changes.begin();
+    std::uint32_t begin = m_offsets[0];
+    for (std::size_t s = 0; s < subjects; ++s)
+    {
+        const std::uint32_t end = s < rows ? m_offsets[s + 1] : begin;
+        m_offsets[s] = static_cast<std::uint32_t>(m_nextObservers.size());
+        const std::uint64_t subjectRemoved = removedAt(m_removedSubjects, static_cast<std::uint32_t>(s));
+        std::uint32_t i = begin;
+        while (i < end || (change != m_changes.end() && change->m_subject == s))
+        {
+            const bool fromChange = change != m_changes.end() && change->m_subject == s &&
+                                    (i == end || change->m_observer <= m_observers[i]);
+            if (!fromChange)
+            {
+                // older than every staged change, kept unless removed
+                if (!subjectRemoved && !removedAt(m_removedObservers, m_observers[i]))
+                {
+                    append(m_observers[i], m_messages[i]);
+                }
+                ++i;
+                continue;
+            }
+
+            auto last = change;
+            while (last + 1 != m_changes.end() && (last + 1)->m_subject == s && (last + 1)->m_observer == change->m_observer)
+            {
+                ++last;                                         // the last change of a pair wins
+            }
+            if (i < end && m_observers[i] == change->m_observer)
+            {
+                ++i;                                            // replaced by the change
+            }
+            if (last->m_subscribe && last->m_sequence > subjectRemoved &&
+                last->m_sequence > removedAt(m_removedObservers, last->m_observer))
+            {
+                append(last->m_observer, last->m_messages);
+            }
+            change = last + 1;
+        }
+        begin = end;
+    }
+    m_offsets[subjects] = static_cast<std::uint32_t>(m_nextObservers.size());
+
+    m_observers.swap(m_nextObservers);
+    m_messages.swap(m_nextMessages);
+    m_changes.clear();
+    m_removedSubjects.clear();
+    m_removedObservers.clear();
+}
+
+template<typename F>
+std::size_t EventHub::publish(SubjectId subject, long msg, F deliver)
+{
+    commit();
+    struct PublishGuard                                         // leave publish even if deliver throws
+    {
+        unsigned &m_publishing;
+        ~PublishGuard() { --m_publishing; }
+    } publishGuard = { ++m_publishing };
+    return publishRow(subject, msg, deliver);
+}
+
+template<typename F>
+std::size_t EventHub::publishBatch(const Publication *publications, std::size_t count, F deliver)
+{
+    commit();
+    struct PublishGuard                                         // leave publish even if deliver throws
+    {
+        unsigned &m_publishing;
+        ~PublishGuard() { --m_publishing; }
+    } publishGuard = { ++m_publishing };
+
+    std::size_t delivered = 0;
+    std::size_t i = 1;
+    while (i < count && publications[i - 1].m_subject <= publications[i].m_subject)
+    {
+        ++i;
+    }
+    if (i >= count)
+    {
+        // already in subject order, the common case of a batch built by walking the subjects
+        for (i = 0; i < count; ++i)
+        {
+            delivered += publishRow(publications[i].m_subject, publications[i].m_msg, deliver);
+        }
+        return delivered;
+    }
+
+    // visit rows in table order, messages of one subject keep their order
+    std::vector<const Publication*> order(count);
+    for (i = 0; i < count; ++i)
+    {
+        order[i] = publications + i;
+    }
+    std::stable_sort(order.begin(), order.end(), [](const Publication *a, const Publication *b)
+    {
+        return a->m_subject < b->m_subject;
+    });
+    for (auto it = order.begin(); it != order.end(); ++it)
+    {
+        delivered += publishRow((*it)->m_subject, (*it)->m_msg, deliver);
+    }
+    return delivered;
+}
+
+inline EventHub::Row EventHub::getObservers(SubjectId subject)
+{
+    commit();
+    if (subject >= m_offsets.size() - 1)
+    {
+        return Row(nullptr, nullptr);
+    }
+    return Row(m_observers.data() + m_offsets[subject], m_observers.data() + m_offsets[subject + 1]);
+}
+
+inline std::size_t EventHub::getSubjectCount() const
+{
+    return m_offsets.size() - 1;
+}
+
+inline std::size_t EventHub::getSubscriptionCount() const
+{
+    return m_observers.size();
+}
+
+inline std::size_t EventHub::getPendingCount() const
+{
+    return m_changes.size() + m_removedSubjects.size() + m_removedObservers.size();
+}
+
+template<typename F>
+std::size_t EventHub::publishRow(SubjectId subject, long msg, F &deliver) const
+{
+    if (subject >= m_offsets.size() - 1)
+    {
+        return 0;                                               // never subscribed
+    }
+
+    // changes staged during publish wait for the next commit, the row is walked as committed
+    const std::uint64_t bits = MessageMask::bitOf(msg);
+    const std::uint32_t end = m_offsets[subject + 1];
+    std::size_t delivered = 0;
+    for (std::uint32_t i = m_offsets[subject]; i < end; ++i)
+    {
+        if (m_messages[i] & bits)
+        {
+            ++delivered;
+            deliver(m_observers[i], subject, msg);
+        }
+    }
+    return delivered;
+}
+
+inline void EventHub::latestOnly(std::vector<Removal> &removals)
+{
+    std::sort(removals.begin(), removals.end());
+    auto out = removals.begin();
+    for (auto it = removals.begin(); it != removals.end(); ++it)
+    {
+        if (it + 1 == removals.end() || (it + 1)->first != it->first)
+        {
+            *out++ = *it;                                       // sorted by sequence within an id, the last is the latest
+        }
+    }
+    removals.erase(out, removals.end());
+}
+
+inline std::uint64_t EventHub::removedAt(const std::vector<Removal> &removals, std::uint32_t id)
+{
+    if (removals.empty())
+    {
+        return 0;                                               // most commits, no lookup
+    }
+    auto it = std::lower_bound(removals.begin(), removals.end(), Removal(id, 0));
+    return it != removals.end() && it->first == id ? it->second : 0;
+}
+
+inline void EventHub::append(ObserverId observer, std::uint64_t messages)
+{
+    m_nextObservers.push_back(observer);
+    m_nextMessages.push_back(messages);
+}
+
+#endif // EVENTHUB_HPP
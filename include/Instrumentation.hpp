@@ -0,0 +1,526 @@
+#ifndef INSTRUMENTATION_HPP
+#define INSTRUMENTATION_HPP
+
+// compiled only when OBSERVERPATTERN_INSTRUMENTATION is defined, included by ObserverPattern.hpp
+
+#include <cstddef>
+#include <cstdint>
+#include <atomic>
+#include <chrono>
+#include <vector>
+#include <ostream>
+#include <mutex>
+
+class SubjectImpl;                                              // forward declaration
+class ObserverImpl;                                             // forward declaration
+
+class HistogramSnapshot                                         // copy of a LatencyHistogram
+{
+    public:
+        HistogramSnapshot();                                    // constructor, empty
+        std::uint64_t count() const;                            // number of values recorded
+        std::uint64_t max() const;                              // largest value recorded, 0 if none
+        double mean() const;                                    // mean of values recorded, 0 if none
+        std::uint64_t percentile(double p) const;               // value at or below which p percent lie, within 1/8
+        const std::vector<std::uint64_t>& buckets() const;      // counts per bucket, see LatencyHistogram
+
+    private:
+        friend class LatencyHistogram;
+        std::vector<std::uint64_t> m_buckets;                   // counts per bucket
+        std::uint64_t m_count;                                  // number of values
+        std::uint64_t m_sum;                                    // sum of values
+        std::uint64_t m_max;                                    // largest value
+};
+
+class LatencyHistogram                                          // HDR-style log-linear histogram of nanoseconds, lock-free
+{
+    public:
+        static const unsigned SubBits = 3;                      // 8 buckets per power of 2, within 12.5%
+        static const unsigned SubBuckets = 1u << SubBits;
+        static const unsigned MaxMagnitude = 47;                // values above 2^48 ns, about 3 days, share the last buckets
+        static const unsigned BucketCount = (MaxMagnitude - SubBits + 2) * SubBuckets;
+
+        LatencyHistogram();                                     // constructor, empty
+        void record(std::uint64_t value);                       // add one value, wait-free
+        HistogramSnapshot snapshot() const;                     // copy, concurrent record may or may not be seen
+        void reset();                                           // empty, not concurrently with record
+        static unsigned bucketOf(std::uint64_t value);          // bucket holding value
+        static std::uint64_t lowerBound(unsigned bucket);       // smallest value of bucket
+
+    private:
+        LatencyHistogram(const LatencyHistogram&) = delete;     // disable copy from left value
+        LatencyHistogram& operator=(const LatencyHistogram&) = delete; // disable assign from left value
+        std::atomic<std::uint64_t> m_buckets[BucketCount];      // counts per bucket
+        std::atomic<std::uint64_t> m_count;                     // number of values
+        std::atomic<std::uint64_t> m_sum;                       // sum of values
+        std::atomic<std::uint64_t> m_max;                       // largest value
+};
+
+struct ObserverStatsSnapshot                                    // copy of ObserverStats
+{
+    const ObserverImpl *m_observer;                             // the observer, for identification only
+    std::uint64_t m_updates;                                    // update invoked
+    std::uint64_t m_rejected;                                   // update returned false
+    std::uint64_t m_slow;                                       // update took longer than the slow threshold
+    HistogramSnapshot m_latency;                                // nanoseconds per update
+
+    double rejectRate() const;                                  // share of update returned false
+};
+
+class ObserverStats                                             // counters of one observer of one subject
+{
+    public:
+        ObserverStats();                                        // constructor, all zero
+        void record(const SubjectImpl *subject, const ObserverImpl *observer, std::uint64_t ns, bool accepted); // one update
+        ObserverStatsSnapshot snapshot(const ObserverImpl *observer) const; // copy
+        void reset();                                           // all zero, not concurrently with record
+
+    private:
+        ObserverStats(const ObserverStats&) = delete;           // disable copy from left value
+        ObserverStats& operator=(const ObserverStats&) = delete; // disable assign from left value
+        std::atomic<std::uint64_t> m_updates;                   // update invoked
+        std::atomic<std::uint64_t> m_rejected;                  // update returned false
+        std::atomic<std::uint64_t> m_slow;                      // update slower than threshold
+        LatencyHistogram m_latency;                             // nanoseconds per update
+};
+
+struct SubjectStatsSnapshot                                     // copy of SubjectStats and the stats of its observers
+{
+    std::uint64_t m_notifies;                                   // synchronous notify
+    std::uint64_t m_deliveries;                                 // update invoked by synchronous notify, sum of fan-out
+    std::uint64_t m_maxFanOut;                                  // most update invoked by one notify
+    HistogramSnapshot m_latency;                                // nanoseconds per notify, all observers
+    std::vector<ObserverStatsSnapshot> m_observers;             // observers observing that got an update, in order of their first one
+
+    double meanFanOut() const;                                  // update invoked per notify
+    void writeJson(std::ostream &out) const;                    // export as one JSON object
+};
+
+class SubjectStats                                              // counters of one subject
+{
+    public:
+        SubjectStats();                                         // constructor, all zero
+        void record(std::uint64_t ns, std::uint64_t fanOut);    // one notify
+        SubjectStatsSnapshot snapshot() const;                  // copy, without observers
+
+    private:
+        SubjectStats(const SubjectStats&) = delete;             // disable copy from left value
+        SubjectStats& operator=(const SubjectStats&) = delete;  // disable assign from left value
+        std::atomic<std::uint64_t> m_notifies;                  // synchronous notify
+        std::atomic<std::uint64_t> m_deliveries;                // update invoked by notify
+        std::atomic<std::uint64_t> m_maxFanOut;                 // most update by one notify
+        LatencyHistogram m_latency;                             // nanoseconds per notify
+};
+
+class StatsTable                                                // counters of a subject and of its observers, allocated at its first notify
+{
+    public:
+        StatsTable();                                           // constructor, no observer
+        ~StatsTable();                                          // destrctor
+        SubjectStats& subject();                                // counters of notify
+        ObserverStats* claim(const ObserverImpl *observer);     // entry of an observer at its first update, a released one if any
+        void release(ObserverStats *stats);                     // entry of an observer stopped observing, no update records into it any more, nullptr ignored
+        SubjectStatsSnapshot snapshot() const;                  // copy from any thread, lock-free, observers in order of their first update
+
+    private:
+        struct Entry : ObserverStats                            // counters of one observer, freed with the table only
+        {
+            Entry();                                            // constructor, free
+            std::atomic<const ObserverImpl*> m_observer;        // the observer, nullptr while free
+            std::atomic<Entry*> m_next;                         // next entry, in order of first claim
+        };
+
+        StatsTable(const StatsTable&) = delete;                 // disable copy from left value
+        StatsTable& operator=(const StatsTable&) = delete;      // disable assign from left value
+        SubjectStats m_subject;                                 // counters of notify
+        std::atomic<Entry*> m_head;                             // first entry, readers walk m_next without a lock
+        Entry *m_tail;                                          // last entry, m_lock locked
+        std::vector<Entry*> m_free;                             // released entries, m_lock locked
+        std::mutex m_lock;                                      // guard claim and release
+};
+
+class Instrumentation                                           // global settings of slow-observer detection
+{
+    public:
+        typedef void (*SlowHandler)(const SubjectImpl *subject, const ObserverImpl *observer, std::uint64_t ns);
+        typedef std::chrono::steady_clock Clock;
+
+        static void setSlowThreshold(std::uint64_t ns);         // update taking at least ns is slow, 0 to disable
+        static std::uint64_t getSlowThreshold();                // current threshold, 0 if disabled
+        static void setSlowHandler(SlowHandler handler);        // invoked on the notifying thread for each slow update
+        static SlowHandler getSlowHandler();                    // current handler, nullptr if none
+        static std::uint64_t since(Clock::time_point start);    // nanoseconds since start
+        template<typename F, typename S>
+        static bool update(const SubjectImpl *subject, ObserverImpl *observer, F &deliver, S statsOf); // timed deliver, recorded into statsOf() unless nullptr
+
+    private:
+        static std::atomic<std::uint64_t>& threshold();         // slow threshold in nanoseconds
+        static std::atomic<SlowHandler>& handler();             // slow handler
+};
+
+class NotifyProbe                                               // times one notify and counts its fan-out
+{
+    public:
+        explicit NotifyProbe(SubjectStats &stats);              // constructor, start timing
+        ~NotifyProbe();                                         // destrctor, record
+        void delivered(std::uint64_t count = 1);                // count more update
+
+    private:
+        NotifyProbe(const NotifyProbe&) = delete;               // disable copy from left value
+        NotifyProbe& operator=(const NotifyProbe&) = delete;    // disable assign from left value
+        SubjectStats &m_stats;                                  // the subject's stats
+        Instrumentation::Clock::time_point m_start;             // when notify began
+        std::uint64_t m_fanOut;                                 // update invoked so far
+};
+
+
+
+inline HistogramSnapshot::HistogramSnapshot(): m_buckets(LatencyHistogram::BucketCount, 0), m_count(0), m_sum(0), m_max(0) {}
+
+inline std::uint64_t HistogramSnapshot::count() const
+{
+    return m_count;
+}
+
+inline std::uint64_t HistogramSnapshot::max() const
+{
+    return m_max;
+}
+
+inline double HistogramSnapshot::mean() const
+{
+    return m_count ? static_cast<double>(m_sum) / m_count : 0;
+}
+
+inline std::uint64_t HistogramSnapshot::percentile(double p) const
+{
+    std::uint64_t total = 0;
+    for (auto it = m_buckets.begin(); it != m_buckets.end(); ++it)
+    {
+        total += *it;                                           // the buckets, m_count may be ahead of them
+    }
+    if (total == 0)
+    {
+        return 0;
+    }
+    std::uint64_t rank = static_cast<std::uint64_t>(p / 100 * total + 0.5);
+    rank = rank < 1 ? 1 : (rank > total ? total : rank);
+    std::uint64_t seen = 0;
+    for (unsigned i = 0; i < LatencyHistogram::BucketCount; ++i)
+    {
+        seen += m_buckets[i];
+        if (seen >= rank)
+        {
+            return LatencyHistogram::lowerBound(i);
+        }
+    }
+    return m_max;
+}
+
+inline const std::vector<std::uint64_t>& HistogramSnapshot::buckets() const
+{
+    return m_buckets;
+}
+
+
+
+inline LatencyHistogram::LatencyHistogram(): m_count(0), m_sum(0), m_max(0)
+{
+    reset();
+}
+
+inline void LatencyHistogram::reset()
+{
+    for (unsigned i = 0; i < BucketCount; ++i)
+    {
+        m_buckets[i].store(0, std::memory_order_relaxed);
+    }
+    m_count.store(0, std::memory_order_relaxed);
+    m_sum.store(0, std::memory_order_relaxed);
+    m_max.store(0, std::memory_order_relaxed);
+}
+
+inline void LatencyHistogram::record(std::uint64_t value)
+{
+    // relaxed, counters are statistics, no other data is published through them
+    m_buckets[bucketOf(value)].fetch_add(1, std::memory_order_relaxed);
+    m_count.fetch_add(1, std::memory_order_relaxed);
+    m_sum.fetch_add(value, std::memory_order_relaxed);
+    std::uint64_t max = m_max.load(std::memory_order_relaxed);
+    while (value > max && !m_max.compare_exchange_weak(max, value, std::memory_order_relaxed)) {}
+}
+
+inline HistogramSnapshot LatencyHistogram::snapshot() const
+{
+    HistogramSnapshot snapshot;
+    for (unsigned i = 0; i < BucketCount; ++i)
+    {
+        snapshot.m_buckets[i] = m_buckets[i].load(std::memory_order_relaxed);
+    }
+    snapshot.m_count = m_count.load(std::memory_order_relaxed);
+    snapshot.m_sum = m_sum.load(std::memory_order_relaxed);
+    snapshot.m_max = m_max.load(std::memory_order_relaxed);
+    return snapshot;
+}
+
+inline unsigned LatencyHistogram::bucketOf(std::uint64_t value)
+{
+    if (value < SubBuckets)
+    {
+        return static_cast<unsigned>(value);                    // exact
+    }
+    unsigned magnitude = 63;
+    while (!(value >> magnitude))
+    {
+        --magnitude;                                            // position of highest bit
+    }
+    if (magnitude > MaxMagnitude)
+    {
+        return BucketCount - 1;
+    }
+    const unsigned sub = static_cast<unsigned>(value >> (magnitude - SubBits)) & (SubBuckets - 1);
+    return (magnitude - SubBits + 1) * SubBuckets + sub;
+}
+
+inline std::uint64_t LatencyHistogram::lowerBound(unsigned bucket)
+{
+    if (bucket < SubBuckets)
+    {
+        return bucket;
+    }
+    const unsigned magnitude = bucket / SubBuckets + SubBits - 1;
+    return static_cast<std::uint64_t>(SubBuckets + bucket % SubBuckets) << (magnitude - SubBits);
+}
+
+
+
+inline double ObserverStatsSnapshot::rejectRate() const
+{
+    return m_updates ? static_cast<double>(m_rejected) / m_updates : 0;
+}
+
+inline ObserverStats::ObserverStats(): m_updates(0), m_rejected(0), m_slow(0) {}
+
+inline void ObserverStats::record(const SubjectImpl *subject, const ObserverImpl *observer, std::uint64_t ns, bool accepted)
+{
+    m_updates.fetch_add(1, std::memory_order_relaxed);
+    if (!accepted)
+    {
+        m_rejected.fetch_add(1, std::memory_order_relaxed);
+    }
+    m_latency.record(ns);
+    const std::uint64_t threshold = Instrumentation::getSlowThreshold();
+    if (threshold && ns >= threshold)
+    {
+        m_slow.fetch_add(1, std::memory_order_relaxed);
+        if (Instrumentation::SlowHandler handler = Instrumentation::getSlowHandler())
+        {
+            handler(subject, observer, ns);
+        }
+    }
+}
+
+inline void ObserverStats::reset()
+{
+    m_updates.store(0, std::memory_order_relaxed);
+    m_rejected.store(0, std::memory_order_relaxed);
+    m_slow.store(0, std::memory_order_relaxed);
+    m_latency.reset();
+}
+
+inline ObserverStatsSnapshot ObserverStats::snapshot(const ObserverImpl *observer) const
+{
+    ObserverStatsSnapshot snapshot;
+    snapshot.m_observer = observer;
+    snapshot.m_updates = m_updates.load(std::memory_order_relaxed);
+    snapshot.m_rejected = m_rejected.load(std::memory_order_relaxed);
+    snapshot.m_slow = m_slow.load(std::memory_order_relaxed);
+    snapshot.m_latency = m_latency.snapshot();
+    return snapshot;
+}
+
+
+
+inline double SubjectStatsSnapshot::meanFanOut() const
+{
+    return m_notifies ? static_cast<double>(m_deliveries) / m_notifies : 0;
+}
+
+inline void SubjectStatsSnapshot::writeJson(std::ostream &out) const
+{
+    out << "{\"notifies\": " << m_notifies << ", \"deliveries\": " << m_deliveries
+        << ", \"max_fan_out\": " << m_maxFanOut << ", \"p50_ns\": " << m_latency.percentile(50)
+        << ", \"p99_ns\": " << m_latency.percentile(99) << ", \"max_ns\": " << m_latency.max() << ", \"observers\": [";
+    for (auto it = m_observers.begin(); it != m_observers.end(); ++it)
+    {
+        out << (it == m_observers.begin() ? "" : ", ")
+            << "{\"observer\": \"" << static_cast<const void*>(it->m_observer) << "\", \"updates\": " << it->m_updates
+            << ", \"rejected\": " << it->m_rejected << ", \"slow\": " << it->m_slow
+            << ", \"p50_ns\": " << it->m_latency.percentile(50) << ", \"p99_ns\": " << it->m_latency.percentile(99)
+            << ", \"max_ns\": " << it->m_latency.max() << "}";
+    }
+    out << "]}";
+}
+
+inline SubjectStats::SubjectStats(): m_notifies(0), m_deliveries(0), m_maxFanOut(0) {}
+
+inline void SubjectStats::record(std::uint64_t ns, std::uint64_t fanOut)
+{
+    m_notifies.fetch_add(1, std::memory_order_relaxed);
+    m_deliveries.fetch_add(fanOut, std::memory_order_relaxed);
+    std::uint64_t max = m_maxFanOut.load(std::memory_order_relaxed);
+    while (fanOut > max && !m_maxFanOut.compare_exchange_weak(max, fanOut, std::memory_order_relaxed)) {}
+    m_latency.record(ns);
+}
+
+inline SubjectStatsSnapshot SubjectStats::snapshot() const
+{
+    SubjectStatsSnapshot snapshot;
+    snapshot.m_notifies = m_notifies.load(std::memory_order_relaxed);
+    snapshot.m_deliveries = m_deliveries.load(std::memory_order_relaxed);
+    snapshot.m_maxFanOut = m_maxFanOut.load(std::memory_order_relaxed);
+    snapshot.m_latency = m_latency.snapshot();
+    return snapshot;
+}
+
+
+
+inline StatsTable::Entry::Entry(): m_observer(nullptr), m_next(nullptr) {}
+
+inline StatsTable::StatsTable(): m_head(nullptr), m_tail(nullptr) {}
+
+inline StatsTable::~StatsTable()
+{
+    for (Entry *entry = m_head.load(); entry;)
+    {
+        Entry *next = entry->m_next.load();
+        delete entry;
+        entry = next;
+    }
+}
+
+inline SubjectStats& StatsTable::subject()
+{
+    return m_subject;
+}
+
+inline ObserverStats* StatsTable::claim(const ObserverImpl *observer)
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    Entry *entry = nullptr;
+    if (!m_free.empty())
+    {
+        entry = m_free.back();                                  // zeroed by release
+        m_free.pop_back();
+    }
+    else
+    {
+        // order matters, the entry MUST be complete before readers can reach it
+        entry = new Entry;
+        (m_tail ? m_tail->m_next : m_head).store(entry, std::memory_order_release);
+        m_tail = entry;
+    }
+    entry->m_observer.store(observer, std::memory_order_release);
+    return entry;
+}
+
+inline void StatsTable::release(ObserverStats *stats)
+{
+    if (!stats)
+    {
+        return;                                                 // never updated, never claimed
+    }
+    Entry *entry = static_cast<Entry*>(stats);
+    entry->m_observer.store(nullptr, std::memory_order_release);  // readers skip it from now on
+    entry->reset();
+    std::lock_guard<std::mutex> lock(m_lock);
+    m_free.push_back(entry);
+}
+
+inline SubjectStatsSnapshot StatsTable::snapshot() const
+{
+    SubjectStatsSnapshot snapshot = m_subject.snapshot();
+    for (const Entry *entry = m_head.load(std::memory_order_acquire); entry; entry = entry->m_next.load(std::memory_order_acquire))
+    {
+        const ObserverImpl *observer = entry->m_observer.load(std::memory_order_acquire);
+        if (!observer)
+        {
+            continue;                                           // free
+        }
+        ObserverStatsSnapshot stats = entry->snapshot(observer);
+        if (entry->m_observer.load(std::memory_order_acquire) == observer)
+        {
+            snapshot.m_observers.push_back(stats);              // not released while copied
+        }
+    }
+    return snapshot;
+}
+
+
+
+inline void Instrumentation::setSlowThreshold(std::uint64_t ns)
+{
+    threshold().store(ns, std::memory_order_relaxed);
+}
+
+inline std::uint64_t Instrumentation::getSlowThreshold()
+{
+    return threshold().load(std::memory_order_relaxed);
+}
+
+inline void Instrumentation::setSlowHandler(SlowHandler slowHandler)
+{
+    handler().store(slowHandler);
+}
+
+inline Instrumentation::SlowHandler Instrumentation::getSlowHandler()
+{
+    return handler().load();
+}
+
+inline std::uint64_t Instrumentation::since(Clock::time_point start)
+{
+    return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count());
+}
+
+template<typename F, typename S>
+bool Instrumentation::update(const SubjectImpl *subject, ObserverImpl *observer, F &deliver, S statsOf)
+{
+    const Clock::time_point start = Clock::now();
+    const bool accepted = deliver(observer);
+    // nothing recorded if update throws, stats are looked up only now,
+    // an observer that stopped observing in its update may be destroyed already
+    if (ObserverStats *stats = statsOf())
+    {
+        stats->record(subject, observer, since(start), accepted);
+    }
+    return accepted;
+}
+
+inline std::atomic<std::uint64_t>& Instrumentation::threshold()
+{
+    static std::atomic<std::uint64_t> ns(0);
+    return ns;
+}
+
+inline std::atomic<Instrumentation::SlowHandler>& Instrumentation::handler()
+{
+    static std::atomic<SlowHandler> slowHandler(nullptr);
+    return slowHandler;
+}
+
+
+
+inline NotifyProbe::NotifyProbe(SubjectStats &stats): m_stats(stats), m_start(Instrumentation::Clock::now()), m_fanOut(0) {}
+
+inline NotifyProbe::~NotifyProbe()
+{
+    m_stats.record(Instrumentation::since(m_start), m_fanOut);
+}
+
+inline void NotifyProbe::delivered(std::uint64_t count)
+{
+    m_fanOut += count;
+}
+
+#endif // INSTRUMENTATION_HPP
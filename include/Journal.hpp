@@ -0,0 +1,553 @@
+#ifndef JOURNAL_HPP
+#define JOURNAL_HPP
+
+// notify records itself only when OBSERVERPATTERN_JOURNAL is defined, included by ObserverPattern.hpp then,
+// JournalReplayer works without it, POSIX only
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+template<typename T, typename... Options>
+class Subject;                                                  // forward declaration
+
+struct JournalRecord                                            // one notify(msg), fixed size
+{
+    static const std::uint32_t UnknownFanOut = 0xFFFFFFFF;      // m_fanOut of a notify that did not update in place
+
+    std::uint64_t m_time;                                       // nanoseconds since recording started
+    std::int64_t m_msg;                                         // message id
+    std::uint32_t m_subject;                                    // journal id of the subject, 0 if none given
+    std::uint32_t m_fanOut;                                     // update invoked by the notify, UnknownFanOut if deferred by a batch or an engine, or sent by notifyBatch
+};
+
+struct JournalHeader                                            // first bytes of a journal file, records follow
+{
+    char m_magic[8];                                            // "OPJRNL1", with the terminating 0
+    std::uint32_t m_recordSize;                                 // sizeof(JournalRecord)
+    std::uint32_t m_stopped;                                    // 1 once written by stop, 0 while recording or if the recorder died
+    std::atomic<std::uint64_t> m_records;                       // records reserved, raised by every copy into the file, exact once stopped
+    std::uint64_t m_dropped;                                    // records lost for lack of capacity, written by stop
+    std::uint64_t m_start;                                      // system clock nanoseconds since epoch when recording started
+};
+
+static_assert(sizeof(std::atomic<std::uint64_t>) == sizeof(std::uint64_t), "journal header layout");
+
+class JournalRecorder                                           // appends notify records to a memory-mapped file, one active at a time
+{
+    public:
+        JournalRecorder();                                      // constructor, not recording
+        ~JournalRecorder();                                     // destrctor, stop
+        bool start(const char *path, std::size_t capacity);     // create file for capacity records and record into it, false if failed or another records
+        void stop();                                            // flush all threads, shrink file to the records, no record from now on
+        bool isRecording() const;                               // between start and stop
+        std::uint64_t getRecorded() const;                      // records in the file, those buffered by threads not yet included, kept after stop
+        std::uint64_t getDropped() const;                       // records lost for lack of capacity
+        static void record(std::uint32_t subject, long msg, std::uint32_t fanOut, std::uint64_t time); // hook, time from now()
+        static std::uint64_t now();                             // steady clock nanoseconds
+        static bool active();                                   // whether a recorder records, cheap
+
+    private:
+        JournalRecorder(const JournalRecorder&) = delete;       // disable copy from left value
+        JournalRecorder& operator=(const JournalRecorder&) = delete; // disable assign from left value
+
+        static const std::size_t BufferRecords = 128;           // records per thread before they go to the file
+        struct ThreadBuffer                                     // records of one thread not in the file yet, lives as long as the thread
+        {
+            ThreadBuffer();                                     // constructor, register
+            ~ThreadBuffer();                                    // destrctor, unregister and flush
+            std::atomic<bool> m_busy;                           // owner thread writing, stop waits
+            std::size_t m_count;                                // records buffered
+            JournalRecord m_records[BufferRecords];             // records buffered
+        };
+
+        void append(const JournalRecord *records, std::size_t count); // reserve in the header and copy into the file, lock-free
+        static ThreadBuffer& threadBuffer();                    // buffer of current thread
+        static std::atomic<JournalRecorder*>& current();        // recorder recording, nullptr if none
+        static std::mutex& registryLock();                      // guard registry
+        static std::vector<ThreadBuffer*>& registry();          // buffers of live threads
+
+        int m_file;                                             // file descriptor, -1 if not recording
+        void *m_map;                                            // whole file mapped
+        std::size_t m_mapSize;                                  // bytes mapped
+        JournalHeader *m_header;                                // header of the file, its m_records reserves space, may exceed m_capacity
+        JournalRecord *m_records;                               // records in the file
+        std::size_t m_capacity;                                 // records the file holds
+        std::uint64_t m_start;                                  // steady clock nanoseconds when started
+        std::uint64_t m_recorded;                               // records in the file once stopped
+        std::atomic<std::uint64_t> m_dropped;                   // records lost for lack of capacity
+};
+
+class JournalEntry                                              // one notify(msg) being recorded, on the stack of notify
+{
+    public:
+        JournalEntry(std::uint32_t subject, long msg);          // constructor, take the time
+        ~JournalEntry();                                        // destrctor, record
+        static JournalEntry* claim();                           // entry of the notify on this thread, once, nullptr if none, by notifyWith
+        void delivered(std::uint32_t fanOut);                   // update invoked by notifyWith
+
+    private:
+        JournalEntry(const JournalEntry&) = delete;             // disable copy from left value
+        JournalEntry& operator=(const JournalEntry&) = delete;  // disable assign from left value
+        static JournalEntry*& pending();                        // entry not claimed yet on current thread
+
+        const std::uint32_t m_subject;                          // journal id of the subject
+        const long m_msg;                                       // message id
+        const bool m_active;                                    // recorder active at construction
+        std::uint32_t m_fanOut;                                 // update invoked, UnknownFanOut unless claimed
+        std::uint64_t m_time;                                   // steady clock nanoseconds at construction
+        JournalEntry *m_prev;                                   // pending entry of the enclosing notify
+};
+
+class JournalReplayer                                           // drives bound subjects from a journal file
+{
+    public:
+        typedef std::function<void(long msg)> Target;           // receives the messages of one journaled subject
+
+        JournalReplayer();                                      // constructor, no journal
+        ~JournalReplayer();                                     // destrctor, close
+        bool open(const char *path);                            // map a journal read only, false if missing or not a journal
+        void close();                                           // unmap, bindings kept
+        std::size_t size() const;                               // records in the journal
+        const JournalRecord& operator[](std::size_t index) const; // records in time order
+        std::uint64_t getStart() const;                         // system clock nanoseconds since epoch when recording started
+        std::uint64_t getDropped() const;                       // records lost while recording
+        bool isComplete() const;                                // whether the recorder stopped, records still buffered by threads are missing otherwise
+        void bind(std::uint32_t subject, Target target);        // replay records of subject into target
+        template<typename T, typename... Options>
+        void bind(std::uint32_t subject, const Subject<T, Options...> *target); // replay records of subject as notify on target
+        std::size_t replay(bool originalTiming = false);        // invoke targets in time order, at full speed or with recorded gaps, records replayed
+
+    private:
+        JournalReplayer(const JournalReplayer&) = delete;       // disable copy from left value
+        JournalReplayer& operator=(const JournalReplayer&) = delete; // disable assign from left value
+        static bool written(const JournalRecord &record);       // whether a record was copied in, the file is zero filled
+
+        void *m_map;                                            // whole file mapped
+        std::size_t m_mapSize;                                  // bytes mapped
+        const JournalHeader *m_header;                          // header of the journal
+        std::uint64_t m_dropped;                                // records lost while recording
+        std::vector<const JournalRecord*> m_order;              // records sorted by time, threads flush out of order
+        std::unordered_map<std::uint32_t, Target> m_targets;    // targets by journal id
+};
+
+
+
+inline JournalRecorder::JournalRecorder():
+    m_file(-1), m_map(nullptr), m_mapSize(0), m_header(nullptr), m_records(nullptr), m_capacity(0), m_start(0), m_recorded(0),
+    m_dropped(0) {}
+
+inline JournalRecorder::~JournalRecorder()
+{
+    stop();
+}
+
+inline bool JournalRecorder::start(const char *path, std::size_t capacity)
+{
+    if (m_file >= 0 || !path || capacity == 0)
+    {
+        return false;                                           // already recording or invalid argument
+    }
+
+    const int file = ::open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (file < 0)
+    {
+        return false;
+    }
+    // sized once, records are copied in without any system call
+    const std::size_t size = sizeof(JournalHeader) + capacity * sizeof(JournalRecord);
+    void *map = MAP_FAILED;
+    if (::ftruncate(file, static_cast<off_t>(size)) == 0)
+    {
+        map = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, file, 0);
+    }
+    if (map == MAP_FAILED)
+    {
+        ::close(file);
+        return false;
+    }
+
+    // zero filled by ftruncate, m_records counts from 0
+    JournalHeader *header = static_cast<JournalHeader*>(map);
+    std::memcpy(header->m_magic, "OPJRNL1", 8);
+    header->m_recordSize = sizeof(JournalRecord);
+    header->m_start = static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count());
+    m_file = file;
+    m_map = map;
+    m_mapSize = size;
+    m_header = header;
+    m_records = reinterpret_cast<JournalRecord*>(header + 1);
+    m_capacity = capacity;
+    m_start = now();
+    m_recorded = 0;
+    m_dropped.store(0);
+
+    JournalRecorder *none = nullptr;
+    if (!current().compare_exchange_strong(none, this))
+    {
+        ::munmap(m_map, m_mapSize);
+        ::close(m_file);
+        m_file = -1;
+        m_map = nullptr;
+        m_header = nullptr;
+        return false;                                           // another recorder records
+    }
+    return true;
+}
+
+inline void JournalRecorder::stop()
+{
+    if (m_file < 0)
+    {
+        return;                                                 // not recording
+    }
+
+    // order matters, current MUST be cleared before buffers are flushed,
+    // a thread sets m_busy before it checks current, so it either sees nullptr or is waited for,
+    // and cleared under the registry lock, a thread that exits flushes its buffer either before, or after stop did
+    {
+        std::lock_guard<std::mutex> lock(registryLock());
+        current().store(nullptr);
+        std::vector<ThreadBuffer*> &buffers = registry();
+        for (auto it = buffers.begin(); it != buffers.end(); ++it)
+        {
+            while ((*it)->m_busy.load())
+            {
+                std::this_thread::yield();
+            }
+            append((*it)->m_records, (*it)->m_count);
+            (*it)->m_count = 0;
+        }
+    }
+
+    const std::uint64_t records = std::min<std::uint64_t>(m_header->m_records.load(), m_capacity);
+    m_header->m_records.store(records);
+    m_header->m_dropped = m_dropped.load();
+    m_header->m_stopped = 1;
+    m_recorded = records;
+    ::msync(m_map, m_mapSize, MS_SYNC);
+    ::munmap(m_map, m_mapSize);
+    if (::ftruncate(m_file, static_cast<off_t>(sizeof(JournalHeader) + records * sizeof(JournalRecord))) != 0)
+    {
+        // the file keeps its capacity, m_records in the header still tells the records
+    }
+    ::close(m_file);
+    m_file = -1;
+    m_map = nullptr;
+    m_header = nullptr;
+    m_records = nullptr;
+}
+
+inline bool JournalRecorder::isRecording() const
+{
+    return m_file >= 0;
+}
+
+inline std::uint64_t JournalRecorder::getRecorded() const
+{
+    return m_header ? std::min<std::uint64_t>(m_header->m_records.load(), m_capacity) : m_recorded;
+}
+
+inline std::uint64_t JournalRecorder::getDropped() const
+{
+    return m_dropped.load();
+}
+
+inline void JournalRecorder::record(std::uint32_t subject, long msg, std::uint32_t fanOut, std::uint64_t time)
+{
+    if (!active())
+    {
+        return;                                                 // not recording, no thread buffer touched
+    }
+
+    ThreadBuffer &buffer = threadBuffer();
+    buffer.m_busy.store(true);
+    if (JournalRecorder *recorder = current().load())
+    {
+        JournalRecord &record = buffer.m_records[buffer.m_count++];
+        record.m_time = time > recorder->m_start ? time - recorder->m_start : 0;
+        record.m_msg = msg;
+        record.m_subject = subject;
+        record.m_fanOut = fanOut;
+        if (buffer.m_count == BufferRecords)
+        {
+            recorder->append(buffer.m_records, buffer.m_count);
+            buffer.m_count = 0;
+        }
+    }
+    buffer.m_busy.store(false);
+}
+
+inline std::uint64_t JournalRecorder::now()
+{
+    return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+inline bool JournalRecorder::active()
+{
+    return current().load(std::memory_order_relaxed) != nullptr;
+}
+
+inline JournalRecorder::ThreadBuffer::ThreadBuffer(): m_busy(false), m_count(0)
+{
+    std::lock_guard<std::mutex> lock(registryLock());
+    registry().push_back(this);
+}
+
+inline JournalRecorder::ThreadBuffer::~ThreadBuffer()
+{
+    // registry locked, so stop can not finish before the records of this thread are in the file
+    std::lock_guard<std::mutex> lock(registryLock());
+    std::vector<ThreadBuffer*> &buffers = registry();
+    buffers.erase(std::find(buffers.begin(), buffers.end(), this));
+    if (JournalRecorder *recorder = current().load())
+    {
+        recorder->append(m_records, m_count);
+    }
+}
+
+inline void JournalRecorder::append(const JournalRecord *records, std::size_t count)
+{
+    if (count == 0)
+    {
+        return;
+    }
+    // reserved in the mapped header, a recorder that dies leaves a count that covers every record copied in
+    const std::uint64_t offset = m_header->m_records.fetch_add(count); // the only shared write, once per BufferRecords
+    std::size_t fits = count;
+    if (offset + count > m_capacity)
+    {
+        fits = offset < m_capacity ? static_cast<std::size_t>(m_capacity - offset) : 0;
+        m_dropped.fetch_add(count - fits);
+    }
+    std::memcpy(m_records + offset, records, fits * sizeof(JournalRecord));
+}
+
+inline JournalRecorder::ThreadBuffer& JournalRecorder::threadBuffer()
+{
+    static thread_local ThreadBuffer buffer;
+    return buffer;
+}
+
+inline std::atomic<JournalRecorder*>& JournalRecorder::current()
+{
+    static std::atomic<JournalRecorder*> recorder(nullptr);
+    return recorder;
+}
+
+inline std::mutex& JournalRecorder::registryLock()
+{
+    // never destroyed, threads may exit after static destruction
+    static std::mutex *lock = new std::mutex;
+    return *lock;
+}
+
+inline std::vector<JournalRecorder::ThreadBuffer*>& JournalRecorder::registry()
+{
+    static std::vector<ThreadBuffer*> *buffers = new std::vector<ThreadBuffer*>;
+    return *buffers;
+}
+
+
+
+inline JournalEntry::JournalEntry(std::uint32_t subject, long msg):
+    m_subject(subject), m_msg(msg), m_active(JournalRecorder::active()), m_fanOut(JournalRecord::UnknownFanOut), m_time(0), m_prev(nullptr)
+{
+    if (m_active)
+    {
+        m_time = JournalRecorder::now();
+        m_prev = pending();
+        pending() = this;
+    }
+}
+
+inline JournalEntry::~JournalEntry()
+{
+    if (m_active)
+    {
+        if (pending() == this)
+        {
+            pending() = m_prev;                                 // not claimed, deferred
+        }
+        JournalRecorder::record(m_subject, m_msg, m_fanOut, m_time);
+    }
+}
+
+inline JournalEntry* JournalEntry::claim()
+{
+    JournalEntry *entry = pending();
+    if (entry)
+    {
+        pending() = entry->m_prev;                              // notify nested in update records its own fan-out
+    }
+    return entry;
+}
+
+inline void JournalEntry::delivered(std::uint32_t fanOut)
+{
+    m_fanOut = fanOut;
+}
+
+inline JournalEntry*& JournalEntry::pending()
+{
+    static thread_local JournalEntry *entry = nullptr;
+    return entry;
+}
+
+
+
+
+inline JournalReplayer::JournalReplayer(): m_map(nullptr), m_mapSize(0), m_header(nullptr), m_dropped(0) {}
+
+inline JournalReplayer::~JournalReplayer()
+{
+    close();
+}
+
+inline bool JournalReplayer::open(const char *path)
+{
+    close();
+    const int file = ::open(path, O_RDONLY);
+    if (file < 0)
+    {
+        return false;
+    }
+    struct stat status;
+    void *map = MAP_FAILED;
+    if (::fstat(file, &status) == 0 && static_cast<std::size_t>(status.st_size) >= sizeof(JournalHeader))
+    {
+        map = ::mmap(nullptr, static_cast<std::size_t>(status.st_size), PROT_READ, MAP_PRIVATE, file, 0);
+    }
+    ::close(file);                                              // the mapping stays valid
+    if (map == MAP_FAILED)
+    {
+        return false;
+    }
+
+    const JournalHeader *header = static_cast<const JournalHeader*>(map);
+    const std::size_t size = static_cast<std::size_t>(status.st_size);
+    if (std::memcmp(header->m_magic, "OPJRNL1", 8) != 0 || header->m_recordSize != sizeof(JournalRecord))
+    {
+        ::munmap(map, size);
+        return false;                                           // not a journal
+    }
+    m_map = map;
+    m_mapSize = size;
+    m_header = header;
+
+    // a recorder that did not stop left the file at its capacity, the reservations in the header,
+    // and zero records where a copy never finished, those are skipped
+    const bool stopped = header->m_stopped != 0;
+    const std::uint64_t reserved = header->m_records.load();
+    const std::uint64_t fits = (size - sizeof(JournalHeader)) / sizeof(JournalRecord);
+    m_dropped = stopped ? header->m_dropped : (reserved > fits ? reserved - fits : 0);
+    const JournalRecord *records = reinterpret_cast<const JournalRecord*>(header + 1);
+    const std::size_t count = static_cast<std::size_t>(std::min(reserved, fits));
+    m_order.reserve(count);
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        if (stopped || written(records[i]))
+        {
+            m_order.push_back(records + i);
+        }
+    }
+    // stable, records of one thread with equal time keep their order
+    std::stable_sort(m_order.begin(), m_order.end(),
+                     [](const JournalRecord *a, const JournalRecord *b) { return a->m_time < b->m_time; });
+    return true;
+}
+
+inline void JournalReplayer::close()
+{
+    if (m_map)
+    {
+        ::munmap(m_map, m_mapSize);
+    }
+    m_map = nullptr;
+    m_mapSize = 0;
+    m_header = nullptr;
+    m_dropped = 0;
+    m_order.clear();
+}
+
+inline std::size_t JournalReplayer::size() const
+{
+    return m_order.size();
+}
+
+inline const JournalRecord& JournalReplayer::operator[](std::size_t index) const
+{
+    return *m_order[index];
+}
+
+inline std::uint64_t JournalReplayer::getStart() const
+{
+    return m_header ? m_header->m_start : 0;
+}
+
+inline std::uint64_t JournalReplayer::getDropped() const
+{
+    return m_dropped;
+}
+
+inline bool JournalReplayer::isComplete() const
+{
+    return m_header && m_header->m_stopped != 0;
+}
+
+inline void JournalReplayer::bind(std::uint32_t subject, Target target)
+{
+    m_targets[subject] = std::move(target);
+}
+
+template<typename T, typename... Options>
+void JournalReplayer::bind(std::uint32_t subject, const Subject<T, Options...> *target)
+{
+    // notify is protected, Subject befriends JournalReplayer
+    m_targets[subject] = [target](long msg) { target->notify(msg); };
+}
+
+inline std::size_t JournalReplayer::replay(bool originalTiming)
+{
+    // records of subjects not bound are skipped, their time still counts
+    const std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+    const std::uint64_t first = m_order.empty() ? 0 : m_order.front()->m_time;
+    std::size_t replayed = 0;
+    for (auto it = m_order.begin(); it != m_order.end(); ++it)
+    {
+        auto target = m_targets.find((*it)->m_subject);
+        if (target == m_targets.end())
+        {
+            continue;
+        }
+        if (originalTiming)
+        {
+            std::this_thread::sleep_until(begin + std::chrono::nanoseconds((*it)->m_time - first));
+        }
+        target->second(static_cast<long>((*it)->m_msg));
+        ++replayed;
+    }
+    return replayed;
+}
+
+inline bool JournalReplayer::written(const JournalRecord &record)
+{
+    // a copy in progress or never made reads as zero, no notify records message 0 of subject 0 at time 0
+    return record.m_time || record.m_msg || record.m_subject || record.m_fanOut;
+}
+
+#endif // JOURNAL_HPP
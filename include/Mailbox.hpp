@@ -0,0 +1,404 @@
+#ifndef MAILBOX_HPP
+#define MAILBOX_HPP
+
+#include "ObserverPattern.hpp"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <mutex>
+
+enum class MailboxOverflow                                      // what update does when the mailbox is full
+{
+    Block,                                                      // publisher waits for the consumer to make room
+    DropNewest,                                                 // the message that does not fit is dropped
+    DropOldest,                                                 // the oldest message queued is dropped to make room
+    Conflate                                                    // a message whose id is already queued is dropped, ids in [0, 62] have room kept, others DropNewest when full
+};
+
+class MailboxRing                                               // bounded lock-free ring of message ids, any number of producers and consumers
+{
+    public:
+        explicit MailboxRing(std::size_t capacity);             // constructor, capacity rounded up to a power of 2
+        bool push(long msg);                                    // queue msg, false if full
+        bool pop(long &msg);                                    // take the oldest msg, false if empty
+        bool empty() const;                                     // whether pop would find nothing now
+        std::size_t size() const;                               // number of messages queued, approximate while pushed or popped
+        std::size_t capacity() const;                           // most messages queued at once
+
+    private:
+        MailboxRing(const MailboxRing&) = delete;               // disable copy from left value
+        MailboxRing& operator=(const MailboxRing&) = delete;    // disable assign from left value
+
+        struct Cell                                             // one message
+        {
+            std::atomic<std::size_t> m_sequence;                // position the cell is ready for, pushed if position + 1
+            long m_msg;                                         // message id, published by m_sequence
+        };
+
+        std::unique_ptr<Cell[]> m_cells;                        // the ring
+        const std::size_t m_mask;                               // capacity - 1
+        char m_pad0[64];                                        // keep producers and consumers on their own cache lines
+        std::atomic<std::size_t> m_head;                        // next position to push
+        char m_pad1[64];
+        std::atomic<std::size_t> m_tail;                        // next position to pop
+};
+
+template<typename T>
+class MailboxObserver : public Observer<T>                      // queues update on the publisher thread, receive runs on a consumer thread
+{
+    public:
+        explicit MailboxObserver(std::size_t capacity, MailboxOverflow overflow = MailboxOverflow::Block); // constructor
+        virtual ~MailboxObserver();                             // destrctor, virtual
+        bool update(long msg) override final;                   // publisher thread, queue msg, false if dropped
+        std::size_t drain(std::size_t max = std::numeric_limits<std::size_t>::max()); // consumer thread, receive up to max messages, number received
+        template<typename Rep, typename Period>
+        std::size_t waitAndDrain(const std::chrono::duration<Rep, Period> &timeout,
+                                 std::size_t max = std::numeric_limits<std::size_t>::max()); // consumer thread, wait for a message, then drain
+        void wake();                                            // make waitAndDrain return now, e.g. to stop the consumer thread
+        MailboxOverflow getOverflow() const;                    // overflow policy
+        std::size_t getCapacity() const;                        // most messages queued at once, with Conflate 63 more for ids in [0, 62]
+        std::size_t getDepth() const;                           // messages queued now, approximate
+        std::uint64_t getDropped() const;                       // messages dropped for lack of room
+        std::uint64_t getConflated() const;                     // messages dropped as already queued
+        std::uint64_t getBlocked() const;                       // times a publisher waited for room
+
+    protected:
+        virtual void receive(long msg) = 0;                     // consumer thread, react to msg, pure virtual
+
+    private:
+        MailboxObserver(const MailboxObserver&) = delete;       // disable copy from left value
+        MailboxObserver(const MailboxObserver&&) = delete;      // disable copy from right value
+        MailboxObserver& operator=(const MailboxObserver&) = delete; // disable assign from left value
+        MailboxObserver& operator=(const MailboxObserver&&) = delete; // disable assign from right value
+
+        static const std::size_t ConflateIds = 63;              // ids in [0, 62], queued once at most each with Conflate
+
+        static std::uint64_t conflateBitOf(long msg);           // bit of msg in m_pending, 0 if msg is never conflated
+        void waitForRoom(long msg);                             // push msg, waiting as long as the ring is full
+        void arrived();                                         // wake the consumer if waiting
+
+        MailboxRing m_ring;                                     // messages not received yet
+        const MailboxOverflow m_overflow;                       // overflow policy
+        std::atomic<std::uint64_t> m_pending;                   // ids in [0, 62] queued, Conflate only
+        std::atomic<std::size_t> m_others;                      // ids out of [0, 62] queued, Conflate only, at most capacity - ConflateIds
+        std::atomic<std::uint64_t> m_dropped;                   // messages dropped for lack of room
+        std::atomic<std::uint64_t> m_conflated;                 // messages dropped as already queued
+        std::atomic<std::uint64_t> m_blocked;                   // times a publisher waited for room
+        std::atomic<unsigned> m_producersWaiting;               // publishers waiting in waitForRoom
+        std::atomic<bool> m_consumerWaiting;                    // consumer waiting in waitAndDrain
+        std::mutex m_lock;                                      // pair with m_room and m_arrived, guard m_woken
+        std::condition_variable m_room;                         // a message was taken
+        std::condition_variable m_arrived;                      // a message was queued, or wake invoked
+        bool m_woken;                                           // wake invoked
+};
+
+
+
+inline MailboxRing::MailboxRing(std::size_t capacity):
+    m_mask([capacity]
+    {
+        std::size_t size = 2;                                   // the ring needs two cells at least
+        while (size < capacity)
+        {
+            size <<= 1;
+        }
+        return size - 1;
+    }()),
+    m_head(0), m_tail(0)
+{
+    m_cells.reset(new Cell[m_mask + 1]);
+    for (std::size_t i = 0; i <= m_mask; ++i)
+    {
+        m_cells[i].m_sequence.store(i);
+    }
+}
+
+inline bool MailboxRing::push(long msg)
+{
+    std::size_t position = m_head.load();
+    Cell *cell = nullptr;
+    for (;;)
+    {
+        cell = &m_cells[position & m_mask];
+        const std::size_t sequence = cell->m_sequence.load();
+        const std::ptrdiff_t diff = static_cast<std::ptrdiff_t>(sequence - position);
+        if (diff == 0)
+        {
+            if (m_head.compare_exchange_weak(position, position + 1))
+            {
+                break;                                          // cell claimed
+            }
+        }
+        else if (diff < 0)
+        {
+            return false;                                       // full, the cell is not popped yet
+        }
+        else
+        {
+            position = m_head.load();                           // another producer claimed it
+        }
+    }
+    cell->m_msg = msg;
+    cell->m_sequence.store(position + 1);                       // publish
+    return true;
+}
+
+inline bool MailboxRing::pop(long &msg)
+{
+    std::size_t position = m_tail.load();
+    Cell *cell = nullptr;
+    for (;;)
+    {
+        cell = &m_cells[position & m_mask];
+        const std::size_t sequence = cell->m_sequence.load();
+        const std::ptrdiff_t diff = static_cast<std::ptrdiff_t>(sequence - (position + 1));
+        if (diff == 0)
+        {
+            if (m_tail.compare_exchange_weak(position, position + 1))
+            {
+                break;                                          // cell claimed
+            }
+        }
+        else if (diff < 0)
+        {
+            return false;                                       // empty, the cell is not pushed yet
+        }
+        else
+        {
+            position = m_tail.load();                           // another consumer claimed it
+        }
+    }
+    msg = cell->m_msg;
+    cell->m_sequence.store(position + m_mask + 1);              // ready for the push one lap later
+    return true;
+}
+
+inline bool MailboxRing::empty() const
+{
+    const std::size_t position = m_tail.load();
+    return m_cells[position & m_mask].m_sequence.load() != position + 1;
+}
+
+inline std::size_t MailboxRing::size() const
+{
+    // order matters, m_tail MUST be loaded first, otherwise it may pass the m_head loaded
+    const std::size_t tail = m_tail.load();
+    const std::size_t head = m_head.load();
+    return head - tail > m_mask + 1 ? m_mask + 1 : head - tail;
+}
+
+inline std::size_t MailboxRing::capacity() const
+{
+    return m_mask + 1;
+}
+
+
+
+template<typename T>
+MailboxObserver<T>::MailboxObserver(std::size_t capacity, MailboxOverflow overflow):
+    m_ring(overflow == MailboxOverflow::Conflate ? capacity + ConflateIds : capacity), m_overflow(overflow), m_pending(0), m_others(0),
+    m_dropped(0), m_conflated(0), m_blocked(0),
+    m_producersWaiting(0), m_consumerWaiting(false), m_woken(false) {}
+
+template<typename T>
+MailboxObserver<T>::~MailboxObserver()
+{
+    // MailboxObserver itself MUST not invoke stopObserve in its destrctor,
+    // otherwise uninit of base class gets invoked, not that of derived class.
+    // all non-abstract derived classes MUST invoke stopObserve in their destrctors,
+    // otherwise dangling pointer may occur.
+    // the consumer thread MUST have stopped draining before.
+}
+
+template<typename T>
+bool MailboxObserver<T>::update(long msg)
+{
+    switch (m_overflow)
+    {
+        case MailboxOverflow::Block:
+            if (!m_ring.push(msg))
+            {
+                waitForRoom(msg);
+            }
+            break;
+
+        case MailboxOverflow::DropNewest:
+            if (!m_ring.push(msg))
+            {
+                m_dropped.fetch_add(1);
+                return false;
+            }
+            break;
+
+        case MailboxOverflow::DropOldest:
+            while (!m_ring.push(msg))
+            {
+                long oldest = 0;
+                if (m_ring.pop(oldest))
+                {
+                    m_dropped.fetch_add(1);                     // the consumer may have taken it meanwhile, then retry
+                }
+            }
+            break;
+
+        case MailboxOverflow::Conflate:
+        {
+            // the ring keeps ConflateIds cells for ids in [0, 62], each holds one of them at most,
+            // other ids share the rest, so the push below always finds room
+            const std::uint64_t bit = conflateBitOf(msg);
+            if (!bit)
+            {
+                if (m_others.fetch_add(1) >= m_ring.capacity() - ConflateIds)
+                {
+                    m_others.fetch_sub(1);
+                    m_dropped.fetch_add(1);
+                    return false;
+                }
+            }
+            else if (m_pending.fetch_or(bit) & bit)
+            {
+                m_conflated.fetch_add(1);                       // still queued, the consumer receives it once
+                return true;
+            }
+            m_ring.push(msg);
+            break;
+        }
+    }
+    arrived();
+    return true;
+}
+
+template<typename T>
+std::size_t MailboxObserver<T>::drain(std::size_t max)
+{
+    std::size_t count = 0;
+    long msg = 0;
+    while (count < max && m_ring.pop(msg))
+    {
+        ++count;
+        if (m_overflow == MailboxOverflow::Conflate)
+        {
+            // order matters, released after the pop and before receive, so a later update queues it again
+            const std::uint64_t bit = conflateBitOf(msg);
+            if (bit)
+            {
+                m_pending.fetch_and(~bit);
+            }
+            else
+            {
+                m_others.fetch_sub(1);
+            }
+        }
+        if (m_producersWaiting.load())
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+            m_room.notify_all();
+        }
+        receive(msg);
+    }
+    return count;
+}
+
+template<typename T>
+template<typename Rep, typename Period>
+std::size_t MailboxObserver<T>::waitAndDrain(const std::chrono::duration<Rep, Period> &timeout, std::size_t max)
+{
+    const std::size_t count = drain(max);
+    if (count)
+    {
+        return count;                                           // busy, no wait
+    }
+
+    {
+        std::unique_lock<std::mutex> lock(m_lock);
+        // order matters, m_consumerWaiting MUST be set before the ring is checked,
+        // a publisher pushes before it checks m_consumerWaiting
+        m_consumerWaiting.store(true);
+        m_arrived.wait_for(lock, timeout, [this] { return !m_ring.empty() || m_woken; });
+        m_consumerWaiting.store(false);
+        m_woken = false;
+    }
+    return drain(max);
+}
+
+template<typename T>
+void MailboxObserver<T>::wake()
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    m_woken = true;
+    m_arrived.notify_all();
+}
+
+template<typename T>
+MailboxOverflow MailboxObserver<T>::getOverflow() const
+{
+    return m_overflow;
+}
+
+template<typename T>
+std::size_t MailboxObserver<T>::getCapacity() const
+{
+    return m_ring.capacity();
+}
+
+template<typename T>
+std::size_t MailboxObserver<T>::getDepth() const
+{
+    return m_ring.size();
+}
+
+template<typename T>
+std::uint64_t MailboxObserver<T>::getDropped() const
+{
+    return m_dropped.load();
+}
+
+template<typename T>
+std::uint64_t MailboxObserver<T>::getConflated() const
+{
+    return m_conflated.load();
+}
+
+template<typename T>
+std::uint64_t MailboxObserver<T>::getBlocked() const
+{
+    return m_blocked.load();
+}
+
+template<typename T>
+std::uint64_t MailboxObserver<T>::conflateBitOf(long msg)
+{
+    // ids out of [0, 62] share bit 63 of MessageMask, they would conflate with each other, so they never do
+    return (msg >= 0 && msg < 63) ? MessageMask::bitOf(msg) : 0;
+}
+
+template<typename T>
+void MailboxObserver<T>::waitForRoom(long msg)
+{
+    m_blocked.fetch_add(1);
+    std::unique_lock<std::mutex> lock(m_lock);
+    // order matters, m_producersWaiting MUST be raised before the push is retried,
+    // the consumer pops before it checks m_producersWaiting
+    m_producersWaiting.fetch_add(1);
+    while (!m_ring.push(msg))
+    {
+        m_room.wait(lock);
+    }
+    m_producersWaiting.fetch_sub(1);
+}
+
+template<typename T>
+void MailboxObserver<T>::arrived()
+{
+    if (m_consumerWaiting.load())
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_arrived.notify_one();
+    }
+}
+
+#endif // MAILBOX_HPP
@@ -0,0 +1,239 @@
+#ifndef MEMORYRESOURCE_HPP
+#define MEMORYRESOURCE_HPP
+
+#include <cstddef>
+#include <new>
+#include <vector>
+#include <mutex>
+
+class MemoryResource                                            // source of memory for subscription nodes, interface
+{
+    public:
+        virtual ~MemoryResource();                              // destrctor, virtual
+        virtual void* allocate(std::size_t bytes) = 0;          // memory aligned as by operator new, pure virtual
+        virtual void deallocate(void *p, std::size_t bytes) = 0; // give back memory of allocate with the same bytes, pure virtual
+};
+
+class NodePool : public MemoryResource                          // fixed-size blocks in power of 2 classes, thread-safe
+{
+    public:
+        static const std::size_t MinBlock = 16;                 // smallest block
+        static const std::size_t MaxBlock = std::size_t(1) << 20; // largest block, larger requests go to operator new
+        static const std::size_t ChunkSize = 64 * 1024;         // blocks are carved from chunks of at least this size
+
+        NodePool();                                             // constructor, nothing reserved
+        virtual ~NodePool();                                    // destrctor, release all chunks, all blocks MUST be given back
+        void* allocate(std::size_t bytes) override;             // pop a free block, carve a chunk if none
+        void deallocate(void *p, std::size_t bytes) override;   // push block back to its class, never freed before destrctor
+        std::size_t getReservedBytes() const;                   // bytes of all chunks
+        static NodePool& instance();                            // shared pool, created on first use, never destroyed
+
+    private:
+        NodePool(const NodePool&) = delete;                     // disable copy from left value
+        NodePool(const NodePool&&) = delete;                    // disable copy from right value
+        NodePool& operator=(const NodePool&) = delete;          // disable assign from left value
+        NodePool& operator=(const NodePool&&) = delete;         // disable assign from right value
+
+        struct FreeBlock                                        // header of a block not in use
+        {
+            FreeBlock *m_next;                                  // next free block of the same class
+        };
+        struct SizeClass                                        // blocks of one size
+        {
+            std::mutex m_lock;                                  // guard m_free
+            FreeBlock *m_free;                                  // free blocks, intrusive stack
+        };
+
+        static unsigned classOf(std::size_t bytes);             // class of smallest block holding bytes
+        static std::size_t blockOf(unsigned index);             // block size of class
+
+        static const unsigned ClassCount = 17;                  // MinBlock << 16 == MaxBlock
+        SizeClass m_classes[ClassCount];                        // one free list per block size
+        mutable std::mutex m_chunkLock;                         // guard m_chunks and m_reserved
+        std::vector<void*> m_chunks;                            // chunks carved so far
+        std::size_t m_reserved;                                 // bytes of m_chunks
+};
+
+template<typename T>
+class ResourceAllocator                                         // STL allocator on a MemoryResource
+{
+    public:
+        typedef T value_type;
+
+        explicit ResourceAllocator(MemoryResource *resource);   // constructor
+        template<typename U>
+        ResourceAllocator(const ResourceAllocator<U> &other);   // rebind
+        T* allocate(std::size_t n);                             // memory for n objects
+        void deallocate(T *p, std::size_t n);                   // give back memory for n objects
+        MemoryResource* resource() const;                       // the resource
+
+    private:
+        MemoryResource *m_resource;                             // the resource, outlives the allocator
+};
+
+template<typename T, typename U>
+bool operator==(const ResourceAllocator<T> &a, const ResourceAllocator<U> &b);
+template<typename T, typename U>
+bool operator!=(const ResourceAllocator<T> &a, const ResourceAllocator<U> &b);
+
+
+
+inline MemoryResource::~MemoryResource() {}
+
+
+
+inline NodePool::NodePool(): m_reserved(0)
+{
+    for (unsigned i = 0; i < ClassCount; ++i)
+    {
+        m_classes[i].m_free = nullptr;
+    }
+}
+
+inline NodePool::~NodePool()
+{
+    for (auto it = m_chunks.begin(); it != m_chunks.end(); ++it)
+    {
+        ::operator delete(*it);
+    }
+}
+
+inline void* NodePool::allocate(std::size_t bytes)
+{
+    if (bytes > MaxBlock)
+    {
+        return ::operator new(bytes);                           // too large to pool
+    }
+
+    SizeClass &sizeClass = m_classes[classOf(bytes)];
+    {
+        std::lock_guard<std::mutex> lock(sizeClass.m_lock);
+        if (FreeBlock *block = sizeClass.m_free)
+        {
+            sizeClass.m_free = block->m_next;
+            return block;                                       // steady state, no allocation
+        }
+    }
+
+    // carve a new chunk, keep one block and give the rest to the class
+    const std::size_t block = blockOf(classOf(bytes));
+    const std::size_t size = block * 8 > ChunkSize ? block * 8 : ChunkSize;
+    char *chunk = static_cast<char*>(::operator new(size));
+    {
+        std::lock_guard<std::mutex> lock(m_chunkLock);
+        try
+        {
+            m_chunks.push_back(chunk);
+        }
+        catch (...)
+        {
+            ::operator delete(chunk);
+            throw;
+        }
+        m_reserved += size;
+    }
+    FreeBlock *first = nullptr;
+    FreeBlock *last = nullptr;
+    for (std::size_t offset = block; offset + block <= size; offset += block)
+    {
+        FreeBlock *free = reinterpret_cast<FreeBlock*>(chunk + offset);
+        free->m_next = nullptr;
+        (last ? last->m_next : first) = free;
+        last = free;
+    }
+    if (first)
+    {
+        std::lock_guard<std::mutex> lock(sizeClass.m_lock);
+        last->m_next = sizeClass.m_free;
+        sizeClass.m_free = first;
+    }
+    return chunk;
+}
+
+inline void NodePool::deallocate(void *p, std::size_t bytes)
+{
+    if (!p)
+    {
+        return;
+    }
+    if (bytes > MaxBlock)
+    {
+        ::operator delete(p);
+        return;
+    }
+
+    SizeClass &sizeClass = m_classes[classOf(bytes)];
+    FreeBlock *block = static_cast<FreeBlock*>(p);
+    std::lock_guard<std::mutex> lock(sizeClass.m_lock);
+    block->m_next = sizeClass.m_free;
+    sizeClass.m_free = block;
+}
+
+inline std::size_t NodePool::getReservedBytes() const
+{
+    std::lock_guard<std::mutex> lock(m_chunkLock);
+    return m_reserved;
+}
+
+inline NodePool& NodePool::instance()
+{
+    // never destroyed, subjects with static storage may give blocks back after exit
+    static NodePool *pool = new NodePool;
+    return *pool;
+}
+
+inline unsigned NodePool::classOf(std::size_t bytes)
+{
+    unsigned index = 0;
+    while (blockOf(index) < bytes)
+    {
+        ++index;
+    }
+    return index;
+}
+
+inline std::size_t NodePool::blockOf(unsigned index)
+{
+    return MinBlock << index;
+}
+
+
+
+template<typename T>
+ResourceAllocator<T>::ResourceAllocator(MemoryResource *resource): m_resource(resource) {}
+
+template<typename T>
+template<typename U>
+ResourceAllocator<T>::ResourceAllocator(const ResourceAllocator<U> &other): m_resource(other.resource()) {}
+
+template<typename T>
+T* ResourceAllocator<T>::allocate(std::size_t n)
+{
+    return static_cast<T*>(m_resource->allocate(n * sizeof(T)));
+}
+
+template<typename T>
+void ResourceAllocator<T>::deallocate(T *p, std::size_t n)
+{
+    m_resource->deallocate(p, n * sizeof(T));
+}
+
+template<typename T>
+MemoryResource* ResourceAllocator<T>::resource() const
+{
+    return m_resource;
+}
+
+template<typename T, typename U>
+bool operator==(const ResourceAllocator<T> &a, const ResourceAllocator<U> &b)
+{
+    return a.resource() == b.resource();
+}
+
+template<typename T, typename U>
+bool operator!=(const ResourceAllocator<T> &a, const ResourceAllocator<U> &b)
+{
+    return !(a == b);
+}
+
+#endif // MEMORYRESOURCE_HPP
@@ -0,0 +1,294 @@
+#ifndef MULTIOBSERVER_HPP
+#define MULTIOBSERVER_HPP
+
+#include "ObserverPattern.hpp"
+
+template<typename T, typename... Events>
+class MultiObserver;                                            // forward declaration
+
+template<typename T, typename E>
+class MultiEventHandler                                         // receives events of type E with the subject fired
+{
+    public:
+        virtual ~MultiEventHandler();                           // destrctor, virtual
+        virtual bool update(T *subject, const E &event) = 0;    // react to the event of subject, pure virtual
+};
+
+template<typename Edge, typename Base, typename... Events>
+class EdgeForwarder;                                            // overrides update(const E&) of Base for each of Events
+
+template<typename Edge, typename Base>
+class EdgeForwarder<Edge, Base> : public Base {};
+
+template<typename Edge, typename Base, typename E, typename... Rest>
+class EdgeForwarder<Edge, Base, E, Rest...> : public EdgeForwarder<Edge, Base, Rest...>
+{
+    public:
+        bool update(const E &event) override;                   // forward to the owner of the edge
+};
+
+template<typename T, typename... Events>
+class ObserverEdge final :                                      // one subscription of a MultiObserver, a node in the store of the subject and the list of the owner
+    public EdgeForwarder<ObserverEdge<T, Events...>, Observer<T, Events...>, Events...>
+{
+    // MultiObserver creates, links and stops edges
+    friend class MultiObserver<T, Events...>;
+    public:
+        bool update(long msg) override;                         // forward to the owner with the subject
+        template<typename E>
+        bool forward(const E &event);                           // forward typed event to the owner with the subject
+        MultiObserver<T, Events...>* getOwner() const;          // the observer owning this edge
+        ObserverEdge* getNext() const;                          // next edge of the owner, nullptr if last
+        T* getTarget() const;                                   // the subject observed
+
+    protected:
+        bool init() override;                                   // forward to the owner with the subject
+        bool uninit() override;                                 // forward to the owner with the subject
+        void detached() override;                               // unlink from the owner and delete
+
+    private:
+        explicit ObserverEdge(MultiObserver<T, Events...> *owner); // constructor, only by MultiObserver
+        ~ObserverEdge();                                        // destrctor, only by detached
+        MultiObserver<T, Events...> *const m_owner;             // the observer owning this edge
+        T *m_target;                                            // the subject observed, kept so no cast during its destrctor
+        ObserverEdge *m_prev;                                   // previous edge of the owner
+        ObserverEdge *m_next;                                   // next edge of the owner
+};
+
+template<typename T, typename... Events>
+class MultiObserver : public MultiEventHandler<T, Events>...    // observes many subjects, one edge per subject
+{
+    // ObserverEdge forwards init, uninit and unlinks itself
+    friend class ObserverEdge<T, Events...>;
+    public:
+        typedef ObserverEdge<T, Events...> Edge;                // one subscription
+
+        MultiObserver();                                        // constructor
+        virtual ~MultiObserver();                               // destrctor, virtual
+        Edge* startObserve(T *subject, MessageMask messages = MessageMask(), int priority = 0); // start observing one more subject, nullptr if already, walks the edges
+        bool stopObserve(T *subject);                           // stop observing the subject, walks the edges
+        bool stopObserve(Edge *edge);                           // stop observing the subject of edge, O(1)
+        virtual bool update(T *subject, long msg);              // react to the change of subject, default do nothing
+        Edge* getEdges() const;                                 // first edge, nullptr if observing nothing
+        std::size_t getSubjectCount() const;                    // number of subjects observed
+
+    protected:
+        void stopObserve();                                     // stop observing all subjects
+        virtual bool init(T *subject);                          // initialize, invoked after start observing subject
+        virtual bool uninit(T *subject);                        // uninitialize, invoked before stop observing subject
+
+    private:
+        MultiObserver(const MultiObserver&) = delete;           // disable copy from left value
+        MultiObserver(const MultiObserver&&) = delete;          // disable copy from right value
+        MultiObserver& operator=(const MultiObserver&) = delete; // disable assign from left value
+        MultiObserver& operator=(const MultiObserver&&) = delete; // disable assign from right value
+        Edge* find(const T *subject) const;                     // edge observing subject, nullptr if none
+        Edge *m_edges;                                          // first edge, intrusive list
+        std::size_t m_count;                                    // number of edges linked
+};
+
+
+
+template<typename T, typename E>
+MultiEventHandler<T, E>::~MultiEventHandler() {}
+
+template<typename Edge, typename Base, typename E, typename... Rest>
+bool EdgeForwarder<Edge, Base, E, Rest...>::update(const E &event)
+{
+    return static_cast<Edge*>(this)->forward(event);
+}
+
+
+
+template<typename T, typename... Events>
+ObserverEdge<T, Events...>::ObserverEdge(MultiObserver<T, Events...> *owner): m_owner(owner), m_target(nullptr), m_prev(nullptr), m_next(nullptr) {}
+
+template<typename T, typename... Events>
+ObserverEdge<T, Events...>::~ObserverEdge() {}
+
+template<typename T, typename... Events>
+bool ObserverEdge<T, Events...>::update(long msg)
+{
+    return m_owner->update(m_target, msg);
+}
+
+template<typename T, typename... Events>
+template<typename E>
+bool ObserverEdge<T, Events...>::forward(const E &event)
+{
+    return static_cast<MultiEventHandler<T, E>*>(m_owner)->update(m_target, event);
+}
+
+template<typename T, typename... Events>
+MultiObserver<T, Events...>* ObserverEdge<T, Events...>::getOwner() const
+{
+    return m_owner;
+}
+
+template<typename T, typename... Events>
+ObserverEdge<T, Events...>* ObserverEdge<T, Events...>::getNext() const
+{
+    return m_next;
+}
+
+template<typename T, typename... Events>
+T* ObserverEdge<T, Events...>::getTarget() const
+{
+    return m_target;
+}
+
+template<typename T, typename... Events>
+bool ObserverEdge<T, Events...>::init()
+{
+    return m_owner->init(m_target);
+}
+
+template<typename T, typename... Events>
+bool ObserverEdge<T, Events...>::uninit()
+{
+    return m_owner->uninit(m_target);
+}
+
+template<typename T, typename... Events>
+void ObserverEdge<T, Events...>::detached()
+{
+    // stopped from either side, O(1) unlink by pointer, m_target is not touched, it may be in its destrctor
+    --m_owner->m_count;
+    if (m_prev)
+    {
+        m_prev->m_next = m_next;
+    }
+    else
+    {
+        m_owner->m_edges = m_next;
+    }
+    if (m_next)
+    {
+        m_next->m_prev = m_prev;
+    }
+    delete this;
+}
+
+
+
+template<typename T, typename... Events>
+MultiObserver<T, Events...>::MultiObserver(): m_edges(nullptr), m_count(0) {}
+
+template<typename T, typename... Events>
+MultiObserver<T, Events...>::~MultiObserver()
+{
+    // MultiObserver itself MUST not invoke stopObserve in its destrctor,
+    // otherwise uninit of base class gets invoked, not that of derived class.
+    // all non-abstract derived classes MUST invoke stopObserve in their destrctors,
+    // otherwise dangling pointer may occur.
+}
+
+template<typename T, typename... Events>
+typename MultiObserver<T, Events...>::Edge* MultiObserver<T, Events...>::startObserve(T *subject, MessageMask messages, int priority)
+{
+    if (!subject)
+    {
+        return nullptr;                                         // nullptr, invalid argument
+    }
+    if (find(subject))
+    {
+        return nullptr;                                         // already observing
+    }
+
+    // order matters, link MUST occur before startObserve, which invokes init
+    Edge *edge = new Edge(this);
+    ++m_count;
+    edge->m_next = m_edges;
+    if (m_edges)
+    {
+        m_edges->m_prev = edge;
+    }
+    m_edges = edge;
+    edge->m_target = subject;
+    if (!edge->startObserve(subject, messages, priority))
+    {
+        edge->detached();                                       // rejected by the subject
+        return nullptr;
+    }
+    return edge;
+}
+
+template<typename T, typename... Events>
+bool MultiObserver<T, Events...>::stopObserve(T *subject)
+{
+    Edge *edge = find(subject);
+    if (!edge)
+    {
+        return false;                                           // not observing
+    }
+    return stopObserve(edge);
+}
+
+template<typename T, typename... Events>
+bool MultiObserver<T, Events...>::stopObserve(Edge *edge)
+{
+    if (!edge || edge->m_owner != this)
+    {
+        return false;                                           // nullptr or edge of another observer
+    }
+    return edge->stopObserve(edge->m_target);                   // edge is deleted once detached
+}
+
+template<typename T, typename... Events>
+void MultiObserver<T, Events...>::stopObserve()
+{
+    // MultiObserver itself MUST not invoke stopObserve in its destrctor,
+    // otherwise uninit of base class gets invoked, not that of derived class.
+    // all non-abstract derived classes MUST invoke stopObserve in their destrctors,
+    // otherwise dangling pointer may occur.
+    while (m_edges)
+    {
+        stopObserve(m_edges);
+    }
+}
+
+template<typename T, typename... Events>
+bool MultiObserver<T, Events...>::update(T*, long)
+{
+    return false;                                               // default do nothing
+}
+
+template<typename T, typename... Events>
+typename MultiObserver<T, Events...>::Edge* MultiObserver<T, Events...>::getEdges() const
+{
+    return m_edges;
+}
+
+template<typename T, typename... Events>
+std::size_t MultiObserver<T, Events...>::getSubjectCount() const
+{
+    return m_count;
+}
+
+template<typename T, typename... Events>
+typename MultiObserver<T, Events...>::Edge* MultiObserver<T, Events...>::find(const T *subject) const
+{
+    // no index by subject, stopObserve(edge) is the O(1) way
+    for (Edge *edge = m_edges; edge; edge = edge->m_next)
+    {
+        if (edge->m_target == subject)
+        {
+            return edge;
+        }
+    }
+    return nullptr;
+}
+
+template<typename T, typename... Events>
+bool MultiObserver<T, Events...>::init(T*)
+{
+    return false;                                               // default do nothing
+}
+
+template<typename T, typename... Events>
+bool MultiObserver<T, Events...>::uninit(T*)
+{
+    return false;                                               // default do nothing
+}
+
+#endif // MULTIOBSERVER_HPP
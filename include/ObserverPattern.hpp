@@ -1,118 +1,3456 @@
 #ifndef OBSERVERPATTERN_HPP
 #define OBSERVERPATTERN_HPP
 
-#include <list>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
 #include <algorithm>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <initializer_list>
+#include <deque>
+#include <limits>
+#include <unordered_set>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+#include <thread>
+#include "ThreadPool.hpp"
+#include "MemoryResource.hpp"
+#ifdef OBSERVERPATTERN_INSTRUMENTATION
+#include "Instrumentation.hpp"
+#endif
+#ifdef OBSERVERPATTERN_JOURNAL
+#include "Journal.hpp"
+#endif
 
 class ObserverImpl;                                             // forward declaration
 
+template<typename O>
+class ObserverView                                              // non-allocating view over the observers of a subject
+{
+    public:
+        class iterator                                          // forward iterator, skips removed slots
+        {
+            public:
+                typedef std::forward_iterator_tag iterator_category;
+                typedef O* value_type;
+                typedef std::ptrdiff_t difference_type;
+                typedef O* const* pointer;
+                typedef O* reference;
+
+                iterator(ObserverImpl *const *pos, ObserverImpl *const *end);
+                O* operator*() const;                           // the observer at current position
+                iterator& operator++();                         // advance to next observer
+                iterator operator++(int);                       // advance to next observer
+                bool operator==(const iterator &other) const;
+                bool operator!=(const iterator &other) const;
+
+            private:
+                void skip();                                    // skip removed slots
+                ObserverImpl *const *m_pos;                     // current position
+                ObserverImpl *const *m_end;                     // end of slots
+        };
+
+        ObserverView(const std::vector<ObserverImpl*> &slots, std::size_t size);
+        template<typename U>
+        explicit ObserverView(const ObserverView<U> &other);    // view the same slots as another type
+        iterator begin() const;                                 // first observer
+        iterator end() const;                                   // past the last observer
+        std::size_t size() const;                               // number of observers
+        bool empty() const;                                     // no observers
+
+    private:
+        template<typename U>
+        friend class ObserverView;
+        static O* cast(ObserverImpl *observer);                 // cast from ObserverImpl* to O*
+        const std::vector<ObserverImpl*> *m_slots;              // slots of the subject, nullptr if removed
+        std::size_t m_size;                                     // number of observers
+};
+
+class MessageMask                                               // message ids an observer is interested in
+{
+    public:
+        MessageMask();                                          // constructor, all messages
+        MessageMask(std::initializer_list<long> msgs);          // constructor, only msgs
+        bool matches(long msg) const;                           // whether msg is one of the ids, exact for ids out of [0, 62] too
+        std::uint64_t bits() const;                             // one bit per message id
+        const std::vector<long>& wideIds() const;               // ids out of [0, 62] sorted, empty if bit 63 stands for all of them
+        static std::uint64_t bitOf(long msg);                   // bit of msg, ids out of [0, 62] share bit 63
+        static MessageMask fromBits(std::uint64_t bits);        // mask of bits as returned by bits, e.g. restored from a file, bit 63 for all ids out of [0, 62]
+
+    private:
+        std::uint64_t m_bits;                                   // one bit per message id
+        std::vector<long> m_wide;                               // ids out of [0, 62] sorted, empty if none or all of them
+};
+
+class MessageSpan                                               // contiguous message ids not owned, std::span<const long> of C++11
+{
+    public:
+        MessageSpan();                                          // constructor, empty
+        MessageSpan(const long *data, std::size_t size);        // constructor, view size ids from data
+        const long* begin() const;                              // first message
+        const long* end() const;                                // past the last message
+        const long* data() const;                               // first message, nullptr if empty
+        std::size_t size() const;                               // number of messages
+        bool empty() const;                                     // no messages
+        long operator[](std::size_t index) const;               // message at index, index MUST be less than size
+        std::uint64_t bits() const;                             // union of MessageMask bits of all messages
+
+    private:
+        const long *m_data;                                     // first message
+        std::size_t m_size;                                     // number of messages
+};
+
+class Message                                                   // payload of notifyAsync, small events stored inline
+{
+    public:
+        Message(long msg);                                      // message id, for update(long)
+        template<typename E, bool (*Deliver)(ObserverImpl*, const E&), typename Arg>
+        static Message of(Arg &&event);                         // typed event, for update(const E&)
+        Message(const Message &other);                          // copy from left value
+        Message(Message &&other);                               // move from right value
+        ~Message();                                             // destrctor
+        Message& operator=(const Message &other);               // assign from left value
+        Message& operator=(Message &&other);                    // assign from right value
+        bool deliver(ObserverImpl *observer) const;             // invoke update of observer with the payload
+        bool sameKind(const Message &other) const;              // same message id, or same event type
+        std::uint64_t bits() const;                             // MessageMask bit of message id, all bits for events
+
+    private:
+        enum Operation { Copy, Move, Destroy };
+        static const std::size_t InlineSize = 3 * sizeof(void*); // larger events are shared by reference count
+        typedef bool (*DeliverFunc)(ObserverImpl*, const void*);
+        typedef void (*ManageFunc)(Operation, void*, void*);
+        typedef std::aligned_storage<InlineSize>::type Storage;
+
+        template<typename E>
+        struct StoredInline : std::integral_constant<bool, sizeof(E) <= InlineSize
+            && std::alignment_of<E>::value <= std::alignment_of<Storage>::value
+            && std::is_nothrow_move_constructible<E>::value> {}; // whether E is stored inline
+
+        Message(DeliverFunc deliver, ManageFunc manage);        // constructor, payload not set yet
+        template<typename E, bool (*Deliver)(ObserverImpl*, const E&), typename Arg>
+        static Message make(Arg &&event, std::true_type);       // event stored inline
+        template<typename E, bool (*Deliver)(ObserverImpl*, const E&), typename Arg>
+        static Message make(Arg &&event, std::false_type);      // event stored in a shared_ptr
+        void assign(const Message &other);                      // copy payload of other, empty now
+        void assign(Message &&other);                           // move payload of other, empty now
+        void clear();                                           // destroy payload
+        template<typename P>
+        static void manage(Operation operation, void *target, void *source); // copy, move or destroy payload of type P
+        template<typename E, bool (*Deliver)(ObserverImpl*, const E&)>
+        static bool deliverInline(ObserverImpl *observer, const void *payload);
+        template<typename E, bool (*Deliver)(ObserverImpl*, const E&)>
+        static bool deliverShared(ObserverImpl *observer, const void *payload);
+        static bool deliverId(ObserverImpl *observer, const void *payload);
+
+        Storage m_payload;                                      // event, or shared_ptr to event if too large
+        DeliverFunc m_deliver;                                  // update observer with m_payload
+        ManageFunc m_manage;                                    // nullptr if m_payload is trivially copyable
+};
+
+struct ObserverHook                                             // link of an observer in the list of an intrusive subject
+{
+    ObserverImpl *m_prev;                                       // previous observer, the last one if first
+    ObserverImpl *m_next;                                       // next observer, the first one if last, nullptr if not linked
+    std::uint64_t m_messages;                                   // MessageMask bits
+};
+
+enum class ObserverInit                                         // when observers added in bulk are initialized
+{
+    Immediate,                                                  // once all of them are attached, before the bulk add returns
+    Deferred                                                    // by initObservers, e.g. once a whole graph is wired
+};
+
+class SubscriptionGraph;                                        // forward declaration
+
+class MessageTap                                                // base of a subject class that also sees the message ids it notifies, interface
+{
+    public:
+        virtual ~MessageTap();                                  // destrctor, virtual
+        virtual void tap(long msg) const = 0;                   // msg notified, invoked before any observer gets it, pure virtual
+};
+
 class SubjectImpl                                               // for implementation of Subject only
 {
+    // ObserverImpl invokes attach and detach
+    friend class ObserverImpl;
+    // SubscriptionGraph lists and restores observers with their own masks and priorities
+    friend class SubscriptionGraph;
     public:
         SubjectImpl();                                          // constructor
         virtual ~SubjectImpl() = 0;                             // destrctor, pure virtual
-        bool addObserver(ObserverImpl *observer);               // add one observer
+        bool addObserver(ObserverImpl *observer, MessageMask messages = MessageMask(), int priority = 0); // add one observer, for messages only, higher priority first
         bool removeObserver(ObserverImpl *observer);            // remove one observer
-        const std::list<ObserverImpl*>& getObservers() const;   // get list of observers
+        std::size_t addObservers(ObserverImpl *const *observers, std::size_t count, MessageMask messages = MessageMask(), int priority = 0,
+                                 ObserverInit init = ObserverInit::Immediate); // add observers in one pass, number added
+        std::size_t initObservers();                            // init observers added with ObserverInit::Deferred, number initialized
+#ifdef OBSERVERPATTERN_INSTRUMENTATION
+        SubjectStatsSnapshot getStats() const;                  // copy of counters, from any thread, lock-free, a drain counts as one notify
+#endif
+#ifdef OBSERVERPATTERN_JOURNAL
+        void setJournalId(std::uint32_t id);                    // id of this subject in journal records, 0 by default
+        std::uint32_t getJournalId() const;                     // id of this subject in journal records
+#endif
 
     protected:
-        void notify(long msg) const;                            // notify all observers
+        struct Subscribed                                       // one observer as stored by a subject
+        {
+            ObserverImpl *m_observer;                           // the observer
+            std::uint64_t m_messages;                           // MessageMask bits
+            int m_priority;                                     // order among observers of the subject
+        };
+
+        virtual bool attach(ObserverImpl *observer, MessageMask messages) = 0; // store one observer, pure virtual
+        virtual bool detach(ObserverImpl *observer) = 0;        // drop one observer, pure virtual
+        virtual void attachAll(const Subscribed *observers, std::size_t count); // store observers none of which is stored yet, default attach each
+        virtual void subscriptions(std::vector<Subscribed> &observers) const = 0; // append observers in notify order, pure virtual
+        static const std::size_t NoSlot = 0x7FFFFFFF;           // slot of an observer not stored in slots, stores keep fewer observers
+        static std::size_t slotOf(const ObserverImpl *observer); // slot of observer reserved for the store, NoSlot if none
+        static void setSlot(ObserverImpl *observer, std::size_t slot); // keep slot of observer, below NoSlot or NoSlot
+        static ObserverHook& hookOf(ObserverImpl *observer);    // link of observer, an IntrusiveObserverImpl as all observers of the intrusive store
+        static int priorityOf(const ObserverImpl *observer);    // priority given when observer started observing
+        static bool threadSafeOf(const ObserverImpl *observer); // whether update of observer may run on any thread at any time
+        static bool updateOf(ObserverImpl *observer, long msg); // invoke update unless msg is an id out of [0, 62] the observer does not observe
+        static bool observesOf(const ObserverImpl *observer, long msg); // whether msg passes the exact check after its bit matched
+        static bool updateBatchOf(ObserverImpl *observer, std::uint64_t messages, MessageSpan msgs, std::uint64_t bits); // invoke updateBatch with the msgs of bits observer observes, messages its mask
+#ifdef OBSERVERPATTERN_INSTRUMENTATION
+        ObserverStats* statsOf(ObserverImpl *observer) const;   // entry of observer in the table, claimed at its first update, serial, intrusive and versioned stores
+        void releaseStats(ObserverImpl *observer) const;        // give the entry of observer back once detached, serial, intrusive and versioned stores
+        StatsTable& statsTable() const;                         // counters of this subject and its observers, allocated at the first use
+        SubjectStats& stats() const;                            // stats of this subject
+#endif
 
     private:
         SubjectImpl(const SubjectImpl&) = delete;               // disable copy from left value
         SubjectImpl(const SubjectImpl&&) = delete;              // disable copy from right value
         SubjectImpl& operator=(const SubjectImpl&) = delete;    // disable assign from left value
         SubjectImpl& operator=(const SubjectImpl&&) = delete;   // disable assign from right value
-        std::list<ObserverImpl*> m_observers;                   // list of observers
+        std::size_t addAll(std::vector<Subscribed> &observers, ObserverInit init, const MessageMask &messages = MessageMask()); // start observing this for each, one attachAll, number added, messages gives the ids out of [0, 62]
+#ifdef OBSERVERPATTERN_INSTRUMENTATION
+        mutable std::atomic<StatsTable*> m_statsTable;          // counters of notify and update, nullptr until the first notify
+#endif
+#ifdef OBSERVERPATTERN_JOURNAL
+        std::uint32_t m_journalId;                              // id in journal records
+#endif
+};
+
+enum class BatchMerge                                           // how a batch coalesces repeated messages
+{
+    KeepAll,                                                    // defer only, deliver every message
+    KeepFirst,                                                  // keep the first of a kind at its position
+    KeepLast                                                    // keep the last of a kind at its position
+};
+
+class SerialSubjectImpl;                                        // forward declaration
+
+class NotifyBatch                                               // defers notify of a subject until destroyed
+{
+    public:
+        NotifyBatch(SerialSubjectImpl *subject, BatchMerge merge); // constructor, begin batch
+        NotifyBatch(NotifyBatch &&other);                       // take over the batch
+        ~NotifyBatch();                                         // destrctor, end batch, deliver if outermost
+
+    private:
+        NotifyBatch(const NotifyBatch&) = delete;               // disable copy from left value
+        NotifyBatch& operator=(const NotifyBatch&) = delete;    // disable assign from left value
+        NotifyBatch& operator=(NotifyBatch&&) = delete;         // disable assign from right value
+        SerialSubjectImpl *m_subject;                           // the subject, nullptr if moved from
+};
+
+class PropagationEngine                                         // runs notify of serial subjects from a work queue instead of recursion
+{
+    // SerialSubjectImpl posts notify while an engine runs on current thread
+    friend class SerialSubjectImpl;
+    public:
+        struct Stats                                            // of the last run
+        {
+            std::size_t m_notified;                             // (subject, msg) pairs notified
+            std::size_t m_updates;                              // update invoked
+            std::size_t m_revisits;                             // (subject, msg) pairs posted again, i.e. cycles
+            std::size_t m_pruned;                               // pairs dropped by budget
+            unsigned m_depth;                                   // deepest pair notified
+        };
+
+        explicit PropagationEngine(unsigned maxDepth = std::numeric_limits<unsigned>::max(),
+                                   std::size_t maxUpdates = std::numeric_limits<std::size_t>::max());
+        template<typename F>
+        void run(F func);                                       // invoke func, then notify breadth-first, each pair once
+        const Stats& getStats() const;                          // stats of the last run
+        static PropagationEngine* current();                    // engine running on current thread, nullptr if none
+
+    private:
+        PropagationEngine(const PropagationEngine&) = delete;   // disable copy from left value
+        PropagationEngine& operator=(const PropagationEngine&) = delete; // disable assign from left value
+
+        struct Item                                             // notify waiting in the queue
+        {
+            const SerialSubjectImpl *m_subject;                 // subject to notify
+            long m_msg;                                         // message id
+            unsigned m_depth;                                   // hops from the notify outside of the engine
+        };
+        struct KeyHash                                          // hash of (subject, msg)
+        {
+            std::size_t operator()(const std::pair<const SerialSubjectImpl*, long> &key) const;
+        };
+
+        void post(const SerialSubjectImpl *subject, long msg);  // queue notify unless visited in this run
+        void forget(const SerialSubjectImpl *subject);          // drop queued notify of subject being destroyed
+        void drain();                                           // notify queued pairs within budget
+        static PropagationEngine*& running();                   // engine running on current thread
+
+        const unsigned m_maxDepth;                              // pairs deeper are pruned
+        const std::size_t m_maxUpdates;                         // pairs after that many update are pruned
+        std::deque<Item> m_queue;                               // pairs waiting, breadth-first
+        std::unordered_set<std::pair<const SerialSubjectImpl*, long>, KeyHash> m_visited; // pairs posted in this run
+        unsigned m_depth;                                       // depth of the pair being notified
+        Stats m_stats;                                          // stats of the current or last run
+};
+
+class SerialSubjectImpl : public SubjectImpl                    // observers in contiguous slots, not thread-safe
+{
+    // NotifyBatch begins and ends batches, PropagationEngine notifies from its queue
+    friend class NotifyBatch;
+    friend class PropagationEngine;
+    public:
+        template<typename O>
+        using View = ObserverView<O>;                           // type returned by getObservers
+        SerialSubjectImpl();                                    // constructor
+        virtual ~SerialSubjectImpl();                           // destrctor, virtual
+        ObserverView<ObserverImpl> getObservers() const;        // get view of observers
+        NotifyBatch beginBatch(BatchMerge merge = BatchMerge::KeepLast); // defer notify until the batch is destroyed
+
+    protected:
+        void notify(long msg) const;                            // notify all observers
+        void notifyBatch(MessageSpan msgs) const;               // one updateBatch per observer, each message deferred or posted alone in a batch or an engine
+        template<typename E, bool (*Deliver)(ObserverImpl*, const E&)>
+        void notifyEvent(const E &event) const;                 // notify all observers of typed event
+        bool notifyUntilConsumed(long msg) const;               // notify observers until one update returns true, never deferred
+        template<typename E, bool (*Deliver)(ObserverImpl*, const E&)>
+        bool notifyEventUntilConsumed(const E &event) const;    // notify observers of typed event until one consumes it, never deferred
+        template<typename F>
+        bool notifyWith(F deliver, std::uint64_t bits = ~std::uint64_t(0), bool consumable = false) const; // invoke deliver on observers matching bits, stop at true if consumable
+        bool attach(ObserverImpl *observer, MessageMask messages) override; // store one observer after those of higher or equal priority
+        bool detach(ObserverImpl *observer) override;           // drop one observer
+        void attachAll(const Subscribed *observers, std::size_t count) override; // append observers, sort once if out of priority order
+        void subscriptions(std::vector<Subscribed> &observers) const override; // append observers in slot order
+
+    private:
+        bool hasObserver(ObserverImpl *observer) const;         // whether observer is in the slots
+        void compact();                                         // drop removed slots, keep observing order
+        void sort();                                            // order slots by priority after observers added during notify
+        void defer(Message message) const;                      // hold message until the batch ends
+        void endBatch();                                        // deliver deferred messages if outermost
+        void propagate(long msg, PropagationEngine &engine) const; // notify from the queue of engine
+        bool batching() const;                                  // whether a batch is open
+
+        struct BatchState                                       // state of open batches, allocated at the first beginBatch
+        {
+            unsigned m_depth;                                   // depth of nested batches
+            BatchMerge m_merge;                                 // merge policy of outermost batch
+            std::vector<Message> m_deferred;                    // messages held by batch
+        };
+
+        std::vector<ObserverImpl*> m_observers;                 // slots of observers, nullptr if removed
+        std::vector<std::uint64_t> m_messages;                  // MessageMask bits per slot, 0 if removed
+        std::size_t m_removed;                                  // number of removed slots
+        mutable unsigned m_notifying;                           // depth of nested notify
+        bool m_unsorted;                                        // observer appended out of priority order during notify
+        std::unique_ptr<BatchState> m_batch;                    // batch state, nullptr until the first batch
+};
+
+template<typename O>
+class ObserverSnapshot;                                         // forward declaration
+
+class ConcurrentSubjectImpl : public SubjectImpl                // observers in copy-on-write snapshots, thread-safe
+{
+    // ObserverSnapshot enters and exits read epochs
+    template<typename O>
+    friend class ObserverSnapshot;
+    public:
+        template<typename O>
+        using View = ObserverSnapshot<O>;                       // type returned by getObservers
+        ConcurrentSubjectImpl();                                // constructor
+        virtual ~ConcurrentSubjectImpl();                       // destrctor, virtual
+        ObserverSnapshot<ObserverImpl> getObservers() const;    // get snapshot of observers
+        void setExecutor(Executor *executor);                   // executor of notifyAsync, nullptr for ThreadPool::instance()
+        void setMemoryResource(MemoryResource *resource);       // source of subscriptions and snapshots, nullptr for NodePool::instance()
+        void setParallelism(std::size_t grain, std::size_t threshold); // observers per task and fewest observers for notifyParallel to fork
+        void flush() const;                                     // wait until all notifyAsync are delivered, rethrow the first exception an update threw meanwhile
+
+    protected:
+        void notify(long msg) const;                            // notify all observers, lock-free
+        void notifyBatch(MessageSpan msgs) const;               // one updateBatch per observer, lock-free
+        template<typename E, bool (*Deliver)(ObserverImpl*, const E&)>
+        void notifyEvent(const E &event) const;                 // notify all observers of typed event, lock-free
+        bool notifyUntilConsumed(long msg) const;               // notify observers until one update returns true, lock-free
+        template<typename E, bool (*Deliver)(ObserverImpl*, const E&)>
+        bool notifyEventUntilConsumed(const E &event) const;    // notify observers of typed event until one consumes it, lock-free
+        template<typename F>
+        bool notifyWith(F deliver, std::uint64_t bits = ~std::uint64_t(0), bool consumable = false) const; // invoke deliver on observers matching bits, stop at true if consumable, lock-free
+        void notifyAsync(Message message) const;                // notify all observers on the executor, in order per observer, an update that throws does not stop the others
+        void notifyParallel(long msg) const;                    // notify all observers, thread-safe ones in chunks on the executor
+        template<typename E, bool (*Deliver)(ObserverImpl*, const E&)>
+        void notifyEventParallel(const E &event) const;         // notify all observers of typed event, thread-safe ones in chunks on the executor
+        template<typename F>
+        void notifyParallelWith(F deliver, std::uint64_t bits = ~std::uint64_t(0)) const; // invoke deliver on observers matching bits, fork-join
+        bool attach(ObserverImpl *observer, MessageMask messages) override; // store one observer after those of higher or equal priority
+        bool detach(ObserverImpl *observer) override;           // drop one observer, wait for notify of older snapshots on other threads
+        void attachAll(const Subscribed *observers, std::size_t count) override; // store observers in one new snapshot
+        void subscriptions(std::vector<Subscribed> &observers) const override; // append observers of the current snapshot
+
+    private:
+        struct Subscription                                     // one observer in snapshots
+        {
+            Subscription(ObserverImpl *observer, MessageMask messages, MemoryResource *resource);
+            ObserverImpl *const m_observer;                     // the observer
+            MemoryResource *const m_resource;                   // memory of this subscription
+            const std::uint64_t m_messages;                     // MessageMask bits
+            const bool m_threadSafe;                            // update may run in a chunk of notifyParallel
+            std::atomic<bool> m_active;                         // false once detached, skipped by notify still reading it, no more update of notifyAsync
+            std::atomic<unsigned> m_dispatching;                // number of update of notifyAsync in progress
+            std::mutex m_queueLock;                             // guard m_queue and m_scheduled
+            std::vector<Message> m_queue;                       // messages of notifyAsync not delivered yet
+            bool m_scheduled;                                   // deliver task queued on the executor
+#ifdef OBSERVERPATTERN_INSTRUMENTATION
+            std::atomic<ObserverStats*> m_stats;                // entry in the stats table, nullptr until the first update
+#endif
+        };
+        struct Snapshot : std::vector<Subscription*, ResourceAllocator<Subscription*>> // immutable once published
+        {
+            explicit Snapshot(MemoryResource *resource);        // constructor, empty
+            mutable std::atomic<long> m_readers;                // notify iterating this snapshot, detach waits for those of replaced ones
+        };
+        struct NotifyFrame                                      // notify in progress on current thread, one per notify, not per update
+        {
+            const ConcurrentSubjectImpl *m_subject;             // subject notifying
+            const Snapshot *m_snapshot;                         // snapshot iterated, counted in its m_readers, nullptr for notifyAsync
+            const Subscription *m_current;                      // subscription being updated, nullptr if none
+            NotifyFrame *m_prev;                                // enclosing notify, for a chunk of notifyParallel those of the notifying thread
+        };
+        struct FrameGuard                                       // push a frame, pop it even if update throws
+        {
+            FrameGuard(const ConcurrentSubjectImpl *subject, const Snapshot *snapshot, NotifyFrame *prev);
+            ~FrameGuard();
+            NotifyFrame m_frame;                                // the frame pushed
+        };
+        struct Retired                                          // snapshot replaced, freed after two epochs
+        {
+            const Snapshot *m_snapshot;                         // the snapshot replaced
+            Subscription *m_removed;                            // subscription removed, nullptr if none
+            std::uint64_t m_epoch;                              // epoch when replaced
+        };
+
+        unsigned enterRead() const;                             // enter current epoch, return its parity
+        void exitRead(unsigned epoch) const;                    // exit epoch entered
+        Snapshot* createSnapshot(std::size_t capacity) const;   // empty snapshot from m_resource, m_writer locked
+        Subscription* createSubscription(ObserverImpl *observer, MessageMask messages) const; // from m_resource, m_writer locked
+        static void destroy(const Snapshot *snapshot);          // give snapshot back to its resource
+        static void destroy(Subscription *subscription);        // give subscription back to its resource
+        void publish(const Snapshot *snapshot, Subscription *removed); // replace snapshot, m_writer locked
+        void reclaim();                                         // free retired snapshots, m_writer locked
+        template<typename F>
+        bool notifySnapshot(const Snapshot *snapshot, F &deliver, std::uint64_t bits, bool consumable) const; // loop of notifyWith, epoch entered
+        template<typename F>
+        bool dispatch(Subscription *subscription, F &deliver) const; // invoke deliver on one observer of a snapshot, its result
+#ifdef OBSERVERPATTERN_INSTRUMENTATION
+        ObserverStats* statsOf(Subscription *subscription) const; // entry of subscription in the table, claimed at its first update while active
+#endif
+        template<typename F>
+        bool dispatchAsync(Subscription *subscription, F deliver) const; // invoke deliver on one observer if still active, its result
+        bool quiescent(const Subscription *removed) const;      // whether only this thread and threads waiting in detach may update removed, m_writer locked
+        void awaitQuiescent(std::unique_lock<std::mutex> &lock, const Subscription *removed); // block until quiescent, m_writer released meanwhile
+        void left() const;                                      // a reader left a snapshot or an update of notifyAsync, wake awaitQuiescent
+        void fanOut() const;                                    // task, queue messages of notifyAsync per observer
+        void deliver(Subscription *subscription, unsigned epoch) const; // task, update one observer in order
+        void finished(std::size_t count) const;                 // count async work done, wake flush
+        void failed(std::exception_ptr error) const;            // keep the first exception of an update of notifyAsync for flush
+        void waitAsync() const;                                 // wait until all notifyAsync are delivered
+        Executor& executor() const;                             // executor of notifyAsync
+        static NotifyFrame*& notifyFrames();                    // notify in progress on current thread
+
+        std::atomic<const Snapshot*> m_snapshot;                // current snapshot, immutable
+        mutable std::atomic<std::uint64_t> m_epoch;             // current read epoch
+        mutable std::atomic<long> m_readers[2];                 // number of readers per epoch parity
+        std::vector<Retired> m_retired;                         // snapshots replaced, m_writer locked
+        std::vector<const NotifyFrame*> m_waiters;              // frames of threads waiting in detach, not running, m_writer locked
+        std::vector<Subscription*> m_unlinked;                  // unlinked by the destrctor, nullptr once stopped by detach meanwhile, m_writer locked
+        mutable std::mutex m_writer;                            // serialize attach and detach, pair with m_quiet
+        mutable std::condition_variable m_quiet;                // a reader left, signalled only while m_detaching
+        mutable std::atomic<unsigned> m_detaching;              // threads in awaitQuiescent
+        MemoryResource *m_resource;                             // memory of new subscriptions and snapshots, m_writer locked
+        Executor *m_executor;                                   // executor of notifyAsync, nullptr for default
+        std::size_t m_grain;                                    // observers per chunk of notifyParallel
+        std::size_t m_threshold;                                // notifyParallel of fewer observers runs the serial loop
+        mutable std::mutex m_asyncLock;                         // guard m_asyncQueue and m_asyncScheduled
+        mutable std::vector<Message> m_asyncQueue;              // messages of notifyAsync not fanned out yet
+        mutable bool m_asyncScheduled;                          // fan-out task queued on the executor
+        mutable std::atomic<std::size_t> m_asyncPending;        // messages and tasks not done yet
+        mutable std::mutex m_flushLock;                         // guard decrease of m_asyncPending and m_asyncError
+        mutable std::exception_ptr m_asyncError;                // first exception thrown by an update of notifyAsync, not rethrown yet
+        mutable std::condition_variable m_flushed;              // m_asyncPending dropped to 0
+};
+
+template<typename O>
+class ObserverSnapshot                                          // view over an immutable snapshot of a concurrent subject
+{
+    public:
+        class iterator                                          // forward iterator
+        {
+            public:
+                typedef std::forward_iterator_tag iterator_category;
+                typedef O* value_type;
+                typedef std::ptrdiff_t difference_type;
+                typedef O* const* pointer;
+                typedef O* reference;
+
+                explicit iterator(const ConcurrentSubjectImpl::Subscription *const *pos);
+                O* operator*() const;                           // the observer at current position
+                iterator& operator++();                         // advance to next observer
+                iterator operator++(int);                       // advance to next observer
+                bool operator==(const iterator &other) const;
+                bool operator!=(const iterator &other) const;
+
+            private:
+                const ConcurrentSubjectImpl::Subscription *const *m_pos; // current position
+        };
+
+        explicit ObserverSnapshot(const ConcurrentSubjectImpl *subject);
+        template<typename U>
+        explicit ObserverSnapshot(ObserverSnapshot<U> &&other); // take over the snapshot of another type
+        ObserverSnapshot(ObserverSnapshot &&other);             // take over the snapshot
+        ~ObserverSnapshot();                                    // release the snapshot
+        iterator begin() const;                                 // first observer
+        iterator end() const;                                   // past the last observer
+        std::size_t size() const;                               // number of observers
+        bool empty() const;                                     // no observers
+
+    private:
+        template<typename U>
+        friend class ObserverSnapshot;
+        ObserverSnapshot(const ObserverSnapshot&) = delete;     // disable copy from left value
+        ObserverSnapshot& operator=(const ObserverSnapshot&) = delete; // disable assign from left value
+        static O* cast(const ConcurrentSubjectImpl::Subscription *subscription); // cast from subscription to O*
+        const ConcurrentSubjectImpl *m_subject;                 // the subject, nullptr if moved from
+        unsigned m_epoch;                                       // parity of the read epoch entered
+        const ConcurrentSubjectImpl::Subscription *const *m_begin; // first subscription
+        const ConcurrentSubjectImpl::Subscription *const *m_end;   // past the last subscription
+};
+
+template<typename O>
+class IntrusiveView                                             // non-allocating view over the observers linked to an intrusive subject
+{
+    public:
+        class iterator                                          // forward iterator
+        {
+            public:
+                typedef std::forward_iterator_tag iterator_category;
+                typedef O* value_type;
+                typedef std::ptrdiff_t difference_type;
+                typedef O* const* pointer;
+                typedef O* reference;
+
+                iterator(ObserverImpl *pos, ObserverImpl *head);
+                O* operator*() const;                           // the observer at current position
+                iterator& operator++();                         // advance to next observer
+                iterator operator++(int);                       // advance to next observer
+                bool operator==(const iterator &other) const;
+                bool operator!=(const iterator &other) const;
+
+            private:
+                ObserverImpl *m_pos;                            // current observer, nullptr past the last
+                ObserverImpl *m_head;                           // first observer
+        };
+
+        explicit IntrusiveView(ObserverImpl *head);
+        template<typename U>
+        explicit IntrusiveView(const IntrusiveView<U> &other);  // view the same list as another type
+        iterator begin() const;                                 // first observer
+        iterator end() const;                                   // past the last observer
+        std::size_t size() const;                               // number of observers, walks the list
+        bool empty() const;                                     // no observers
+
+    private:
+        template<typename U>
+        friend class IntrusiveView;
+        static O* cast(ObserverImpl *observer);                 // cast from ObserverImpl* to O*
+        ObserverImpl *m_head;                                   // first observer, nullptr if none
+};
+
+class IntrusiveSubjectImpl : public SubjectImpl                 // observers linked through their own hooks, not thread-safe
+{
+    public:
+        template<typename O>
+        using View = IntrusiveView<O>;                          // type returned by getObservers
+        IntrusiveSubjectImpl();                                 // constructor
+        virtual ~IntrusiveSubjectImpl();                        // destrctor, virtual
+        IntrusiveView<ObserverImpl> getObservers() const;       // get view of observers
+
+    protected:
+        void notify(long msg) const;                            // notify all observers
+        void notifyBatch(MessageSpan msgs) const;               // one updateBatch per observer
+        template<typename E, bool (*Deliver)(ObserverImpl*, const E&)>
+        void notifyEvent(const E &event) const;                 // notify all observers of typed event
+        bool notifyUntilConsumed(long msg) const;               // notify observers until one update returns true
+        template<typename E, bool (*Deliver)(ObserverImpl*, const E&)>
+        bool notifyEventUntilConsumed(const E &event) const;    // notify observers of typed event until one consumes it
+        template<typename F>
+        bool notifyWith(F deliver, std::uint64_t bits = ~std::uint64_t(0), bool consumable = false) const; // invoke deliver on observers matching bits, stop at true if consumable
+        bool attach(ObserverImpl *observer, MessageMask messages) override; // link one observer after those of higher or equal priority
+        bool detach(ObserverImpl *observer) override;           // unlink one observer
+        void attachAll(const Subscribed *observers, std::size_t count) override; // link observers in one walk, merged by priority
+        void subscriptions(std::vector<Subscribed> &observers) const override; // append observers in link order
+
+    private:
+        struct NotifyFrame                                      // notify in progress on current thread
+        {
+            const IntrusiveSubjectImpl *m_subject;              // subject notifying
+            ObserverImpl *m_next;                               // next observer to visit
+            ObserverImpl *m_last;                               // last observer to visit, observers linked later are not
+            bool m_done;                                        // m_last visited or unlinked
+            NotifyFrame *m_prev;                                // enclosing notify, nullptr if none
+            ObserverImpl *m_current;                            // observer in update, nullptr once unlinked, instrumentation only
+        };
+
+        static NotifyFrame*& notifyFrames();                    // notify in progress on current thread
+        ObserverImpl *m_head;                                   // first observer, nullptr if none, the only state
+};
+
+class VersionedSubjectImpl : public SubjectImpl                 // notify marks observers dirty, they pull or are drained, not thread-safe
+{
+    public:
+        template<typename O>
+        using View = ObserverView<O>;                           // type returned by getObservers
+        VersionedSubjectImpl();                                 // constructor
+        virtual ~VersionedSubjectImpl();                        // destrctor, virtual
+        ObserverView<ObserverImpl> getObservers() const;        // get view of observers
+        std::uint64_t getVersion() const;                       // number of notify so far
+        bool isDirty(ObserverImpl *observer) const;             // whether notified since its last pull or update
+        std::uint64_t pull(ObserverImpl *observer);             // mark observer clean, current version, the observer reads the state itself
+        std::size_t getDirtyCount() const;                      // number of dirty observers
+        std::size_t drain(std::size_t max = std::numeric_limits<std::size_t>::max()); // update dirty observers once each with their latest message, number updated
+
+    protected:
+        void notify(long msg) const;                            // bump version, mark observers of msg dirty, no update invoked
+        void notifyBatch(MessageSpan msgs) const;               // notify each message, dirty bits coalesce them anyway
+        bool attach(ObserverImpl *observer, MessageMask messages) override; // store one observer, in a free slot if any
+        bool detach(ObserverImpl *observer) override;           // drop one observer
+        void subscriptions(std::vector<Subscribed> &observers) const override; // append observers in slot order
+
+    private:
+        bool hasObserver(ObserverImpl *observer) const;         // whether observer is in the slots
+        static unsigned lowestBit(std::uint64_t word);          // index of the lowest bit set, word MUST not be 0
+        static unsigned bitCount(std::uint64_t word);           // number of bits set
+        std::vector<ObserverImpl*> m_observers;                 // slots of observers, nullptr if removed
+        std::vector<std::uint64_t> m_messages;                  // MessageMask bits per slot, 0 if removed
+        std::vector<std::size_t> m_free;                        // removed slots, reused unless draining
+        std::vector<std::size_t> m_filtered;                    // slots of observers not observing all messages
+        std::vector<std::uint64_t> m_all;                       // one bit per slot observing all messages
+        mutable std::vector<std::uint64_t> m_dirty;             // one bit per slot notified since its last pull or update
+        mutable std::vector<long> m_latest;                     // latest message per slot in m_filtered
+        mutable long m_last;                                    // latest message, for slots in m_all
+        mutable std::uint64_t m_version;                        // number of notify so far
+        unsigned m_draining;                                    // depth of nested drain
 };
 
 class ObserverImpl                                              // for implementation of Observer only
 {
+    // SubjectImpl maintains m_slot and starts observers added in bulk
+    friend class SubjectImpl;
+    // Message delivers ids through observes
+    friend class Message;
     public:
         ObserverImpl();                                         // constructor
         virtual ~ObserverImpl();                                // destrctor, virtual
-        bool startObserve(SubjectImpl *subject);                // start observing the subject
+        bool startObserve(SubjectImpl *subject, MessageMask messages = MessageMask(), int priority = 0); // start observing the subject, higher priority first
         bool stopObserve(SubjectImpl *subject);                 // stop observing the subject
         virtual bool update(long msg) = 0;                      // react to the change to keep update, pure virtual
+        virtual bool updateBatch(MessageSpan msgs);             // react to several changes at once, default update each in order, whether any returned true
         SubjectImpl* getSubject() const;                        // get the subject observed
+        int getPriority() const;                                // priority given when started observing, 0 by default
+
+    protected:
+        void stopObserve();                                     // stop observing the subject if any
+        virtual bool init() = 0;                                // initialize, invoked after start observing, pure virtual
+        virtual bool uninit() = 0;                              // uninitialize, invoked before stop observing, pure virtual
+        virtual void detached();                                // invoked after stop observing, last access to this
+        virtual bool threadSafeUpdate() const;                  // whether update may run on any thread concurrently with others, default false
+
+    private:
+        ObserverImpl(const ObserverImpl&) = delete;             // disable copy from left value
+        ObserverImpl(const ObserverImpl&&) = delete;            // disable copy from right value
+        ObserverImpl& operator=(const ObserverImpl&) = delete;  // disable assign from left value
+        ObserverImpl& operator=(const ObserverImpl&&) = delete; // disable assign from right value
+        void observeWide(const MessageMask &messages);          // keep the ids out of [0, 62] of messages, before attach
+        bool observes(long msg) const;                          // false only for an id out of [0, 62] not in m_wide, bit 63 already matched
+        SubjectImpl *m_subject;                                 // the subject observed
+        std::unique_ptr<const std::vector<long>> m_wide;        // ids out of [0, 62] observed sorted, nullptr if bit 63 stands for all of them
+        int m_priority;                                         // order among observers of the subject, fixed while observing
+        std::uint32_t m_slot : 31;                              // reserved for the serial and versioned stores, NoSlot if none
+        std::uint32_t m_initPending : 1;                        // added with ObserverInit::Deferred, init not invoked yet
+#ifdef OBSERVERPATTERN_INSTRUMENTATION
+        ObserverStats *m_stats;                                 // reserved for the serial, intrusive and versioned stores, entry in the stats table
+#endif
+};
+
+class IntrusiveObserverImpl : public ObserverImpl               // for implementation of Observer of an intrusive subject only
+{
+    // SubjectImpl links m_hook, IntrusiveView walks it
+    friend class SubjectImpl;
+    template<typename O>
+    friend class IntrusiveView;
+    public:
+        IntrusiveObserverImpl();                                // constructor, not linked
+
+    private:
+        ObserverHook m_hook;                                    // link in the list of the intrusive subject observed
+};
+
+template<typename O>
+ObserverView<O>::iterator::iterator(ObserverImpl *const *pos, ObserverImpl *const *end): m_pos(pos), m_end(end)
+{
+    skip();
+}
+
+template<typename O>
+O* ObserverView<O>::iterator::operator*() const
+{
+    return ObserverView<O>::cast(*m_pos);
+}
+
+template<typename O>
+typename ObserverView<O>::iterator& ObserverView<O>::iterator::operator++()
+{
+    ++m_pos;
+    skip();
+    return *this;
+}
+
+template<typename O>
+typename ObserverView<O>::iterator ObserverView<O>::iterator::operator++(int)
+{
+    iterator it = *this;
+    ++(*this);
+    return it;
+}
+
+template<typename O>
+bool ObserverView<O>::iterator::operator==(const iterator &other) const
+{
+    return m_pos == other.m_pos;
+}
+
+template<typename O>
+bool ObserverView<O>::iterator::operator!=(const iterator &other) const
+{
+    return m_pos != other.m_pos;
+}
+
+template<typename O>
+void ObserverView<O>::iterator::skip()
+{
+    while (m_pos != m_end && !*m_pos)
+    {
+        ++m_pos;                                                // removed slot
+    }
+}
+
+template<typename O>
+ObserverView<O>::ObserverView(const std::vector<ObserverImpl*> &slots, std::size_t size): m_slots(&slots), m_size(size) {}
+
+template<typename O>
+template<typename U>
+ObserverView<O>::ObserverView(const ObserverView<U> &other): m_slots(other.m_slots), m_size(other.m_size) {}
+
+template<typename O>
+typename ObserverView<O>::iterator ObserverView<O>::begin() const
+{
+    return iterator(m_slots->data(), m_slots->data() + m_slots->size());
+}
+
+template<typename O>
+typename ObserverView<O>::iterator ObserverView<O>::end() const
+{
+    return iterator(m_slots->data() + m_slots->size(), m_slots->data() + m_slots->size());
+}
+
+template<typename O>
+std::size_t ObserverView<O>::size() const
+{
+    return m_size;
+}
+
+template<typename O>
+bool ObserverView<O>::empty() const
+{
+    return m_size == 0;
+}
+
+template<typename O>
+O* ObserverView<O>::cast(ObserverImpl *observer)
+{
+    // MUST not use reinterpret_cast
+    return static_cast<O*>(observer);
+}
+
+
+
+template<typename O>
+ObserverSnapshot<O>::iterator::iterator(const ConcurrentSubjectImpl::Subscription *const *pos): m_pos(pos) {}
+
+template<typename O>
+O* ObserverSnapshot<O>::iterator::operator*() const
+{
+    return ObserverSnapshot<O>::cast(*m_pos);
+}
+
+template<typename O>
+typename ObserverSnapshot<O>::iterator& ObserverSnapshot<O>::iterator::operator++()
+{
+    ++m_pos;
+    return *this;
+}
+
+template<typename O>
+typename ObserverSnapshot<O>::iterator ObserverSnapshot<O>::iterator::operator++(int)
+{
+    iterator it = *this;
+    ++m_pos;
+    return it;
+}
+
+template<typename O>
+bool ObserverSnapshot<O>::iterator::operator==(const iterator &other) const
+{
+    return m_pos == other.m_pos;
+}
+
+template<typename O>
+bool ObserverSnapshot<O>::iterator::operator!=(const iterator &other) const
+{
+    return m_pos != other.m_pos;
+}
+
+template<typename O>
+ObserverSnapshot<O>::ObserverSnapshot(const ConcurrentSubjectImpl *subject): m_subject(subject)
+{
+    // the snapshot stays alive until the epoch entered is exited
+    m_epoch = subject->enterRead();
+    const ConcurrentSubjectImpl::Snapshot *snapshot = subject->m_snapshot.load();
+    m_begin = snapshot->data();
+    m_end = m_begin + snapshot->size();
+}
+
+template<typename O>
+template<typename U>
+ObserverSnapshot<O>::ObserverSnapshot(ObserverSnapshot<U> &&other):
+    m_subject(other.m_subject), m_epoch(other.m_epoch), m_begin(other.m_begin), m_end(other.m_end)
+{
+    other.m_subject = nullptr;
+}
+
+template<typename O>
+ObserverSnapshot<O>::ObserverSnapshot(ObserverSnapshot &&other):
+    m_subject(other.m_subject), m_epoch(other.m_epoch), m_begin(other.m_begin), m_end(other.m_end)
+{
+    other.m_subject = nullptr;
+}
+
+template<typename O>
+ObserverSnapshot<O>::~ObserverSnapshot()
+{
+    if (m_subject)
+    {
+        m_subject->exitRead(m_epoch);                           // the snapshot may be freed from now on
+    }
+}
+
+template<typename O>
+typename ObserverSnapshot<O>::iterator ObserverSnapshot<O>::begin() const
+{
+    return iterator(m_begin);
+}
+
+template<typename O>
+typename ObserverSnapshot<O>::iterator ObserverSnapshot<O>::end() const
+{
+    return iterator(m_end);
+}
+
+template<typename O>
+std::size_t ObserverSnapshot<O>::size() const
+{
+    return static_cast<std::size_t>(m_end - m_begin);
+}
+
+template<typename O>
+bool ObserverSnapshot<O>::empty() const
+{
+    return m_begin == m_end;
+}
+
+template<typename O>
+O* ObserverSnapshot<O>::cast(const ConcurrentSubjectImpl::Subscription *subscription)
+{
+    // MUST not use reinterpret_cast
+    return static_cast<O*>(subscription->m_observer);
+}
+
+template<typename O>
+IntrusiveView<O>::iterator::iterator(ObserverImpl *pos, ObserverImpl *head): m_pos(pos), m_head(head) {}
+
+template<typename O>
+O* IntrusiveView<O>::iterator::operator*() const
+{
+    return IntrusiveView<O>::cast(m_pos);
+}
+
+template<typename O>
+typename IntrusiveView<O>::iterator& IntrusiveView<O>::iterator::operator++()
+{
+    m_pos = static_cast<IntrusiveObserverImpl*>(m_pos)->m_hook.m_next;
+    if (m_pos == m_head)
+    {
+        m_pos = nullptr;                                        // back to the first, past the last
+    }
+    return *this;
+}
+
+template<typename O>
+typename IntrusiveView<O>::iterator IntrusiveView<O>::iterator::operator++(int)
+{
+    iterator it = *this;
+    ++*this;
+    return it;
+}
+
+template<typename O>
+bool IntrusiveView<O>::iterator::operator==(const iterator &other) const
+{
+    return m_pos == other.m_pos;
+}
+
+template<typename O>
+bool IntrusiveView<O>::iterator::operator!=(const iterator &other) const
+{
+    return m_pos != other.m_pos;
+}
+
+template<typename O>
+IntrusiveView<O>::IntrusiveView(ObserverImpl *head): m_head(head) {}
+
+template<typename O>
+template<typename U>
+IntrusiveView<O>::IntrusiveView(const IntrusiveView<U> &other): m_head(other.m_head) {}
+
+template<typename O>
+typename IntrusiveView<O>::iterator IntrusiveView<O>::begin() const
+{
+    return iterator(m_head, m_head);
+}
+
+template<typename O>
+typename IntrusiveView<O>::iterator IntrusiveView<O>::end() const
+{
+    return iterator(nullptr, m_head);
+}
+
+template<typename O>
+std::size_t IntrusiveView<O>::size() const
+{
+    // not stored, the subject is only a head pointer
+    std::size_t count = 0;
+    for (auto it = begin(); it != end(); ++it)
+    {
+        ++count;
+    }
+    return count;
+}
+
+template<typename O>
+bool IntrusiveView<O>::empty() const
+{
+    return !m_head;
+}
+
+template<typename O>
+O* IntrusiveView<O>::cast(ObserverImpl *observer)
+{
+    // MUST not use reinterpret_cast
+    return static_cast<O*>(observer);
+}
+
+
+
+inline MessageMask::MessageMask(): m_bits(~std::uint64_t(0)) {}
+
+inline MessageMask::MessageMask(std::initializer_list<long> msgs): m_bits(0)
+{
+    for (auto it = msgs.begin(); it != msgs.end(); ++it)
+    {
+        m_bits |= bitOf(*it);
+        if (*it < 0 || *it >= 63)
+        {
+            m_wide.push_back(*it);
+        }
+    }
+    std::sort(m_wide.begin(), m_wide.end());
+    m_wide.erase(std::unique(m_wide.begin(), m_wide.end()), m_wide.end());
+}
+
+inline bool MessageMask::matches(long msg) const
+{
+    // bit 63 is shared by every id out of [0, 62], the sorted ids then decide, none of them unless given
+    if (!(m_bits & bitOf(msg)))
+    {
+        return false;
+    }
+    return (msg >= 0 && msg < 63) || m_wide.empty() || std::binary_search(m_wide.begin(), m_wide.end(), msg);
+}
+
+inline std::uint64_t MessageMask::bits() const
+{
+    return m_bits;
+}
+
+inline const std::vector<long>& MessageMask::wideIds() const
+{
+    return m_wide;
+}
+
+inline std::uint64_t MessageMask::bitOf(long msg)
+{
+    // ids sharing bit 63 are told apart by the ids the observer keeps, see ObserverImpl::observes
+    return std::uint64_t(1) << ((msg >= 0 && msg < 63) ? msg : 63);
+}
+
+inline MessageMask MessageMask::fromBits(std::uint64_t bits)
+{
+    MessageMask mask;
+    mask.m_bits = bits;
+    return mask;
+}
+
+
+
+inline MessageSpan::MessageSpan(): m_data(nullptr), m_size(0) {}
+
+inline MessageSpan::MessageSpan(const long *data, std::size_t size): m_data(data), m_size(size) {}
+
+inline const long* MessageSpan::begin() const
+{
+    return m_data;
+}
+
+inline const long* MessageSpan::end() const
+{
+    return m_data + m_size;
+}
+
+inline const long* MessageSpan::data() const
+{
+    return m_data;
+}
+
+inline std::size_t MessageSpan::size() const
+{
+    return m_size;
+}
+
+inline bool MessageSpan::empty() const
+{
+    return m_size == 0;
+}
+
+inline long MessageSpan::operator[](std::size_t index) const
+{
+    return m_data[index];
+}
+
+inline std::uint64_t MessageSpan::bits() const
+{
+    std::uint64_t bits = 0;
+    for (std::size_t i = 0; i < m_size; ++i)
+    {
+        bits |= MessageMask::bitOf(m_data[i]);
+    }
+    return bits;
+}
+
+
+
+inline Message::Message(long msg): m_deliver(&Message::deliverId), m_manage(nullptr)
+{
+    new (&m_payload) long(msg);
+}
+
+template<typename E, bool (*Deliver)(ObserverImpl*, const E&), typename Arg>
+Message Message::of(Arg &&event)
+{
+    return make<E, Deliver>(std::forward<Arg>(event), StoredInline<E>());
+}
+
+template<typename E, bool (*Deliver)(ObserverImpl*, const E&), typename Arg>
+Message Message::make(Arg &&event, std::true_type)
+{
+    Message message(&Message::deliverInline<E, Deliver>, &Message::manage<E>);
+    new (&message.m_payload) E(std::forward<Arg>(event));       // no heap allocation
+    return message;
+}
+
+template<typename E, bool (*Deliver)(ObserverImpl*, const E&), typename Arg>
+Message Message::make(Arg &&event, std::false_type)
+{
+    Message message(&Message::deliverShared<E, Deliver>, &Message::manage<std::shared_ptr<const E>>);
+    new (&message.m_payload) std::shared_ptr<const E>(std::make_shared<E>(std::forward<Arg>(event)));
+    return message;
+}
+
+inline Message::Message(DeliverFunc deliver, ManageFunc manage): m_deliver(deliver), m_manage(manage) {}
+
+inline Message::Message(const Message &other): m_deliver(other.m_deliver), m_manage(other.m_manage)
+{
+    assign(other);
+}
+
+inline Message::Message(Message &&other): m_deliver(other.m_deliver), m_manage(other.m_manage)
+{
+    assign(std::move(other));
+}
+
+inline Message::~Message()
+{
+    clear();
+}
+
+inline Message& Message::operator=(const Message &other)
+{
+    if (this != &other)
+    {
+        clear();
+        m_deliver = other.m_deliver;
+        m_manage = other.m_manage;
+        assign(other);
+    }
+    return *this;
+}
+
+inline Message& Message::operator=(Message &&other)
+{
+    if (this != &other)
+    {
+        clear();
+        m_deliver = other.m_deliver;
+        m_manage = other.m_manage;
+        assign(std::move(other));
+    }
+    return *this;
+}
+
+inline bool Message::deliver(ObserverImpl *observer) const
+{
+    return m_deliver(observer, &m_payload);
+}
+
+inline bool Message::sameKind(const Message &other) const
+{
+    if (m_deliver != other.m_deliver)
+    {
+        return false;                                           // different event types
+    }
+    if (m_deliver == &Message::deliverId)
+    {
+        return *reinterpret_cast<const long*>(&m_payload) == *reinterpret_cast<const long*>(&other.m_payload);
+    }
+    return true;                                                // same event type, payload may differ
+}
+
+inline std::uint64_t Message::bits() const
+{
+    if (m_deliver == &Message::deliverId)
+    {
+        return MessageMask::bitOf(*reinterpret_cast<const long*>(&m_payload));
+    }
+    return ~std::uint64_t(0);                                   // typed events are not filtered by id
+}
+
+inline void Message::assign(const Message &other)
+{
+    if (m_manage)
+    {
+        m_manage(Copy, &m_payload, const_cast<Storage*>(&other.m_payload));
+    }
+    else
+    {
+        m_payload = other.m_payload;                            // trivially copyable
+    }
+}
+
+inline void Message::assign(Message &&other)
+{
+    if (m_manage)
+    {
+        m_manage(Move, &m_payload, &other.m_payload);
+    }
+    else
+    {
+        m_payload = other.m_payload;                            // trivially copyable
+    }
+}
+
+inline void Message::clear()
+{
+    if (m_manage)
+    {
+        m_manage(Destroy, &m_payload, nullptr);
+    }
+}
+
+template<typename P>
+void Message::manage(Operation operation, void *target, void *source)
+{
+    switch (operation)
+    {
+        case Copy:
+            new (target) P(*static_cast<const P*>(source));
+            break;
+        case Move:
+            new (target) P(std::move(*static_cast<P*>(source)));
+            break;
+        case Destroy:
+            static_cast<P*>(target)->~P();
+            break;
+    }
+}
+
+template<typename E, bool (*Deliver)(ObserverImpl*, const E&)>
+bool Message::deliverInline(ObserverImpl *observer, const void *payload)
+{
+    return Deliver(observer, *static_cast<const E*>(payload));
+}
+
+template<typename E, bool (*Deliver)(ObserverImpl*, const E&)>
+bool Message::deliverShared(ObserverImpl *observer, const void *payload)
+{
+    return Deliver(observer, **static_cast<const std::shared_ptr<const E>*>(payload));
+}
+
+inline bool Message::deliverId(ObserverImpl *observer, const void *payload)
+{
+    const long msg = *static_cast<const long*>(payload);
+    return observer->observes(msg) && observer->update(msg);
+}
+
+
+
+inline MessageTap::~MessageTap() {}
+
+inline SubjectImpl::SubjectImpl()
+#ifdef OBSERVERPATTERN_JOURNAL
+    : m_journalId(0)
+#endif
+{
+#ifdef OBSERVERPATTERN_INSTRUMENTATION
+    m_statsTable.store(nullptr, std::memory_order_relaxed);
+#endif
+}
+
+inline SubjectImpl::~SubjectImpl()
+{
+#ifdef OBSERVERPATTERN_INSTRUMENTATION
+    delete m_statsTable.load();                                 // the store detached its observers, entries still claimed go with the table
+#endif
+}
+
+inline bool SubjectImpl::addObserver(ObserverImpl *observer, MessageMask messages, int priority)
+{
+    if (!observer)
+    {
+        return false;                                           // nullptr, invalid argument
+    }
+
+    return observer->startObserve(this, messages, priority);              // attach via observer, which also stops observing the previous subject
+}
+
+inline bool SubjectImpl::removeObserver(ObserverImpl *observer)
+{
+    if (!observer)
+    {
+        return false;                                           // nullptr, invalid argument
+    }
+
+    return observer->stopObserve(this);                         // detach via observer, which also uninitializes
+}
+
+inline std::size_t SubjectImpl::addObservers(ObserverImpl *const *observers, std::size_t count, MessageMask messages, int priority,
+                                             ObserverInit init)
+{
+    if (!observers)
+    {
+        return 0;                                               // nullptr, invalid argument
+    }
+
+    std::vector<Subscribed> added;
+    added.reserve(count);
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        const Subscribed subscribed = { observers[i], messages.bits(), priority };
+        added.push_back(subscribed);
+    }
+    return addAll(added, init, messages);
+}
+
+inline std::size_t SubjectImpl::initObservers()
+{
+    std::vector<Subscribed> observers;
+    subscriptions(observers);
+    std::size_t initialized = 0;
+    for (auto it = observers.begin(); it != observers.end(); ++it)
+    {
+        ObserverImpl *observer = it->m_observer;
+        if (observer->m_subject == this && observer->m_initPending)
+        {
+            observer->m_initPending = false;
+            observer->init();                                   // may stop observing others, they are checked again
+            ++initialized;
+        }
+    }
+    return initialized;
+}
+
+inline void SubjectImpl::attachAll(const Subscribed *observers, std::size_t count)
+{
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        if (!attach(observers[i].m_observer, MessageMask::fromBits(observers[i].m_messages)))
+        {
+            observers[i].m_observer->m_subject = nullptr;       // rejected by the subject
+        }
+    }
+}
+
+inline std::size_t SubjectImpl::addAll(std::vector<Subscribed> &observers, ObserverInit init, const MessageMask &messages)
+{
+    // the check of startObserve, an observer observes one subject, so no search of the stored observers is needed
+    std::size_t count = 0;
+    for (auto it = observers.begin(); it != observers.end(); ++it)
+    {
+        ObserverImpl *observer = it->m_observer;
+        if (!observer || observer->m_subject == this)
+        {
+            continue;                                           // nullptr, already observing or given twice
+        }
+        if (observer->m_subject)
+        {
+            observer->stopObserve(observer->m_subject);         // stop observing the subject if any
+        }
+        // order matters, assignment MUST occurs before attach, as in startObserve
+        observer->m_subject = this;
+        observer->m_priority = it->m_priority;
+        observer->observeWide(messages);
+        observers[count++] = *it;
+    }
+    observers.resize(count);
+
+    attachAll(observers.data(), count);
+    std::size_t added = 0;
+    for (auto it = observers.begin(); it != observers.end(); ++it)
+    {
+        ObserverImpl *observer = it->m_observer;
+        if (observer->m_subject != this)
+        {
+            if (!observer->m_subject)
+            {
+                observer->m_wide.reset();                       // rejected, stopped ones already dropped theirs
+            }
+            continue;                                           // rejected, or stopped by the init of another
+        }
+        ++added;
+        if (init == ObserverInit::Deferred)
+        {
+            observer->m_initPending = true;
+        }
+        else
+        {
+            observer->init();                                   // after all are attached
+        }
+    }
+    return added;
+}
+
+inline std::size_t SubjectImpl::slotOf(const ObserverImpl *observer)
+{
+    return observer->m_slot;
+}
+
+inline void SubjectImpl::setSlot(ObserverImpl *observer, std::size_t slot)
+{
+    observer->m_slot = static_cast<std::uint32_t>(slot);        // 31 bits, next to m_initPending
+}
+
+inline ObserverHook& SubjectImpl::hookOf(ObserverImpl *observer)
+{
+    // MUST not use reinterpret_cast
+    return static_cast<IntrusiveObserverImpl*>(observer)->m_hook;
+}
+
+inline int SubjectImpl::priorityOf(const ObserverImpl *observer)
+{
+    return observer->m_priority;
+}
+
+inline bool SubjectImpl::threadSafeOf(const ObserverImpl *observer)
+{
+    return observer->threadSafeUpdate();
+}
+
+inline bool SubjectImpl::updateOf(ObserverImpl *observer, long msg)
+{
+    return observer->observes(msg) && observer->update(msg);   // not observed, not consumed either
+}
+
+inline bool SubjectImpl::observesOf(const ObserverImpl *observer, long msg)
+{
+    return observer->observes(msg);
+}
+
+inline bool SubjectImpl::updateBatchOf(ObserverImpl *observer, std::uint64_t messages, MessageSpan msgs, std::uint64_t bits)
+{
+    if ((messages & bits) == bits && !observer->m_wide)
+    {
+        return observer->updateBatch(msgs);                     // observes every message of the batch, no copy
+    }
+    // local rather than shared scratch, updateBatch may notify a batch again
+    std::vector<long> matching;
+    matching.reserve(msgs.size());
+    for (auto it = msgs.begin(); it != msgs.end(); ++it)
+    {
+        if ((messages & MessageMask::bitOf(*it)) && observer->observes(*it))
+        {
+            matching.push_back(*it);
+        }
+    }
+    return observer->updateBatch(MessageSpan(matching.data(), matching.size()));
+}
+
+#ifdef OBSERVERPATTERN_INSTRUMENTATION
+inline ObserverStats* SubjectImpl::statsOf(ObserverImpl *observer) const
+{
+    if (!observer->m_stats)
+    {
+        observer->m_stats = statsTable().claim(observer);       // only observers that got an update cost an entry
+    }
+    return observer->m_stats;
+}
+
+inline void SubjectImpl::releaseStats(ObserverImpl *observer) const
+{
+    if (StatsTable *table = m_statsTable.load(std::memory_order_acquire))
+    {
+        table->release(observer->m_stats);                      // counters are per subject observed
+    }
+    observer->m_stats = nullptr;
+}
+
+inline StatsTable& SubjectImpl::statsTable() const
+{
+    StatsTable *table = m_statsTable.load(std::memory_order_acquire);
+    if (!table)
+    {
+        // first notify, several threads of a concurrent subject may race, one table is kept
+        StatsTable *created = new StatsTable;
+        if (m_statsTable.compare_exchange_strong(table, created, std::memory_order_acq_rel))
+        {
+            table = created;
+        }
+        else
+        {
+            delete created;
+        }
+    }
+    return *table;
+}
+
+inline SubjectStats& SubjectImpl::stats() const
+{
+    return statsTable().subject();
+}
+
+inline SubjectStatsSnapshot SubjectImpl::getStats() const
+{
+    StatsTable *table = m_statsTable.load(std::memory_order_acquire);
+    return table ? table->snapshot() : SubjectStatsSnapshot();  // value-initialized, all zero before the first notify
+}
+#endif
+
+#ifdef OBSERVERPATTERN_JOURNAL
+inline void SubjectImpl::setJournalId(std::uint32_t id)
+{
+    m_journalId = id;
+}
+
+inline std::uint32_t SubjectImpl::getJournalId() const
+{
+    return m_journalId;
+}
+#endif
+
+
+
+inline PropagationEngine::PropagationEngine(unsigned maxDepth, std::size_t maxUpdates):
+    m_maxDepth(maxDepth), m_maxUpdates(maxUpdates), m_depth(0)
+{
+    m_stats = Stats();
+}
+
+template<typename F>
+void PropagationEngine::run(F func)
+{
+    if (running())
+    {
+        func();                                                 // nested, joins the propagation running
+        return;
+    }
+
+    struct RunGuard                                             // leave engine even if func or update throws
+    {
+        PropagationEngine *m_engine;
+        ~RunGuard()
+        {
+            running() = nullptr;
+            m_engine->m_queue.clear();
+        }
+    } runGuard = { this };
+
+    running() = this;
+    m_stats = Stats();
+    m_visited.clear();                                          // keeps buckets, no allocation after warm-up
+    m_depth = 0;
+    func();
+    drain();
+}
+
+inline const PropagationEngine::Stats& PropagationEngine::getStats() const
+{
+    return m_stats;
+}
+
+inline PropagationEngine* PropagationEngine::current()
+{
+    return running();
+}
+
+inline std::size_t PropagationEngine::KeyHash::operator()(const std::pair<const SerialSubjectImpl*, long> &key) const
+{
+    return std::hash<const void*>()(key.first) ^ (std::hash<long>()(key.second) * 0x9e3779b97f4a7c15ULL);
+}
+
+inline void PropagationEngine::post(const SerialSubjectImpl *subject, long msg)
+{
+    if (!m_visited.insert(std::make_pair(subject, msg)).second)
+    {
+        ++m_stats.m_revisits;                                   // cycle, or diamond, already notified in this run
+        return;
+    }
+
+    Item item = { subject, msg, m_depth + 1 };
+    m_queue.push_back(item);
+}
+
+inline void PropagationEngine::forget(const SerialSubjectImpl *subject)
+{
+    m_queue.erase(std::remove_if(m_queue.begin(), m_queue.end(),
+                                 [subject](const Item &item) { return item.m_subject == subject; }),
+                  m_queue.end());
+}
+
+inline void PropagationEngine::drain()
+{
+    while (!m_queue.empty())
+    {
+        const Item item = m_queue.front();
+        m_queue.pop_front();
+        if (item.m_depth > m_maxDepth || m_stats.m_updates >= m_maxUpdates)
+        {
+            ++m_stats.m_pruned;                                 // over budget
+            continue;
+        }
+
+        m_depth = item.m_depth;
+        if (m_depth > m_stats.m_depth)
+        {
+            m_stats.m_depth = m_depth;
+        }
+        ++m_stats.m_notified;
+        item.m_subject->propagate(item.m_msg, *this);           // update may post further pairs
+    }
+}
+
+inline PropagationEngine*& PropagationEngine::running()
+{
+    static thread_local PropagationEngine *engine = nullptr;
+    return engine;
+}
+
+
+
+inline NotifyBatch::NotifyBatch(SerialSubjectImpl *subject, BatchMerge merge): m_subject(subject)
+{
+    std::unique_ptr<SerialSubjectImpl::BatchState> &batch = m_subject->m_batch;
+    if (!batch)
+    {
+        batch.reset(new SerialSubjectImpl::BatchState{ 0, merge, std::vector<Message>() });
+    }
+    if (batch->m_depth++ == 0)
+    {
+        batch->m_merge = merge;                                 // nested batches follow the outermost one
+    }
+}
+
+inline NotifyBatch::NotifyBatch(NotifyBatch &&other): m_subject(other.m_subject)
+{
+    other.m_subject = nullptr;
+}
+
+inline NotifyBatch::~NotifyBatch()
+{
+    if (m_subject)
+    {
+        m_subject->endBatch();
+    }
+}
+
+
+
+inline SerialSubjectImpl::SerialSubjectImpl(): m_removed(0), m_notifying(0), m_unsorted(false) {}
+
+inline SerialSubjectImpl::~SerialSubjectImpl()
+{
+    // MUST be done here rather than in SubjectImpl, where detach is pure virtual
+    while (!m_observers.empty())
+    {
+        if (!m_observers.back())
+        {
+            m_observers.pop_back();                             // drop removed slot
+            m_messages.pop_back();
+            --m_removed;
+            continue;
+        }
+        removeObserver(m_observers.back());                     // remove observers in reverse order
+    }
+
+    if (PropagationEngine *engine = PropagationEngine::current())
+    {
+        engine->forget(this);                                   // no notify of a destroyed subject
+    }
+}
+
+inline bool SerialSubjectImpl::attach(ObserverImpl *observer, MessageMask messages)
+{
+    if (hasObserver(observer))
+    {
+        return false;                                           // already in the list of observers
+    }
+
+    // after all observers of higher or equal priority, O(1) when priorities are equal
+    const int priority = priorityOf(observer);
+    std::size_t slot = m_observers.size();
+    while (slot && (!m_observers[slot - 1] || priorityOf(m_observers[slot - 1]) < priority))
+    {
+        --slot;
+    }
+    if (slot == m_observers.size() || m_notifying)
+    {
+        // indices MUST stay stable during notify, sorted when the outermost notify ends
+        m_unsorted = m_unsorted || slot != m_observers.size();
+        setSlot(observer, m_observers.size());
+        m_observers.push_back(observer);
+        m_messages.push_back(messages.bits());
+        return true;
+    }
+    m_observers.insert(m_observers.begin() + slot, observer);
+    m_messages.insert(m_messages.begin() + slot, messages.bits());
+    for (std::size_t i = slot; i < m_observers.size(); ++i)
+    {
+        if (m_observers[i])
+        {
+            setSlot(m_observers[i], i);                         // shifted by one
+        }
+    }
+    return true;
+}
+
+inline bool SerialSubjectImpl::detach(ObserverImpl *observer)
+{
+    if (!hasObserver(observer))
+    {
+        return false;                                           // not in the list of observers
+    }
+
+#ifdef OBSERVERPATTERN_INSTRUMENTATION
+    releaseStats(observer);                                     // an update in progress is not recorded, its slot is gone
+#endif
+    const std::size_t slot = slotOf(observer);
+    if (slot + 1 == m_observers.size() && !m_notifying)
+    {
+        m_observers.pop_back();                                 // last slot, no tombstone needed
+        m_messages.pop_back();
+    }
+    else
+    {
+        m_observers[slot] = nullptr;                            // tombstone, keeps indices stable during notify
+        m_messages[slot] = 0;                                   // skipped by notify without touching the observer
+        ++m_removed;
+    }
+    setSlot(observer, NoSlot);
+
+    if (m_removed > m_observers.size() / 2 && !m_notifying)
+    {
+        compact();                                              // amortized O(1)
+    }
+    return true;
+}
+
+inline void SerialSubjectImpl::attachAll(const Subscribed *observers, std::size_t count)
+{
+    if (m_notifying)
+    {
+        SubjectImpl::attachAll(observers, count);               // appended one by one, sorted when the outermost notify ends
+        return;
+    }
+
+    // appended in one pass and sorted once, rather than one insert each
+    m_observers.reserve(m_observers.size() + count);
+    m_messages.reserve(m_messages.size() + count);
+    const ObserverImpl *last = nullptr;
+    for (auto it = m_observers.rbegin(); it != m_observers.rend() && !last; ++it)
+    {
+        last = *it;                                             // last one stored, removed slots skipped
+    }
+    bool unsorted = false;
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        ObserverImpl *observer = observers[i].m_observer;
+        unsorted = unsorted || (last && priorityOf(last) < priorityOf(observer));
+        setSlot(observer, m_observers.size());
+        m_observers.push_back(observer);
+        m_messages.push_back(observers[i].m_messages);
+        last = observer;
+    }
+    if (unsorted)
+    {
+        sort();
+    }
+}
+
+inline void SerialSubjectImpl::subscriptions(std::vector<Subscribed> &observers) const
+{
+    for (std::size_t i = 0; i < m_observers.size(); ++i)
+    {
+        if (m_observers[i])
+        {
+            const Subscribed subscribed = { m_observers[i], m_messages[i], priorityOf(m_observers[i]) };
+            observers.push_back(subscribed);
+        }
+    }
+}
+
+inline ObserverView<ObserverImpl> SerialSubjectImpl::getObservers() const
+{
+    return ObserverView<ObserverImpl>(m_observers, m_observers.size() - m_removed);
+}
+
+inline NotifyBatch SerialSubjectImpl::beginBatch(BatchMerge merge)
+{
+    return NotifyBatch(this, merge);
+}
+
+inline void SerialSubjectImpl::notify(long msg) const
+{
+#ifdef OBSERVERPATTERN_JOURNAL
+    JournalEntry journal(getJournalId(), msg);                  // recorded when notify returns
+#endif
+    if (batching())
+    {
+        defer(Message(msg));
+        return;
+    }
+    if (PropagationEngine *engine = PropagationEngine::current())
+    {
+        engine->post(this, msg);                                // no recursion, the engine notifies later
+        return;
+    }
+    notifyWith([msg](ObserverImpl *observer) { return updateOf(observer, msg); }, MessageMask::bitOf(msg));
+}
+
+inline void SerialSubjectImpl::notifyBatch(MessageSpan msgs) const
+{
+    if (batching() || PropagationEngine::current())
+    {
+        for (auto it = msgs.begin(); it != msgs.end(); ++it)
+        {
+            notify(*it);                                        // merged or queued one by one, as if notified alone
+        }
+        return;
+    }
+#ifdef OBSERVERPATTERN_JOURNAL
+    for (auto it = msgs.begin(); it != msgs.end(); ++it)
+    {
+        JournalEntry journal(getJournalId(), *it);              // recorded one by one, fan-out unknown, replayed as notify
+    }
+#endif
+    const std::uint64_t bits = msgs.bits();
+    notifyWith([this, msgs, bits](ObserverImpl *observer)
+    {
+        return updateBatchOf(observer, m_messages[slotOf(observer)], msgs, bits);
+    }, bits);
+}
+
+template<typename E, bool (*Deliver)(ObserverImpl*, const E&)>
+void SerialSubjectImpl::notifyEvent(const E &event) const
+{
+    if (batching())
+    {
+        defer(Message::of<E, Deliver>(event));                  // copied, the reference may not outlive the batch
+        return;
+    }
+    // no copy, every observer gets the same reference
+    notifyWith([&event](ObserverImpl *observer) { return Deliver(observer, event); });
+}
+
+inline bool SerialSubjectImpl::notifyUntilConsumed(long msg) const
+{
+    // neither deferred by a batch nor posted to an engine, the caller needs the result now
+    return notifyWith([msg](ObserverImpl *observer) { return updateOf(observer, msg); }, MessageMask::bitOf(msg), true);
+}
+
+template<typename E, bool (*Deliver)(ObserverImpl*, const E&)>
+bool SerialSubjectImpl::notifyEventUntilConsumed(const E &event) const
+{
+    return notifyWith([&event](ObserverImpl *observer) { return Deliver(observer, event); }, ~std::uint64_t(0), true);
+}
+
+template<typename F>
+bool SerialSubjectImpl::notifyWith(F deliver, std::uint64_t bits, bool consumable) const
+{
+    ++m_notifying;
+#ifdef OBSERVERPATTERN_INSTRUMENTATION
+    NotifyProbe probe(stats());
+#endif
+#ifdef OBSERVERPATTERN_JOURNAL
+    JournalEntry *journal = JournalEntry::claim();              // nullptr unless invoked by notify(msg)
+    std::uint32_t fanOut = 0;
+#endif
+    // observers added during notify are not notified until next time
+    const std::size_t size = m_observers.size();
+    bool consumed = false;
+    for (std::size_t i = 0; i < size && !consumed; ++i)
+    {
+        // masks are scanned contiguously, observers not interested are never touched
+        if (m_messages[i] & bits)
+        {
+#ifdef OBSERVERPATTERN_JOURNAL
+            ++fanOut;
+#endif
+#ifdef OBSERVERPATTERN_INSTRUMENTATION
+            probe.delivered();
+            ObserverImpl *observer = m_observers[i];
+            auto attached = [this, i, observer]() { return m_observers[i] == observer ? statsOf(observer) : nullptr; }; // tombstone once detached
+            consumed = Instrumentation::update(this, observer, deliver, attached) && consumable;
+#else
+            consumed = deliver(m_observers[i]) && consumable;   // notify observers in priority, then observing order
+#endif
+        }
+    }
+#ifdef OBSERVERPATTERN_JOURNAL
+    if (journal)
+    {
+        journal->delivered(fanOut);
+    }
+#endif
+    if (!--m_notifying && m_unsorted)
+    {
+        // reorders slots only, the set of observers is unchanged
+        const_cast<SerialSubjectImpl*>(this)->sort();
+    }
+    return consumed;
+}
+
+inline bool SerialSubjectImpl::hasObserver(ObserverImpl *observer) const
+{
+    const std::size_t slot = slotOf(observer);
+    return slot < m_observers.size() && m_observers[slot] == observer;
+}
+
+inline void SerialSubjectImpl::defer(Message message) const
+{
+    std::vector<Message> &deferred = m_batch->m_deferred;
+    if (m_batch->m_merge != BatchMerge::KeepAll)
+    {
+        for (auto it = deferred.begin(); it != deferred.end(); ++it)
+        {
+            if (!it->sameKind(message))
+            {
+                continue;
+            }
+            if (m_batch->m_merge == BatchMerge::KeepFirst)
+            {
+                return;                                         // first one stays
+            }
+            deferred.erase(it);                                 // last one moves to the end
+            break;
+        }
+    }
+    deferred.push_back(std::move(message));
+}
+
+inline void SerialSubjectImpl::endBatch()
+{
+    if (--m_batch->m_depth)
+    {
+        return;                                                 // nested, outermost batch delivers
+    }
+
+    std::vector<Message> messages;
+    messages.swap(m_batch->m_deferred);
+    for (auto it = messages.begin(); it != messages.end(); ++it)
+    {
+        const Message &message = *it;
+        notifyWith([&message](ObserverImpl *observer) { return message.deliver(observer); }, message.bits());
+    }
+}
+
+inline bool SerialSubjectImpl::batching() const
+{
+    return m_batch && m_batch->m_depth;
+}
+
+inline void SerialSubjectImpl::propagate(long msg, PropagationEngine &engine) const
+{
+    notifyWith([msg, &engine](ObserverImpl *observer)
+    {
+        ++engine.m_stats.m_updates;
+        return updateOf(observer, msg);
+    }, MessageMask::bitOf(msg));
+}
+
+inline void SerialSubjectImpl::compact()
+{
+    std::size_t count = 0;
+    for (std::size_t i = 0; i < m_observers.size(); ++i)
+    {
+        if (m_observers[i])
+        {
+            m_observers[count] = m_observers[i];
+            m_messages[count] = m_messages[i];
+            setSlot(m_observers[count], count);                 // keep observing order
+            ++count;
+        }
+    }
+    m_observers.resize(count);
+    m_messages.resize(count);
+    m_removed = 0;
+}
+
+inline void SerialSubjectImpl::sort()
+{
+    compact();
+    std::vector<std::pair<ObserverImpl*, std::uint64_t>> slots(m_observers.size());
+    for (std::size_t i = 0; i < slots.size(); ++i)
+    {
+        slots[i] = std::make_pair(m_observers[i], m_messages[i]);
+    }
+    // stable, observing order is kept among equal priorities
+    std::stable_sort(slots.begin(), slots.end(), [](const std::pair<ObserverImpl*, std::uint64_t> &a, const std::pair<ObserverImpl*, std::uint64_t> &b)
+    {
+        return priorityOf(a.first) > priorityOf(b.first);
+    });
+    for (std::size_t i = 0; i < slots.size(); ++i)
+    {
+        m_observers[i] = slots[i].first;
+        m_messages[i] = slots[i].second;
+        setSlot(m_observers[i], i);
+    }
+    m_unsorted = false;
+}
+
+
+
+inline ConcurrentSubjectImpl::Subscription::Subscription(ObserverImpl *observer, MessageMask messages, MemoryResource *resource):
+    m_observer(observer), m_resource(resource), m_messages(messages.bits()), m_threadSafe(threadSafeOf(observer)),
+    m_active(true), m_dispatching(0), m_scheduled(false)
+{
+#ifdef OBSERVERPATTERN_INSTRUMENTATION
+    m_stats.store(nullptr, std::memory_order_relaxed);
+#endif
+}
+
+inline ConcurrentSubjectImpl::Snapshot::Snapshot(MemoryResource *resource):
+    std::vector<Subscription*, ResourceAllocator<Subscription*>>(ResourceAllocator<Subscription*>(resource)), m_readers(0) {}
+
+inline ConcurrentSubjectImpl::FrameGuard::FrameGuard(const ConcurrentSubjectImpl *subject, const Snapshot *snapshot, NotifyFrame *prev)
+{
+    m_frame.m_subject = subject;
+    m_frame.m_snapshot = snapshot;
+    m_frame.m_current = nullptr;
+    m_frame.m_prev = prev;
+    if (snapshot)
+    {
+        snapshot->m_readers.fetch_add(1);                       // order matters, counted before the frame can be seen
+    }
+    notifyFrames() = &m_frame;
+}
+
+inline ConcurrentSubjectImpl::FrameGuard::~FrameGuard()
+{
+    notifyFrames() = m_frame.m_prev;                            // a chunk of notifyParallel restores the frames of its thread below
+    if (m_frame.m_snapshot)
+    {
+        m_frame.m_snapshot->m_readers.fetch_sub(1);
+        m_frame.m_subject->left();
+    }
+}
+
+inline ConcurrentSubjectImpl::ConcurrentSubjectImpl():
+    m_snapshot(nullptr), m_epoch(0), m_detaching(0), m_resource(&NodePool::instance()), m_executor(nullptr), m_grain(1024), m_threshold(8192),
+    m_asyncScheduled(false), m_asyncPending(0)
+{
+    m_readers[0] = 0;
+    m_readers[1] = 0;
+    m_snapshot.store(createSnapshot(0));
+}
+
+inline ConcurrentSubjectImpl::~ConcurrentSubjectImpl()
+{
+    // MUST be done here rather than in SubjectImpl, where detach is pure virtual,
+    // one publish unlinks all observers rather than one copy of the snapshot per observer
+    std::vector<Subscription*> unlinked;
+    std::vector<ObserverImpl*> stopping;
+    for (;;)
+    {
+        const std::size_t first = unlinked.size();
+        {
+            std::unique_lock<std::mutex> lock(m_writer);
+            const Snapshot *snapshot = m_snapshot.load();
+            if (snapshot->empty())
+            {
+                break;
+            }
+            unlinked.insert(unlinked.end(), snapshot->begin(), snapshot->end());
+            m_unlinked.assign(snapshot->begin(), snapshot->end());
+            for (auto it = unlinked.begin() + first; it != unlinked.end(); ++it)
+            {
+                (*it)->m_active.store(false);
+            }
+            publish(createSnapshot(0), nullptr);
+            for (auto it = unlinked.begin() + first; it != unlinked.end(); ++it)
+            {
+                awaitQuiescent(lock, *it);                      // as in detach
+            }
+            // no update of them runs any more, one that stopped observing meanwhile, e.g. in its update, may be gone already
+            stopping.clear();
+            for (auto it = m_unlinked.begin(); it != m_unlinked.end(); ++it)
+            {
+                if (*it)
+                {
+                    stopping.push_back((*it)->m_observer);
+                }
+            }
+            m_unlinked.clear();
+        }
+        // in reverse order, uninit and detached as by removeObserver, detach no longer finds them,
+        // observers added meanwhile by uninit are unlinked in the next round
+        for (std::size_t i = stopping.size(); i > 0; --i)
+        {
+            stopping[i - 1]->stopObserve(this);                 // nothing if already switching away
+        }
+    }
+    waitAsync();                                                // tasks of notifyAsync refer to this, an exception not taken by flush is dropped
+    for (auto it = unlinked.begin(); it != unlinked.end(); ++it)
+    {
+        destroy(*it);                                           // a pending task of notifyAsync may still have skipped it
+    }
+
+    // no reader is left once the subject is being destroyed
+    for (auto it = m_retired.begin(); it != m_retired.end(); ++it)
+    {
+        destroy(it->m_snapshot);
+        destroy(it->m_removed);
+    }
+    destroy(m_snapshot.load());
+}
+
+inline ObserverSnapshot<ObserverImpl> ConcurrentSubjectImpl::getObservers() const
+{
+    return ObserverSnapshot<ObserverImpl>(this);
+}
+
+inline void ConcurrentSubjectImpl::setMemoryResource(MemoryResource *resource)
+{
+    // existing subscriptions and snapshots go back to the resource they came from,
+    // every resource ever set MUST outlive this subject
+    std::lock_guard<std::mutex> lock(m_writer);
+    m_resource = resource ? resource : &NodePool::instance();
+}
+
+inline void ConcurrentSubjectImpl::setExecutor(Executor *executor)
+{
+    m_executor = executor;                                      // MUST be set before any notifyAsync
+}
+
+inline void ConcurrentSubjectImpl::setParallelism(std::size_t grain, std::size_t threshold)
+{
+    m_grain = grain ? grain : 1;                                // MUST be set before any notifyParallel
+    m_threshold = threshold;
+}
+
+inline void ConcurrentSubjectImpl::flush() const
+{
+    waitAsync();
+    std::exception_ptr error;
+    {
+        std::lock_guard<std::mutex> lock(m_flushLock);
+        error.swap(m_asyncError);
+    }
+    if (error)
+    {
+        std::rethrow_exception(error);                          // once, a later flush rethrows only a later one
+    }
+}
+
+inline void ConcurrentSubjectImpl::waitAsync() const
+{
+    // MUST not be invoked from an update of this subject running on the executor
+    std::unique_lock<std::mutex> lock(m_flushLock);
+    m_flushed.wait(lock, [this] { return m_asyncPending.load() == 0; });
+}
+
+inline void ConcurrentSubjectImpl::notify(long msg) const
+{
+#ifdef OBSERVERPATTERN_JOURNAL
+    JournalEntry journal(getJournalId(), msg);                  // recorded when notify returns
+#endif
+    notifyWith([msg](ObserverImpl *observer) { return updateOf(observer, msg); }, MessageMask::bitOf(msg));
+}
+
+inline void ConcurrentSubjectImpl::notifyBatch(MessageSpan msgs) const
+{
+#ifdef OBSERVERPATTERN_JOURNAL
+    for (auto it = msgs.begin(); it != msgs.end(); ++it)
+    {
+        JournalEntry journal(getJournalId(), *it);              // recorded one by one, fan-out unknown, replayed as notify
+    }
+#endif
+    const std::uint64_t bits = msgs.bits();
+    notifyWith([msgs, bits](ObserverImpl *observer)
+    {
+        // the mask lives in the subscription being dispatched, not in the observer
+        return updateBatchOf(observer, notifyFrames()->m_current->m_messages, msgs, bits);
+    }, bits);
+}
+
+template<typename E, bool (*Deliver)(ObserverImpl*, const E&)>
+void ConcurrentSubjectImpl::notifyEvent(const E &event) const
+{
+    // no copy, every observer gets the same reference
+    notifyWith([&event](ObserverImpl *observer) { return Deliver(observer, event); });
+}
+
+inline bool ConcurrentSubjectImpl::notifyUntilConsumed(long msg) const
+{
+    return notifyWith([msg](ObserverImpl *observer) { return updateOf(observer, msg); }, MessageMask::bitOf(msg), true);
+}
+
+template<typename E, bool (*Deliver)(ObserverImpl*, const E&)>
+bool ConcurrentSubjectImpl::notifyEventUntilConsumed(const E &event) const
+{
+    return notifyWith([&event](ObserverImpl *observer) { return Deliver(observer, event); }, ~std::uint64_t(0), true);
+}
+
+template<typename F>
+bool ConcurrentSubjectImpl::notifyWith(F deliver, std::uint64_t bits, bool consumable) const
+{
+    struct ReadGuard                                            // exit epoch even if update throws
+    {
+        const ConcurrentSubjectImpl *m_subject;
+        unsigned m_epoch;
+        ~ReadGuard() { m_subject->exitRead(m_epoch); }
+    } readGuard = { this, enterRead() };
+
+    return notifySnapshot(m_snapshot.load(), deliver, bits, consumable);
+}
+
+template<typename F>
+bool ConcurrentSubjectImpl::notifySnapshot(const Snapshot *snapshot, F &deliver, std::uint64_t bits, bool consumable) const
+{
+#ifdef OBSERVERPATTERN_INSTRUMENTATION
+    NotifyProbe probe(stats());
+#endif
+#ifdef OBSERVERPATTERN_JOURNAL
+    JournalEntry *journal = JournalEntry::claim();              // nullptr unless invoked by notify(msg)
+    std::uint32_t fanOut = 0;
+#endif
+    // only the snapshot is read per update, detach on another thread waits for this notify to end instead,
+    // m_active shares the cache line of m_messages, it is seen cleared by a detach of this thread
+    // or of a thread this one waited for in detach
+    FrameGuard guard(this, snapshot, notifyFrames());
+    bool consumed = false;
+    for (auto it = snapshot->begin(); it != snapshot->end() && !consumed; ++it)
+    {
+        Subscription *subscription = *it;
+        if ((subscription->m_messages & bits) && subscription->m_active.load(std::memory_order_relaxed))
+        {
+#ifdef OBSERVERPATTERN_JOURNAL
+            ++fanOut;
+#endif
+#ifdef OBSERVERPATTERN_INSTRUMENTATION
+            probe.delivered();
+#endif
+            guard.m_frame.m_current = subscription;
+            consumed = dispatch(subscription, deliver) && consumable; // notify observers in priority, then observing order
+        }
+    }
+#ifdef OBSERVERPATTERN_JOURNAL
+    if (journal)
+    {
+        journal->delivered(fanOut);
+    }
+#endif
+    return consumed;
+}
+
+inline void ConcurrentSubjectImpl::notifyAsync(Message message) const
+{
+    // constant time, fan-out runs on the executor, one task at a time per subject
+    bool schedule = false;
+    {
+        std::lock_guard<std::mutex> lock(m_asyncLock);
+        m_asyncQueue.push_back(std::move(message));
+        m_asyncPending.fetch_add(1);
+        if (!m_asyncScheduled)
+        {
+            m_asyncScheduled = schedule = true;
+            m_asyncPending.fetch_add(1);                        // the task itself
+        }
+    }
+    if (schedule)
+    {
+        executor().execute([this] { fanOut(); });
+    }
+}
+
+inline void ConcurrentSubjectImpl::notifyParallel(long msg) const
+{
+#ifdef OBSERVERPATTERN_JOURNAL
+    JournalEntry journal(getJournalId(), msg);                  // recorded when notify returns
+#endif
+    notifyParallelWith([msg](ObserverImpl *observer) { return updateOf(observer, msg); }, MessageMask::bitOf(msg));
+}
+
+template<typename E, bool (*Deliver)(ObserverImpl*, const E&)>
+void ConcurrentSubjectImpl::notifyEventParallel(const E &event) const
+{
+    // no copy, every chunk gets the same reference, valid until all chunks are done
+    notifyParallelWith([&event](ObserverImpl *observer) { return Deliver(observer, event); });
+}
+
+template<typename F>
+void ConcurrentSubjectImpl::notifyParallelWith(F deliver, std::uint64_t bits) const
+{
+    struct ReadGuard                                            // exit epoch even if update throws
+    {
+        const ConcurrentSubjectImpl *m_subject;
+        unsigned m_epoch;
+        ~ReadGuard() { m_subject->exitRead(m_epoch); }
+    } readGuard = { this, enterRead() };
+
+    const Snapshot *snapshot = m_snapshot.load();
+    const std::size_t size = snapshot->size();
+    if (size < m_threshold || size <= m_grain)
+    {
+        notifySnapshot(snapshot, deliver, bits, false);         // small fan-out, no task, no allocation
+        return;
+    }
+
+    struct Fork                                                 // shared with helper tasks, which may start after notify returns
+    {
+        std::atomic<std::size_t> m_next;                        // next chunk to claim
+        std::size_t m_chunks;                                   // number of chunks
+        std::atomic<std::size_t> m_done;                        // chunks finished
+        std::mutex m_lock;                                      // guard m_error, pair with m_finished
+        std::condition_variable m_finished;                     // m_done reached m_chunks
+        std::exception_ptr m_error;                             // first exception thrown by update
+        NotifyFrame *m_frames;                                  // frames of the notifying thread, enclosing every chunk
+#if defined(OBSERVERPATTERN_INSTRUMENTATION) || defined(OBSERVERPATTERN_JOURNAL)
+        std::atomic<std::uint64_t> m_delivered;                 // fan-out of all chunks
+#endif
+    };
+    std::shared_ptr<Fork> fork = std::make_shared<Fork>();
+    fork->m_next = 0;
+    fork->m_chunks = (size + m_grain - 1) / m_grain;
+    fork->m_done = 0;
+    fork->m_frames = notifyFrames();
+#ifdef OBSERVERPATTERN_INSTRUMENTATION
+    NotifyProbe probe(stats());
+#endif
+#if defined(OBSERVERPATTERN_INSTRUMENTATION) || defined(OBSERVERPATTERN_JOURNAL)
+    fork->m_delivered = 0;
+#endif
+#ifdef OBSERVERPATTERN_JOURNAL
+    JournalEntry *journal = JournalEntry::claim();              // nullptr unless invoked by notify(msg)
+#endif
+
+
+    // chunks are claimed one at a time by the caller and the helpers, so a slow chunk never holds up the others,
+    // a helper starting after all chunks are claimed touches nothing but fork
+    const std::size_t grain = m_grain;
+    F *work = &deliver;
+    std::function<void()> help = [this, fork, snapshot, work, bits, grain]()
+    {
+        for (std::size_t chunk = fork->m_next.fetch_add(1); chunk < fork->m_chunks; chunk = fork->m_next.fetch_add(1))
+        {
+            const std::size_t begin = chunk * grain;
+            const std::size_t end = std::min(begin + grain, snapshot->size());
+            std::uint64_t delivered = 0;
+            {
+                // a chunk is one more reader of snapshot, part of the notify of the notifying thread,
+                // its frame MUST be popped before the chunk is counted done, snapshot may be freed then
+                FrameGuard guard(this, snapshot, fork->m_frames);
+                try
+                {
+                    for (std::size_t i = begin; i < end; ++i)
+                    {
+                        Subscription *subscription = (*snapshot)[i];
+                        if (subscription->m_threadSafe && (subscription->m_messages & bits) &&
+                            subscription->m_active.load(std::memory_order_relaxed))
+                        {
+                            ++delivered;
+                            guard.m_frame.m_current = subscription;
+                            dispatch(subscription, *work);
+                        }
+                    }
+                }
+                catch (...)
+                {
+                    std::lock_guard<std::mutex> lock(fork->m_lock);
+                    if (!fork->m_error)
+                    {
+                        fork->m_error = std::current_exception();
+                    }
+                }
+            }
+#if defined(OBSERVERPATTERN_INSTRUMENTATION) || defined(OBSERVERPATTERN_JOURNAL)
+            fork->m_delivered.fetch_add(delivered);
+#else
+            (void)delivered;
+#endif
+            if (fork->m_done.fetch_add(1) + 1 == fork->m_chunks)
+            {
+                std::lock_guard<std::mutex> lock(fork->m_lock);
+                fork->m_finished.notify_all();
+            }
+        }
+    };
+
+    const unsigned cores = std::thread::hardware_concurrency();
+    const std::size_t helpers = std::min<std::size_t>(fork->m_chunks - 1, cores > 1 ? cores - 1 : 1);
+    try
+    {
+        for (std::size_t i = 0; i < helpers; ++i)
+        {
+            executor().execute(help);
+        }
+    }
+    catch (...)
+    {
+        // fewer helpers, the caller claims the rest
+    }
+
+    // observers not declaring thread-safe update stay on this thread, in order,
+    // the frame is popped before joining, chunks of this thread push their own
+    std::exception_ptr error;
+    try
+    {
+        FrameGuard guard(this, snapshot, fork->m_frames);
+        for (auto it = snapshot->begin(); it != snapshot->end(); ++it)
+        {
+            Subscription *subscription = *it;
+            if (!subscription->m_threadSafe && (subscription->m_messages & bits) &&
+                subscription->m_active.load(std::memory_order_relaxed))
+            {
+#if defined(OBSERVERPATTERN_INSTRUMENTATION) || defined(OBSERVERPATTERN_JOURNAL)
+                fork->m_delivered.fetch_add(1, std::memory_order_relaxed);
+#endif
+                guard.m_frame.m_current = subscription;
+                dispatch(subscription, deliver);
+            }
+        }
+    }
+    catch (...)
+    {
+        error = std::current_exception();                       // MUST join before leaving, chunks use deliver and snapshot
+    }
+
+    help();                                                     // join by claiming chunks left
+    {
+        std::unique_lock<std::mutex> lock(fork->m_lock);
+        fork->m_finished.wait(lock, [&fork] { return fork->m_done.load() == fork->m_chunks; });
+        if (!error)
+        {
+            error = fork->m_error;
+        }
+    }
+#ifdef OBSERVERPATTERN_INSTRUMENTATION
+    probe.delivered(fork->m_delivered.load());
+#endif
+#ifdef OBSERVERPATTERN_JOURNAL
+    if (journal)
+    {
+        journal->delivered(static_cast<std::uint32_t>(fork->m_delivered.load()));
+    }
+#endif
+    if (error)
+    {
+        std::rethrow_exception(error);
+    }
+}
+
+inline bool ConcurrentSubjectImpl::attach(ObserverImpl *observer, MessageMask messages)
+{
+    std::lock_guard<std::mutex> lock(m_writer);
+    const Snapshot *current = m_snapshot.load();
+    for (auto it = current->begin(); it != current->end(); ++it)
+    {
+        if ((*it)->m_observer == observer)
+        {
+            return false;                                       // already in the list of observers
+        }
+    }
+
+    // after all observers of higher or equal priority, readers never sort
+    const int priority = priorityOf(observer);
+    auto position = current->end();
+    while (position != current->begin() && priorityOf((*(position - 1))->m_observer) < priority)
+    {
+        --position;
+    }
+    Snapshot *snapshot = createSnapshot(current->size() + 1);
+    snapshot->assign(current->begin(), position);
+    try
+    {
+        snapshot->push_back(createSubscription(observer, messages));
+    }
+    catch (...)
+    {
+        destroy(snapshot);
+        throw;
+    }
+    snapshot->insert(snapshot->end(), position, current->end()); // capacity reserved, no throw
+    publish(snapshot, nullptr);
+    return true;
+}
+
+inline bool ConcurrentSubjectImpl::detach(ObserverImpl *observer)
+{
+    std::unique_lock<std::mutex> lock(m_writer);
+    Subscription *removed = nullptr;
+    const Snapshot *current = m_snapshot.load();
+    Snapshot *snapshot = createSnapshot(current->size());
+    for (auto it = current->begin(); it != current->end(); ++it)
+    {
+        if ((*it)->m_observer == observer)
+        {
+            removed = *it;
+        }
+        else
+        {
+            snapshot->push_back(*it);
+        }
+    }
+    if (!removed)
+    {
+        destroy(snapshot);
+        snapshot = nullptr;
+        // unlinked by the destrctor, which then waits, stopped from an update in progress or another thread,
+        // the destrctor MUST not stop it again, it may be deleted as soon as this returns
+        auto unlinked = std::find_if(m_unlinked.begin(), m_unlinked.end(),
+                                     [observer](const Subscription *subscription) { return subscription && subscription->m_observer == observer; });
+        if (unlinked == m_unlinked.end())
+        {
+            return false;                                       // not in the list of observers
+        }
+        removed = *unlinked;
+        *unlinked = nullptr;                                    // the destrctor frees it with the others
+    }
+
+    removed->m_active.store(false);                             // skipped by notify of this thread, no update of notifyAsync starts
+    // order matters, enterRead MUST occur before publish, keeps removed alive while waiting
+    const unsigned epoch = enterRead();
+    if (snapshot)
+    {
+        publish(snapshot, removed);
+    }
+
+    // grace period, notify of replaced snapshots on other threads may still update removed,
+    // m_writer MUST not be held while waiting, otherwise an update invoking addObserver or removeObserver deadlocks,
+    // this thread is listed meanwhile, so a detach inside a notify of another thread does not wait for it in turn
+    NotifyFrame *frames = notifyFrames();
+    if (frames)
+    {
+        m_waiters.push_back(frames);
+    }
+    awaitQuiescent(lock, removed);
+#ifdef OBSERVERPATTERN_INSTRUMENTATION
+    statsTable().release(removed->m_stats.exchange(nullptr));  // no update of another thread records into it any more
+#endif
+    if (frames)
+    {
+        m_waiters.erase(std::find(m_waiters.begin(), m_waiters.end(), frames));
+        m_quiet.notify_all();                                   // another detach may have waited for this thread to leave update of its observer
+    }
+    lock.unlock();
+    exitRead(epoch);
+    return true;
+}
+
+inline void ConcurrentSubjectImpl::attachAll(const Subscribed *observers, std::size_t count)
+{
+    std::lock_guard<std::mutex> lock(m_writer);
+    const Snapshot *current = m_snapshot.load();
+    // one snapshot for all, rather than one copy of the whole snapshot each
+    Snapshot *snapshot = createSnapshot(current->size() + count);
+    snapshot->assign(current->begin(), current->end());
+    bool unsorted = false;
+    try
+    {
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            ObserverImpl *observer = observers[i].m_observer;
+            unsorted = unsorted || (!snapshot->empty() && priorityOf(snapshot->back()->m_observer) < priorityOf(observer));
+            snapshot->push_back(createSubscription(observer, MessageMask::fromBits(observers[i].m_messages)));
+        }
+    }
+    catch (...)
+    {
+        for (auto it = snapshot->begin() + current->size(); it != snapshot->end(); ++it)
+        {
+            destroy(*it);                                       // never published, no reader saw it
+        }
+        destroy(snapshot);
+        throw;
+    }
+    if (unsorted)
+    {
+        // stable, observing order is kept among equal priorities
+        std::stable_sort(snapshot->begin(), snapshot->end(), [](const Subscription *a, const Subscription *b)
+        {
+            return priorityOf(a->m_observer) > priorityOf(b->m_observer);
+        });
+    }
+    publish(snapshot, nullptr);
+}
+
+inline void ConcurrentSubjectImpl::subscriptions(std::vector<Subscribed> &observers) const
+{
+    const unsigned epoch = enterRead();
+    const Snapshot *snapshot = m_snapshot.load();
+    for (auto it = snapshot->begin(); it != snapshot->end(); ++it)
+    {
+        if ((*it)->m_active.load())
+        {
+            const Subscribed subscribed = { (*it)->m_observer, (*it)->m_messages, priorityOf((*it)->m_observer) };
+            observers.push_back(subscribed);
+        }
+    }
+    exitRead(epoch);
+}
+
+inline unsigned ConcurrentSubjectImpl::enterRead() const
+{
+    for (;;)
+    {
+        const std::uint64_t epoch = m_epoch.load();
+        m_readers[epoch & 1].fetch_add(1);
+        if (m_epoch.load() == epoch)
+        {
+            return static_cast<unsigned>(epoch & 1);            // entered before epoch moves on
+        }
+        m_readers[epoch & 1].fetch_sub(1);                      // epoch moved on, retry
+    }
+}
+
+inline void ConcurrentSubjectImpl::exitRead(unsigned epoch) const
+{
+    m_readers[epoch].fetch_sub(1);
+}
+
+inline ConcurrentSubjectImpl::Snapshot* ConcurrentSubjectImpl::createSnapshot(std::size_t capacity) const
+{
+    void *memory = m_resource->allocate(sizeof(Snapshot));
+    Snapshot *snapshot = new (memory) Snapshot(m_resource);
+    try
+    {
+        snapshot->reserve(capacity);
+    }
+    catch (...)
+    {
+        destroy(snapshot);
+        throw;
+    }
+    return snapshot;
+}
+
+inline ConcurrentSubjectImpl::Subscription* ConcurrentSubjectImpl::createSubscription(ObserverImpl *observer, MessageMask messages) const
+{
+    void *memory = m_resource->allocate(sizeof(Subscription));
+    return new (memory) Subscription(observer, messages, m_resource);
+}
+
+inline void ConcurrentSubjectImpl::destroy(const Snapshot *snapshot)
+{
+    MemoryResource *resource = snapshot->get_allocator().resource();
+    snapshot->~Snapshot();
+    resource->deallocate(const_cast<Snapshot*>(snapshot), sizeof(Snapshot));
+}
+
+inline void ConcurrentSubjectImpl::destroy(Subscription *subscription)
+{
+    if (!subscription)
+    {
+        return;                                                 // nothing removed
+    }
+    MemoryResource *resource = subscription->m_resource;
+    subscription->~Subscription();
+    resource->deallocate(subscription, sizeof(Subscription));
+}
+
+inline void ConcurrentSubjectImpl::publish(const Snapshot *snapshot, Subscription *removed)
+{
+    const Snapshot *previous = m_snapshot.exchange(snapshot);
+    Retired retired = { previous, removed, m_epoch.load() };
+    m_retired.push_back(retired);
+    reclaim();
+}
+
+inline void ConcurrentSubjectImpl::reclaim()
+{
+    // readers are in current epoch or the previous one, a snapshot replaced in epoch E
+    // is unreachable once epoch reaches E + 2, never blocks
+    for (int i = 0; i < 2; ++i)
+    {
+        const std::uint64_t epoch = m_epoch.load();
+        if (m_readers[(epoch + 1) & 1].load() != 0)
+        {
+            break;                                              // readers of previous epoch still running
+        }
+        m_epoch.store(epoch + 1);
+    }
+
+    const std::uint64_t epoch = m_epoch.load();
+    auto it = m_retired.begin();
+    for (; it != m_retired.end() && it->m_epoch + 2 <= epoch; ++it)
+    {
+        destroy(it->m_snapshot);
+        destroy(it->m_removed);
+    }
+    m_retired.erase(m_retired.begin(), it);
+}
+
+template<typename F>
+bool ConcurrentSubjectImpl::dispatch(Subscription *subscription, F &deliver) const
+{
+#ifdef OBSERVERPATTERN_INSTRUMENTATION
+    return Instrumentation::update(this, subscription->m_observer, deliver, [this, subscription]() { return statsOf(subscription); });
+#else
+    return deliver(subscription->m_observer);
+#endif
+}
+
+#ifdef OBSERVERPATTERN_INSTRUMENTATION
+inline ObserverStats* ConcurrentSubjectImpl::statsOf(Subscription *subscription) const
+{
+    ObserverStats *stats = subscription->m_stats.load(std::memory_order_acquire);
+    if (stats || !subscription->m_active.load())
+    {
+        return stats;                                           // nothing recorded once detached, the entry is released by detach
+    }
+    // updates of a thread-safe observer may run on several threads, one entry is kept
+    ObserverStats *claimed = statsTable().claim(subscription->m_observer);
+    if (subscription->m_stats.compare_exchange_strong(stats, claimed, std::memory_order_acq_rel))
+    {
+        return claimed;
+    }
+    statsTable().release(claimed);
+    return stats;
+}
+#endif
+
+template<typename F>
+bool ConcurrentSubjectImpl::dispatchAsync(Subscription *subscription, F deliver) const
+{
+    struct DispatchGuard                                        // count update done even if it throws
+    {
+        const ConcurrentSubjectImpl *m_subject;
+        Subscription *m_subscription;
+        ~DispatchGuard()
+        {
+            m_subscription->m_dispatching.fetch_sub(1);
+            m_subject->left();
+        }
+    };
+
+    // no snapshot is read, order matters, m_dispatching MUST be raised before m_active is checked,
+    // detach clears m_active before it waits for m_dispatching to drop
+    subscription->m_dispatching.fetch_add(1);
+    DispatchGuard dispatchGuard = { this, subscription };
+    if (!subscription->m_active.load())
+    {
+        return false;                                           // detached, not consumed
+    }
+    return dispatch(subscription, deliver);
+}
+
+inline void ConcurrentSubjectImpl::fanOut() const
+{
+    std::vector<Message> messages;
+    for (;;)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_asyncLock);
+            if (m_asyncQueue.empty())
+            {
+                m_asyncScheduled = false;
+                break;
+            }
+            messages.swap(m_asyncQueue);
+        }
+
+        const unsigned epoch = enterRead();
+        const Snapshot *snapshot = m_snapshot.load();
+        for (auto it = snapshot->begin(); it != snapshot->end(); ++it)
+        {
+            Subscription *subscription = *it;
+            if (!subscription->m_active.load())
+            {
+                continue;                                       // being detached
+            }
+
+            bool schedule = false;
+            {
+                std::lock_guard<std::mutex> lock(subscription->m_queueLock);
+                const std::size_t queued = subscription->m_queue.size();
+                for (auto message = messages.begin(); message != messages.end(); ++message)
+                {
+                    if (subscription->m_messages & message->bits())
+                    {
+                        subscription->m_queue.push_back(*message);
+                    }
+                }
+                if (subscription->m_queue.size() == queued)
+                {
+                    continue;                                   // none of interest
+                }
+                m_asyncPending.fetch_add(subscription->m_queue.size() - queued);
+                if (!subscription->m_scheduled)
+                {
+                    subscription->m_scheduled = schedule = true;
+                    m_asyncPending.fetch_add(1);                // the task itself
+                }
+            }
+            if (schedule)
+            {
+                // the epoch entered keeps subscription alive until deliver is done
+                const unsigned pinned = enterRead();
+                executor().execute([this, subscription, pinned] { deliver(subscription, pinned); });
+            }
+        }
+        exitRead(epoch);
+        finished(messages.size());
+        messages.clear();
+    }
+    finished(1);                                                // MUST be the last access to this
+}
+
+inline void ConcurrentSubjectImpl::deliver(Subscription *subscription, unsigned epoch) const
+{
+    std::vector<Message> messages;
+    for (;;)
+    {
+        {
+            std::lock_guard<std::mutex> lock(subscription->m_queueLock);
+            if (subscription->m_queue.empty())
+            {
+                subscription->m_scheduled = false;
+                break;
+            }
+            messages.swap(subscription->m_queue);
+        }
+
+        FrameGuard guard(this, nullptr, notifyFrames());        // for a detach inside update, nothing counted
+        guard.m_frame.m_current = subscription;
+        for (auto it = messages.begin(); it != messages.end(); ++it)
+        {
+            // no one waits for the result on the executor, so a throwing update is kept for flush,
+            // and the messages queued behind it, the counts and the epoch go on as usual
+            const Message &message = *it;
+            try
+            {
+                dispatchAsync(subscription, [&message](ObserverImpl *observer) { return message.deliver(observer); }); // dropped once detached
+            }
+            catch (...)
+            {
+                failed(std::current_exception());
+            }
+        }
+        finished(messages.size());
+        messages.clear();
+    }
+    exitRead(epoch);
+    finished(1);                                                // MUST be the last access to this
+}
+
+inline void ConcurrentSubjectImpl::finished(std::size_t count) const
+{
+    // decrease under m_flushLock, flush may destroy this as soon as it sees 0
+    std::lock_guard<std::mutex> lock(m_flushLock);
+    if (m_asyncPending.fetch_sub(count) == count)
+    {
+        m_flushed.notify_all();
+    }
+}
+
+inline void ConcurrentSubjectImpl::failed(std::exception_ptr error) const
+{
+    std::lock_guard<std::mutex> lock(m_flushLock);
+    if (!m_asyncError)
+    {
+        m_asyncError = error;                                   // later ones are dropped
+    }
+}
+
+inline Executor& ConcurrentSubjectImpl::executor() const
+{
+    return m_executor ? *m_executor : ThreadPool::instance();
+}
+
+inline bool ConcurrentSubjectImpl::quiescent(const Subscription *removed) const
+{
+    // frames of this thread and of threads waiting in detach do not run until they resume, then they skip removed,
+    // except a waiting thread inside update of removed, it MUST return from it first
+    const NotifyFrame *const here = notifyFrames();
+    std::vector<const NotifyFrame*> frames;
+    unsigned dispatching = 0;
+    for (const NotifyFrame *frame = here; frame; frame = frame->m_prev)
+    {
+        frames.push_back(frame);
+        if (frame->m_subject == this && !frame->m_snapshot && frame->m_current == removed)
+        {
+            ++dispatching;                                      // stopObserve invoked inside its own update of notifyAsync
+        }
+    }
+    for (auto waiter = m_waiters.begin(); waiter != m_waiters.end(); ++waiter)
+    {
+        for (const NotifyFrame *frame = *waiter; frame && *waiter != here; frame = frame->m_prev)
+        {
+            if (frame->m_subject == this && frame->m_current == removed)
+            {
+                return false;
+            }
+            frames.push_back(frame);
+        }
+    }
+    std::sort(frames.begin(), frames.end());
+    frames.erase(std::unique(frames.begin(), frames.end()), frames.end()); // chunks of notifyParallel share the frames below
+
+    // any other notify of a snapshot replaced may still reach removed, the current one does not hold it
+    for (auto it = m_retired.begin(); it != m_retired.end(); ++it)
+    {
+        long held = 0;
+        for (auto frame = frames.begin(); frame != frames.end(); ++frame)
+        {
+            held += (*frame)->m_snapshot == it->m_snapshot ? 1 : 0;
+        }
+        if (it->m_snapshot->m_readers.load() > held)
+        {
+            return false;
+        }
+    }
+    return removed->m_dispatching.load() <= dispatching;
+}
+
+inline void ConcurrentSubjectImpl::awaitQuiescent(std::unique_lock<std::mutex> &lock, const Subscription *removed)
+{
+    // order matters, m_detaching MUST be raised before the counts are checked,
+    // a reader lowers its count before it checks m_detaching, so it either is seen gone or signals
+    m_detaching.fetch_add(1);
+    while (!quiescent(removed))
+    {
+        m_quiet.wait(lock);                                     // no core spent while a slow update runs elsewhere
+    }
+    m_detaching.fetch_sub(1);
+}
+
+inline void ConcurrentSubjectImpl::left() const
+{
+    // one load on the notify path while nobody detaches, locked otherwise so the signal falls between check and wait
+    if (m_detaching.load())
+    {
+        std::lock_guard<std::mutex> lock(m_writer);
+        m_quiet.notify_all();
+    }
+}
+
+inline ConcurrentSubjectImpl::NotifyFrame*& ConcurrentSubjectImpl::notifyFrames()
+{
+    static thread_local NotifyFrame *frames = nullptr;
+    return frames;
+}
+
+
+
+inline IntrusiveSubjectImpl::IntrusiveSubjectImpl(): m_head(nullptr) {}
+
+inline IntrusiveSubjectImpl::~IntrusiveSubjectImpl()
+{
+    // MUST be done here rather than in SubjectImpl, where detach is pure virtual
+    while (m_head)
+    {
+        ObserverImpl *observer = hookOf(m_head).m_prev;
+        if (!removeObserver(observer))                          // remove observers in reverse order
+        {
+            detach(observer);                                   // never leave the loop with observer linked
+        }
+    }
+}
+
+inline IntrusiveView<ObserverImpl> IntrusiveSubjectImpl::getObservers() const
+{
+    return IntrusiveView<ObserverImpl>(m_head);
+}
+
+inline void IntrusiveSubjectImpl::notify(long msg) const
+{
+#ifdef OBSERVERPATTERN_JOURNAL
+    JournalEntry journal(getJournalId(), msg);                  // recorded when notify returns
+#endif
+    notifyWith([msg](ObserverImpl *observer) { return updateOf(observer, msg); }, MessageMask::bitOf(msg));
+}
+
+inline void IntrusiveSubjectImpl::notifyBatch(MessageSpan msgs) const
+{
+#ifdef OBSERVERPATTERN_JOURNAL
+    for (auto it = msgs.begin(); it != msgs.end(); ++it)
+    {
+        JournalEntry journal(getJournalId(), *it);              // recorded one by one, fan-out unknown, replayed as notify
+    }
+#endif
+    const std::uint64_t bits = msgs.bits();
+    notifyWith([msgs, bits](ObserverImpl *observer)
+    {
+        return updateBatchOf(observer, hookOf(observer).m_messages, msgs, bits);
+    }, bits);
+}
+
+template<typename E, bool (*Deliver)(ObserverImpl*, const E&)>
+void IntrusiveSubjectImpl::notifyEvent(const E &event) const
+{
+    // no copy, every observer gets the same reference
+    notifyWith([&event](ObserverImpl *observer) { return Deliver(observer, event); });
+}
+
+inline bool IntrusiveSubjectImpl::notifyUntilConsumed(long msg) const
+{
+    return notifyWith([msg](ObserverImpl *observer) { return updateOf(observer, msg); }, MessageMask::bitOf(msg), true);
+}
+
+template<typename E, bool (*Deliver)(ObserverImpl*, const E&)>
+bool IntrusiveSubjectImpl::notifyEventUntilConsumed(const E &event) const
+{
+    return notifyWith([&event](ObserverImpl *observer) { return Deliver(observer, event); }, ~std::uint64_t(0), true);
+}
+
+template<typename F>
+bool IntrusiveSubjectImpl::notifyWith(F deliver, std::uint64_t bits, bool consumable) const
+{
+    if (!m_head)
+    {
+        return false;                                           // most subjects, nothing to do
+    }
+
+    struct FrameGuard                                           // pop frame even if update throws
+    {
+        NotifyFrame m_frame;
+        ~FrameGuard() { notifyFrames() = m_frame.m_prev; }
+    } frameGuard = { { this, m_head, hookOf(m_head).m_prev, false, notifyFrames(), nullptr } };
+    NotifyFrame &frame = frameGuard.m_frame;
+    notifyFrames() = &frame;
+#ifdef OBSERVERPATTERN_INSTRUMENTATION
+    NotifyProbe probe(stats());
+#endif
+#ifdef OBSERVERPATTERN_JOURNAL
+    JournalEntry *journal = JournalEntry::claim();              // nullptr unless invoked by notify(msg)
+    std::uint32_t fanOut = 0;
+#endif
+
+    // observers linked during notify are not notified until next time,
+    // detach moves m_next and m_last away from an observer unlinked during notify
+    bool consumed = false;
+    while (!frame.m_done && !consumed)
+    {
+        ObserverImpl *observer = frame.m_next;
+        if (observer == frame.m_last)
+        {
+            frame.m_done = true;
+        }
+        else
+        {
+            frame.m_next = hookOf(observer).m_next;
+        }
+        if (hookOf(observer).m_messages & bits)
+        {
+#ifdef OBSERVERPATTERN_JOURNAL
+            ++fanOut;
+#endif
+#ifdef OBSERVERPATTERN_INSTRUMENTATION
+            probe.delivered();
+            frame.m_current = observer;
+            auto attached = [this, &frame, observer]() { return frame.m_current == observer ? statsOf(observer) : nullptr; }; // cleared once unlinked
+            consumed = Instrumentation::update(this, observer, deliver, attached) && consumable;
+#else
+            consumed = deliver(observer) && consumable;         // notify observers in priority, then observing order
+#endif
+        }
+    }
+#ifdef OBSERVERPATTERN_JOURNAL
+    if (journal)
+    {
+        journal->delivered(fanOut);
+    }
+#endif
+    return consumed;
+}
+
+inline bool IntrusiveSubjectImpl::attach(ObserverImpl *observer, MessageMask messages)
+{
+    ObserverHook &hook = hookOf(observer);
+    if (hook.m_next)
+    {
+        return false;                                           // already linked, an observer observes one subject
+    }
+
+    hook.m_messages = messages.bits();
+    if (!m_head)
+    {
+        hook.m_prev = hook.m_next = observer;                   // only one, linked to itself
+        m_head = observer;
+        return true;
+    }
+    // circular, the last one is before the first, no tail pointer needed,
+    // walk back from it past observers of lower priority, O(1) when priorities are equal
+    const int priority = priorityOf(observer);
+    ObserverImpl *prev = hookOf(m_head).m_prev;
+    bool first = false;
+    while (priorityOf(prev) < priority)
+    {
+        if (prev == m_head)
+        {
+            prev = hookOf(m_head).m_prev;                       // becomes the first, linked after the last
+            first = true;
+            break;
+        }
+        prev = hookOf(prev).m_prev;
+    }
+    ObserverImpl *next = hookOf(prev).m_next;
+    hook.m_prev = prev;
+    hook.m_next = next;
+    hookOf(prev).m_next = observer;
+    hookOf(next).m_prev = observer;
+    if (first)
+    {
+        m_head = observer;
+    }
+    return true;
+}
+
+inline bool IntrusiveSubjectImpl::detach(ObserverImpl *observer)
+{
+    ObserverHook &hook = hookOf(observer);
+    if (!hook.m_next)
+    {
+        return false;                                           // not linked
+    }
+
+    const bool only = hook.m_next == observer;
+    for (NotifyFrame *frame = notifyFrames(); frame; frame = frame->m_prev)
+    {
+        if (frame->m_subject != this)
+        {
+            continue;
+        }
+        if (frame->m_current == observer)
+        {
+            frame->m_current = nullptr;                         // unlinked in its own update, not recorded
+        }
+        if (frame->m_done)
+        {
+            continue;
+        }
+        if (frame->m_next == observer && frame->m_last == observer)
+        {
+            frame->m_done = true;                               // nothing left to visit
+        }
+        else if (frame->m_next == observer)
+        {
+            frame->m_next = hook.m_next;                        // skip it, still before m_last
+        }
+        else if (frame->m_last == observer)
+        {
+            frame->m_last = hook.m_prev;                        // still at or after m_next
+        }
+    }
+
+    if (only)
+    {
+        m_head = nullptr;
+    }
+    else
+    {
+        hookOf(hook.m_prev).m_next = hook.m_next;
+        hookOf(hook.m_next).m_prev = hook.m_prev;
+        if (m_head == observer)
+        {
+            m_head = hook.m_next;
+        }
+    }
+    hook.m_prev = hook.m_next = nullptr;
+    hook.m_messages = 0;
+#ifdef OBSERVERPATTERN_INSTRUMENTATION
+    releaseStats(observer);
+#endif
+    return true;
+}
+
+inline void IntrusiveSubjectImpl::attachAll(const Subscribed *observers, std::size_t count)
+{
+    // sorted, then merged into the list in one walk from the head, rather than one walk back from the last each
+    std::vector<const Subscribed*> sorted(count);
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        sorted[i] = &observers[i];
+    }
+    std::stable_sort(sorted.begin(), sorted.end(), [](const Subscribed *a, const Subscribed *b)
+    {
+        return a->m_priority > b->m_priority;
+    });
+    ObserverImpl *next = m_head;                                // linked before next unless at the end
+    bool end = !m_head;
+    for (auto it = sorted.begin(); it != sorted.end(); ++it)
+    {
+        ObserverImpl *observer = (*it)->m_observer;
+        ObserverHook &hook = hookOf(observer);
+        hook.m_messages = (*it)->m_messages;
+        if (!m_head)
+        {
+            hook.m_prev = hook.m_next = observer;               // only one, linked to itself
+            m_head = observer;
+            continue;
+        }
+        // after all observers of higher or equal priority, those linked here are behind next
+        while (!end && priorityOf(next) >= (*it)->m_priority)
+        {
+            next = hookOf(next).m_next;
+            end = next == m_head;
+        }
+        ObserverImpl *before = end ? m_head : next;
+        ObserverImpl *prev = hookOf(before).m_prev;
+        hook.m_prev = prev;
+        hook.m_next = before;
+        hookOf(prev).m_next = observer;
+        hookOf(before).m_prev = observer;
+        if (!end && before == m_head)
+        {
+            m_head = observer;                                  // higher than the first
+        }
+    }
+}
+
+inline void IntrusiveSubjectImpl::subscriptions(std::vector<Subscribed> &observers) const
+{
+    if (!m_head)
+    {
+        return;
+    }
+    ObserverImpl *observer = m_head;
+    do
+    {
+        const Subscribed subscribed = { observer, hookOf(observer).m_messages, priorityOf(observer) };
+        observers.push_back(subscribed);
+        observer = hookOf(observer).m_next;
+    } while (observer != m_head);
+}
+
+inline IntrusiveSubjectImpl::NotifyFrame*& IntrusiveSubjectImpl::notifyFrames()
+{
+    static thread_local NotifyFrame *frames = nullptr;
+    return frames;
+}
+
+
+
+inline VersionedSubjectImpl::VersionedSubjectImpl(): m_last(0), m_version(0), m_draining(0) {}
+
+inline VersionedSubjectImpl::~VersionedSubjectImpl()
+{
+    // MUST be done here rather than in SubjectImpl, where detach is pure virtual
+    for (std::size_t slot = m_observers.size(); slot; --slot)
+    {
+        if (m_observers[slot - 1])
+        {
+            removeObserver(m_observers[slot - 1]);              // remove observers in reverse order
+        }
+    }
+}
+
+inline ObserverView<ObserverImpl> VersionedSubjectImpl::getObservers() const
+{
+    return ObserverView<ObserverImpl>(m_observers, m_observers.size() - m_free.size());
+}
+
+inline std::uint64_t VersionedSubjectImpl::getVersion() const
+{
+    return m_version;
+}
+
+inline bool VersionedSubjectImpl::isDirty(ObserverImpl *observer) const
+{
+    if (!hasObserver(observer))
+    {
+        return false;
+    }
+    const std::size_t slot = slotOf(observer);
+    return (m_dirty[slot / 64] >> (slot % 64)) & 1;
+}
+
+inline std::uint64_t VersionedSubjectImpl::pull(ObserverImpl *observer)
+{
+    if (hasObserver(observer))
+    {
+        const std::size_t slot = slotOf(observer);
+        m_dirty[slot / 64] &= ~(std::uint64_t(1) << (slot % 64));
+    }
+    return m_version;
+}
 
-    protected:
-        void stopObserve();                                     // stop observing the subject if any
-        virtual bool init() = 0;                                // initialize, invoked after start observing, pure virtual
-        virtual bool uninit() = 0;                              // uninitialize, invoked before stop observing, pure virtual
+inline std::size_t VersionedSubjectImpl::getDirtyCount() const
+{
+    std::size_t count = 0;
+    for (auto it = m_dirty.begin(); it != m_dirty.end(); ++it)
+    {
+        count += bitCount(*it);
+    }
+    return count;
+}
 
-    private:
-        ObserverImpl(const ObserverImpl&) = delete;             // disable copy from left value
-        ObserverImpl(const ObserverImpl&&) = delete;            // disable copy from right value
-        ObserverImpl& operator=(const ObserverImpl&) = delete;  // disable assign from left value
-        ObserverImpl& operator=(const ObserverImpl&&) = delete; // disable assign from right value
-        SubjectImpl *m_subject;                                 // the subject observed
-};
+inline std::size_t VersionedSubjectImpl::drain(std::size_t max)
+{
+    struct DrainGuard                                           // end drain even if update throws
+    {
+        unsigned &m_draining;
+        ~DrainGuard() { --m_draining; }
+    } drainGuard = { ++m_draining };
+#ifdef OBSERVERPATTERN_INSTRUMENTATION
+    NotifyProbe probe(stats());
+#endif
 
-inline SubjectImpl::SubjectImpl() {}
+    // one pass, an observer marked dirty again by update waits for the next drain,
+    // slots are not reused during drain, so a bit never stands for another observer
+    std::size_t updated = 0;
+    for (std::size_t word = 0; word < m_dirty.size() && updated < max; ++word)
+    {
+        for (std::uint64_t pending = m_dirty[word]; pending && updated < max; pending &= pending - 1)
+        {
+            const unsigned bit = lowestBit(pending);
+            const std::uint64_t mask = std::uint64_t(1) << bit;
+            if (!(m_dirty[word] & mask))
+            {
+                continue;                                       // pulled or removed by an earlier update
+            }
+            m_dirty[word] &= ~mask;
+            const std::size_t slot = word * 64 + bit;
+            ObserverImpl *observer = m_observers[slot];
+            const long msg = (m_all[word] & mask) ? m_last : m_latest[slot];
+            ++updated;
+#ifdef OBSERVERPATTERN_INSTRUMENTATION
+            probe.delivered();
+            auto deliver = [msg](ObserverImpl *target) { return target->update(msg); };
+            auto attached = [this, slot, observer]() { return m_observers[slot] == observer ? statsOf(observer) : nullptr; }; // slot not reused during drain
+            Instrumentation::update(this, observer, deliver, attached);
+#else
+            observer->update(msg);                              // intermediate versions skipped
+#endif
+        }
+    }
+    return updated;
+}
 
-inline SubjectImpl::~SubjectImpl()
+inline void VersionedSubjectImpl::notify(long msg) const
 {
-    while (!m_observers.empty())
+#ifdef OBSERVERPATTERN_JOURNAL
+    JournalEntry journal(getJournalId(), msg);                  // recorded when notify returns, fan-out unknown, updated by drain
+#endif
+    ++m_version;
+    m_last = msg;
+    // a word at a time for observers of all messages, the usual case
+    for (std::size_t word = 0; word < m_all.size(); ++word)
     {
-        removeObserver(m_observers.back());                     // remove observers in reverse order
+        m_dirty[word] |= m_all[word];
+    }
+    const std::uint64_t bit = MessageMask::bitOf(msg);
+    for (auto it = m_filtered.begin(); it != m_filtered.end(); ++it)
+    {
+        if ((m_messages[*it] & bit) && observesOf(m_observers[*it], msg))
+        {
+            m_dirty[*it / 64] |= std::uint64_t(1) << (*it % 64);
+            m_latest[*it] = msg;
+        }
     }
 }
 
-inline bool SubjectImpl::addObserver(ObserverImpl *observer)
+inline void VersionedSubjectImpl::notifyBatch(MessageSpan msgs) const
 {
-    if (!observer)
+    for (auto it = msgs.begin(); it != msgs.end(); ++it)
     {
-        return false;                                           // nullptr, invalid argument
+        notify(*it);                                            // drain still updates each observer once, with its latest
     }
+}
 
-    auto it = std::find(m_observers.begin(), m_observers.end(), observer);
-    if (it != m_observers.end())
+inline bool VersionedSubjectImpl::attach(ObserverImpl *observer, MessageMask messages)
+{
+    if (hasObserver(observer))
     {
         return false;                                           // already in the list of observers
     }
 
-    // order matters, push_back MUST occurs before startObserve
-    m_observers.push_back(observer);
-    observer->startObserve(this);
-    return true;
+    // priorities do not apply, drain visits slots in order
+    std::size_t slot = m_observers.size();
+    if (!m_free.empty() && !m_draining)
+    {
+        slot = m_free.back();
+        m_free.pop_back();
+        m_observers[slot] = observer;
+        m_messages[slot] = messages.bits();
+    }
+    else
+    {
+        m_observers.push_back(observer);
+        m_messages.push_back(messages.bits());
+        m_latest.push_back(0);
+        if (m_dirty.size() * 64 < m_observers.size())
+        {
+            m_dirty.push_back(0);
+            m_all.push_back(0);
+        }
+    }
+    setSlot(observer, slot);
+    if (messages.bits() == ~std::uint64_t(0) && messages.wideIds().empty())
+    {
+        m_all[slot / 64] |= std::uint64_t(1) << (slot % 64);
+    }
+    else
+    {
+        m_filtered.push_back(slot);
+    }
+    return true;                                                // clean, the current version is already there to read
 }
 
-inline  bool SubjectImpl::removeObserver(ObserverImpl *observer)
+inline bool VersionedSubjectImpl::detach(ObserverImpl *observer)
 {
-    if (!observer)
+    if (!hasObserver(observer))
     {
-        return false;                                           // nullptr, invalid argument
+        return false;                                           // not in the list of observers
     }
 
-    auto it = std::find(m_observers.begin(), m_observers.end(), observer);
-    if (it == m_observers.end())
+    const std::size_t slot = slotOf(observer);
+    const std::uint64_t mask = ~(std::uint64_t(1) << (slot % 64));
+    m_dirty[slot / 64] &= mask;
+    if (m_all[slot / 64] & ~mask)
     {
-        return false;                                           // not in the list of observers
+        m_all[slot / 64] &= mask;
     }
-
-    // order matters, erase MUST occurs before stopObserve
-    m_observers.erase(it);
-    observer->stopObserve(this);
+    else
+    {
+        m_filtered.erase(std::find(m_filtered.begin(), m_filtered.end(), slot));
+    }
+    m_observers[slot] = nullptr;
+    m_messages[slot] = 0;
+    m_free.push_back(slot);
+    setSlot(observer, NoSlot);
+#ifdef OBSERVERPATTERN_INSTRUMENTATION
+    releaseStats(observer);
+#endif
     return true;
 }
 
-inline const std::list<ObserverImpl*>& SubjectImpl::getObservers() const
+inline void VersionedSubjectImpl::subscriptions(std::vector<Subscribed> &observers) const
 {
-    return m_observers;                                         // list of observers
+    for (std::size_t i = 0; i < m_observers.size(); ++i)
+    {
+        if (m_observers[i])
+        {
+            const Subscribed subscribed = { m_observers[i], m_messages[i], priorityOf(m_observers[i]) };
+            observers.push_back(subscribed);
+        }
+    }
+}
+
+inline bool VersionedSubjectImpl::hasObserver(ObserverImpl *observer) const
+{
+    const std::size_t slot = slotOf(observer);
+    return slot < m_observers.size() && m_observers[slot] == observer;
+}
+
+inline unsigned VersionedSubjectImpl::lowestBit(std::uint64_t word)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    return static_cast<unsigned>(__builtin_ctzll(word));
+#else
+    unsigned bit = 0;
+    while (!(word & 1))
+    {
+        word >>= 1;
+        ++bit;
+    }
+    return bit;
+#endif
 }
 
-inline void SubjectImpl::notify(long msg) const
+inline unsigned VersionedSubjectImpl::bitCount(std::uint64_t word)
 {
-    for (auto it = m_observers.begin(); it != m_observers.end(); ++it)
+#if defined(__GNUC__) || defined(__clang__)
+    return static_cast<unsigned>(__builtin_popcountll(word));
+#else
+    unsigned count = 0;
+    for (; word; word &= word - 1)
     {
-        (*it)->update(msg);                                     // notify observers in observing order
+        ++count;
     }
+    return count;
+#endif
 }
 
 
 
-inline ObserverImpl::ObserverImpl(): m_subject(nullptr) {}
+inline ObserverImpl::ObserverImpl(): m_subject(nullptr), m_priority(0), m_slot(SubjectImpl::NoSlot), m_initPending(false)
+{
+#ifdef OBSERVERPATTERN_INSTRUMENTATION
+    m_stats = nullptr;
+#endif
+}
 
 inline ObserverImpl::~ObserverImpl()
 {
@@ -127,7 +3465,12 @@ inline SubjectImpl* ObserverImpl::getSubject() const
     return m_subject;                                           // the subject observed
 }
 
-inline bool ObserverImpl::startObserve(SubjectImpl *subject)
+inline int ObserverImpl::getPriority() const
+{
+    return m_priority;
+}
+
+inline bool ObserverImpl::startObserve(SubjectImpl *subject, MessageMask messages, int priority)
 {
     if (!subject || (m_subject == subject))
     {
@@ -139,9 +3482,17 @@ inline bool ObserverImpl::startObserve(SubjectImpl *subject)
         stopObserve(m_subject);                                 // stop observing the subject if any
     }
 
-    // order matters, assignment MUST occurs before addObserver
+    // order matters, assignment MUST occurs before attach,
+    // update may run on another thread as soon as attached
     m_subject = subject;
-    m_subject->addObserver(this);
+    m_priority = priority;                                      // read by attach to find the position
+    observeWide(messages);                                      // read by update of other threads once attached
+    if (!subject->attach(this, messages))
+    {
+        m_subject = nullptr;
+        m_wide.reset();
+        return false;                                           // rejected by the subject
+    }
     init();                                                     // initialize after start observing
     return true;
 }
@@ -153,13 +3504,52 @@ inline bool ObserverImpl::stopObserve(SubjectImpl *subject)
         return false;                                           // nullptr or not observing
     }
 
-    uninit();                                                   // uninitialize before stop observing
-    // order matters, assignment MUST occurs before removeObserver
+    if (m_initPending)
+    {
+        m_initPending = false;                                  // never initialized, nothing to uninitialize
+    }
+    else
+    {
+        uninit();                                               // uninitialize before stop observing
+    }
+    // order matters, assignment MUST occurs after detach,
+    // update in progress on another thread may still invoke getSubject
+    subject->detach(this);
     m_subject = nullptr;
-    subject->removeObserver(this);
+    m_wide.reset();                                             // no update in progress once detach returned
+    detached();                                                 // MUST be the last access to this
     return true;
 }
 
+inline bool ObserverImpl::updateBatch(MessageSpan msgs)
+{
+    bool updated = false;
+    for (auto it = msgs.begin(); it != msgs.end(); ++it)
+    {
+        updated = update(*it) || updated;                       // every message, even after one returned true
+    }
+    return updated;
+}
+
+inline void ObserverImpl::observeWide(const MessageMask &messages)
+{
+    const std::vector<long> &wide = messages.wideIds();
+    m_wide.reset(wide.empty() ? nullptr : new std::vector<long>(wide));
+}
+
+inline bool ObserverImpl::observes(long msg) const
+{
+    // ids in [0, 62] have a bit of their own, already matched by the store
+    return !m_wide || (msg >= 0 && msg < 63) || std::binary_search(m_wide->begin(), m_wide->end(), msg);
+}
+
+inline void ObserverImpl::detached() {}
+
+inline bool ObserverImpl::threadSafeUpdate() const
+{
+    return false;                                               // default updated on the notifying thread only
+}
+
 inline void ObserverImpl::stopObserve()
 {
     // ObserverImpl itself MUST not invoke stopObserve in its destrctor,
@@ -172,103 +3562,512 @@ inline void ObserverImpl::stopObserve()
     }
 }
 
-template<typename T>
+inline IntrusiveObserverImpl::IntrusiveObserverImpl()
+{
+    m_hook.m_prev = nullptr;
+    m_hook.m_next = nullptr;
+    m_hook.m_messages = 0;
+}
+
+struct SubjectPolicy {};                                        // base of policies, tells them from events
+
+struct SerialPolicy : SubjectPolicy                             // single-threaded subject, default
+{
+    typedef SerialSubjectImpl Impl;                             // implementation of Subject
+};
+
+struct ConcurrentPolicy : SubjectPolicy                         // thread-safe subject, notify takes no lock
+{
+    typedef ConcurrentSubjectImpl Impl;                         // implementation of Subject
+};
+
+struct IntrusivePolicy : SubjectPolicy                          // single-threaded subject of one pointer, links live in observers
+{
+    typedef IntrusiveSubjectImpl Impl;                          // implementation of Subject
+};
+
+struct VersionedPolicy : SubjectPolicy                          // single-threaded subject, observers pull the latest version
+{
+    typedef VersionedSubjectImpl Impl;                          // implementation of Subject
+};
+
+template<typename E>
+class EventHandler                                              // receives events of type E
+{
+    public:
+        virtual ~EventHandler();                                // destrctor, virtual
+        virtual bool update(const E &event) = 0;                // react to the event, pure virtual
+};
+
+template<typename Base>
+class EventObserverImpl : public Base                           // for implementation of Observer of typed events only, Base ObserverImpl or IntrusiveObserverImpl
+{
+    public:
+        bool update(long msg) override;                         // message id, ignored by default
+};
+
+template<typename T, typename... Events>
 class Observer;                                                 // forward declaration
 
+template<typename T, typename = void>
+struct IsComplete : std::false_type {};                         // whether T is defined at the first use, never asked again
+
+template<typename T>
+struct IsComplete<T, decltype(void(sizeof(T)))> : std::true_type {};
+
+template<typename T, bool Complete = IsComplete<T>::value>
+struct IsIntrusiveSubject : std::false_type {};                 // whether T is an intrusive subject, false if not defined yet
+
 template<typename T>
-class Subject : private SubjectImpl                             // abstract template class
+struct IsIntrusiveSubject<T, true> : std::is_base_of<IntrusiveSubjectImpl, T> {};
+
+template<typename Policy, typename O>
+struct IsLinkedFor : std::true_type {};                         // whether observer O has the links the store of Policy needs
+
+template<typename O>
+struct IsLinkedFor<IntrusivePolicy, O> : std::is_base_of<IntrusiveObserverImpl, O> {};
+
+template<typename T, bool Events>
+struct ObserverBaseOf                                           // base of Observer<T, Events...>, links only for an intrusive subject
+{
+    // a subject observing its own type is not defined yet where it derives from Observer, it gets no links,
+    // Observer and Subject assert that observers of an intrusive subject have them
+    typedef typename std::conditional<IsIntrusiveSubject<T>::value, IntrusiveObserverImpl, ObserverImpl>::type Linked;
+    typedef typename std::conditional<Events, EventObserverImpl<Linked>, Linked>::type type;
+};
+
+template<typename... Events>
+struct EventList                                                // list of event types
+{
+    template<typename T>
+    using ObserverOf = Observer<T, Events...>;                  // observer handling these events
+};
+
+template<typename E, typename List>
+struct IsEventOf;                                               // whether E is in List
+
+template<typename E>
+struct IsEventOf<E, EventList<>> : std::false_type {};
+
+template<typename E, typename First, typename... Rest>
+struct IsEventOf<E, EventList<First, Rest...>> :
+    std::integral_constant<bool, std::is_same<E, First>::value || IsEventOf<E, EventList<Rest...>>::value> {};
+
+template<bool HasPolicy, typename... Options>
+struct SubjectOptionsImpl;                                      // split Options into policy and events
+
+template<typename... Options>
+struct SubjectOptionsImpl<false, Options...>
+{
+    typedef SerialPolicy Policy;                                // default policy
+    typedef EventList<Options...> Events;
+};
+
+template<typename First, typename... Rest>
+struct SubjectOptionsImpl<true, First, Rest...>
+{
+    typedef First Policy;
+    typedef EventList<Rest...> Events;
+};
+
+template<typename... Options>
+struct StartsWithPolicy : std::false_type {};                   // whether the first option is a policy
+
+template<typename First, typename... Rest>
+struct StartsWithPolicy<First, Rest...> : std::is_base_of<SubjectPolicy, First> {};
+
+template<typename... Options>
+struct SubjectOptions : SubjectOptionsImpl<StartsWithPolicy<Options...>::value, Options...> {};
+
+class JournalReplayer;                                          // forward declaration
+
+class SharedMemoryProxy;                                        // forward declaration
+
+template<typename V>
+class Computed;                                                 // forward declaration
+
+template<typename T, typename... Options>
+class Subject;                                                  // forward declaration
+
+template<typename T, typename... Options>
+class Subject : private SubjectOptions<Options...>::Policy::Impl // abstract template class
 {
-    // static_cast from Subject<T>* to SubjectImpl* in Observer<T>
-    friend class Observer<T>;
+    public:
+        typedef typename SubjectOptions<Options...>::Policy Policy; // policy, SerialPolicy unless given first in Options
+        typedef typename SubjectOptions<Options...>::Events EventTypes; // typed events, the rest of Options
+        typedef typename EventTypes::template ObserverOf<T> ObserverType; // observer of this subject
+        typedef typename Policy::Impl Impl;                     // implementation selected by Policy
+        typedef typename Impl::template View<ObserverType> View; // type returned by getObservers
+
+    private:
+        // static_cast from Subject<T, Options...>* to SubjectImpl* in Observer<T, Events...>
+        friend ObserverType;
+        // notify on replay of a journal
+        friend class JournalReplayer;
+        // notify on messages of another process
+        friend class SharedMemoryProxy;
+        // attach of a computed value refreshes it first
+        template<typename V>
+        friend class Computed;
+        // static_cast from Subject<T, Options...>* to SubjectImpl* on registration
+        friend class SubscriptionGraph;
+
     public:
         Subject();                                              // constructor
         virtual ~Subject() = 0;                                 // destrctor, pure virtual
-        bool addObserver(Observer<T> *observer);                // add one observer
-        bool removeObserver(Observer<T> *observer);             // remove one observer
-        std::list<Observer<T>*> getObservers() const;           // get list of observers
+        bool addObserver(ObserverType *observer, MessageMask messages = MessageMask(), int priority = 0); // add one observer, for messages only, higher priority first
+        bool removeObserver(ObserverType *observer);            // remove one observer
+        template<typename Iterator>
+        std::size_t addObservers(Iterator first, Iterator last, MessageMask messages = MessageMask(), int priority = 0,
+                                 ObserverInit init = ObserverInit::Immediate); // add observers in one pass, init after all unless deferred, number added
+        std::size_t initObservers();                            // init observers added with ObserverInit::Deferred, number initialized
+        View getObservers() const;                              // get view of observers
+        void setExecutor(Executor *executor);                   // executor of notifyAsync, ConcurrentPolicy only
+        void setMemoryResource(MemoryResource *resource);       // memory of subscriptions, ConcurrentPolicy only
+        void setParallelism(std::size_t grain, std::size_t threshold); // chunk size and fewest observers to fork, ConcurrentPolicy only
+        void flush() const;                                     // wait until notifyAsync delivered, rethrow the first exception of an update, ConcurrentPolicy only
+        NotifyBatch beginBatch(BatchMerge merge = BatchMerge::KeepLast); // defer notify until the batch is destroyed, SerialPolicy only
+        std::uint64_t getVersion() const;                       // number of notify so far, VersionedPolicy only
+        bool isDirty(ObserverType *observer) const;             // whether notified since its last pull or update, VersionedPolicy only
+        std::uint64_t pull(ObserverType *observer);             // mark observer clean, current version, VersionedPolicy only
+        std::size_t getDirtyCount() const;                      // number of dirty observers, VersionedPolicy only
+        std::size_t drain(std::size_t max = std::numeric_limits<std::size_t>::max()); // update dirty observers once each, VersionedPolicy only
+#ifdef OBSERVERPATTERN_INSTRUMENTATION
+        SubjectStatsSnapshot getStats() const;                  // copy of counters of the subject and its observers
+#endif
+#ifdef OBSERVERPATTERN_JOURNAL
+        void setJournalId(std::uint32_t id);                    // id of this subject in journal records, 0 by default
+        std::uint32_t getJournalId() const;                     // id of this subject in journal records
+#endif
 
     protected:
         void notify(long msg) const;                            // notify all observers
+        void notifyBatch(const long *msgs, std::size_t count) const; // deliver count messages to each observer in one updateBatch
+        void notifyBatch(MessageSpan msgs) const;               // deliver msgs to each observer in one updateBatch
+        void notifyAsync(long msg) const;                       // notify all observers on executor, an update that throws is kept for flush, ConcurrentPolicy only
+        void notifyParallel(long msg) const;                    // notify all observers, thread-safe ones across executor, ConcurrentPolicy only
+        template<typename E>
+        typename std::enable_if<IsEventOf<E, EventTypes>::value>::type
+        notify(const E &event) const;                           // deliver event by reference to all observers
+        bool notifyUntilConsumed(long msg) const;               // notify observers until one update returns true, whether consumed
+        template<typename E>
+        typename std::enable_if<IsEventOf<E, EventTypes>::value, bool>::type
+        notifyUntilConsumed(const E &event) const;              // deliver event until one update returns true, whether consumed
+        template<typename E>
+        typename std::enable_if<IsEventOf<typename std::decay<E>::type, EventTypes>::value>::type
+        notifyAsync(E &&event) const;                           // deliver event on executor, ConcurrentPolicy only
+        template<typename E>
+        typename std::enable_if<IsEventOf<E, EventTypes>::value>::type
+        notifyParallel(const E &event) const;                   // deliver event by reference, thread-safe observers across executor, ConcurrentPolicy only
 
     private:
         Subject(const Subject&) = delete;                       // disable copy from left value
         Subject(const Subject&&) = delete;                      // disable copy from right value
         Subject& operator=(const Subject&) = delete;            // disable assign from left value
         Subject& operator=(const Subject&&) = delete;           // disable assign from right value
+        template<typename E>
+        static bool deliver(ObserverImpl *observer, const E &event); // invoke update of the observer for E
+        void tapped(long msg) const;                            // hand msg to tap if T is a MessageTap
+        void tapped(long msg, std::true_type) const;
+        void tapped(long, std::false_type) const;               // nothing, no cost
 };
 
 
 
-template<typename T>
-class Observer : private ObserverImpl                           // abstract template class
+template<typename T, typename... Events>
+class Observer : private ObserverBaseOf<T, sizeof...(Events) != 0>::type,
+                 public EventHandler<Events>...                 // abstract template class
 {
-    // static_cast from Observer<T>* to ObserverImpl* in Subject<T>
-    friend class Subject<T>;
+    // static_cast from Observer<T, Events...>* to ObserverImpl* in Subject<T, Options...>
+    template<typename U, typename... Options>
+    friend class Subject;
+    // static_cast from ObserverImpl* to Observer<T, Events...>* in ObserverView, ObserverSnapshot and IntrusiveView
+    friend class ObserverView<Observer>;
+    friend class ObserverSnapshot<Observer>;
+    friend class IntrusiveView<Observer>;
+    // static_cast from Observer<T, Events...>* to ObserverImpl* on registration
+    friend class SubscriptionGraph;
     public:
         Observer();                                             // constructor
         virtual ~Observer();                                    // destrctor, virtual
-        bool startObserve(T *subject);                          // start observing the subject
+        bool startObserve(T *subject, MessageMask messages = MessageMask(), int priority = 0); // start observing the subject, for messages only, higher priority first
         bool stopObserve(T *subject);                           // stop observing the subject
-        virtual bool update(long msg) = 0;                      // react to the change to keep update, pure virtual
+        using ObserverImpl::update;                             // react to the change to keep update, pure virtual unless Events given
+        using ObserverImpl::updateBatch;                        // react to several changes at once, default update each in order
         T* getSubject() const;                                  // get the subject observed
+        using ObserverImpl::getPriority;                        // priority given when started observing
 
     protected:
         void stopObserve();                                     // stop observing the subject if any
         virtual bool init();                                    // initialize, invoked after start observing
         virtual bool uninit();                                  // uninitialize, invoked before stop observing
+        using ObserverImpl::threadSafeUpdate;                   // whether update may run in parallel chunks, default false
 
     private:
         Observer(const Observer&) = delete;                     // disable copy from left value
         Observer(const Observer&&) = delete;                    // disable copy from right value
         Observer& operator=(const Observer&) = delete;          // disable assign from left value
         Observer& operator=(const Observer&&) = delete;         // disable assign from right value
+        template<typename... Options>
+        static Subject<T, Options...>* subjectOf(Subject<T, Options...> *subject); // deduce Options of T
 };
 
 
 
-template<typename T>
-Subject<T>::Subject() {}
+template<typename E>
+EventHandler<E>::~EventHandler() {}
 
-template<typename T>
-Subject<T>::~Subject() {}
+template<typename Base>
+bool EventObserverImpl<Base>::update(long)
+{
+    return false;                                               // default do nothing
+}
 
-template<typename T>
-bool Subject<T>::addObserver(Observer<T> *observer)
+
+
+template<typename T, typename... Options>
+Subject<T, Options...>::Subject()
 {
-    return SubjectImpl::addObserver(static_cast<ObserverImpl*>(observer));
+    static_assert(IsLinkedFor<Policy, ObserverType>::value,
+                  "Observer of an intrusive Subject MUST be instantiated where the Subject is defined, not inside its own definition");
 }
 
-template<typename T>
-bool Subject<T>::removeObserver(Observer<T> *observer)
+template<typename T, typename... Options>
+Subject<T, Options...>::~Subject() {}
+
+template<typename T, typename... Options>
+bool Subject<T, Options...>::addObserver(ObserverType *observer, MessageMask messages, int priority)
 {
-    return SubjectImpl::removeObserver(static_cast<ObserverImpl*>(observer));
+    return Impl::addObserver(static_cast<ObserverImpl*>(observer), messages, priority);
 }
 
-template<typename T>
-std::list<Observer<T>*> Subject<T>::getObservers() const
+template<typename T, typename... Options>
+bool Subject<T, Options...>::removeObserver(ObserverType *observer)
 {
-    std::list<Observer<T>*> observers;
-    for (auto observerImpl : SubjectImpl::getObservers())
+    return Impl::removeObserver(static_cast<ObserverImpl*>(observer));
+}
+
+template<typename T, typename... Options>
+template<typename Iterator>
+std::size_t Subject<T, Options...>::addObservers(Iterator first, Iterator last, MessageMask messages, int priority, ObserverInit init)
+{
+    std::vector<ObserverImpl*> observers;
+    for (; first != last; ++first)
     {
-        auto observer = static_cast<Observer<T>*>(observerImpl);
-        observers.push_back(observer);
+        ObserverType *observer = *first;
+        observers.push_back(static_cast<ObserverImpl*>(observer));
     }
-    return observers;
+    return Impl::addObservers(observers.data(), observers.size(), messages, priority, init);
 }
 
-template<typename T>
-void Subject<T>::notify(long msg) const
+template<typename T, typename... Options>
+std::size_t Subject<T, Options...>::initObservers()
 {
-    SubjectImpl::notify(msg);
+    return Impl::initObservers();
 }
 
+template<typename T, typename... Options>
+typename Subject<T, Options...>::View Subject<T, Options...>::getObservers() const
+{
+    // no copy, ObserverView is invalidated by addObserver and removeObserver,
+    // ObserverSnapshot keeps its snapshot alive until destroyed
+    return View(Impl::getObservers());
+}
 
+template<typename T, typename... Options>
+void Subject<T, Options...>::setExecutor(Executor *executor)
+{
+    Impl::setExecutor(executor);
+}
 
-template<typename T>
-Observer<T>::Observer() {}
+template<typename T, typename... Options>
+void Subject<T, Options...>::setMemoryResource(MemoryResource *resource)
+{
+    Impl::setMemoryResource(resource);
+}
 
-template<typename T>
-Observer<T>::~Observer() 
+template<typename T, typename... Options>
+void Subject<T, Options...>::setParallelism(std::size_t grain, std::size_t threshold)
+{
+    Impl::setParallelism(grain, threshold);
+}
+
+template<typename T, typename... Options>
+void Subject<T, Options...>::flush() const
+{
+    Impl::flush();
+}
+
+template<typename T, typename... Options>
+NotifyBatch Subject<T, Options...>::beginBatch(BatchMerge merge)
+{
+    return Impl::beginBatch(merge);
+}
+
+template<typename T, typename... Options>
+std::uint64_t Subject<T, Options...>::getVersion() const
+{
+    return Impl::getVersion();
+}
+
+template<typename T, typename... Options>
+bool Subject<T, Options...>::isDirty(ObserverType *observer) const
+{
+    return Impl::isDirty(static_cast<ObserverImpl*>(observer));
+}
+
+template<typename T, typename... Options>
+std::uint64_t Subject<T, Options...>::pull(ObserverType *observer)
+{
+    return Impl::pull(static_cast<ObserverImpl*>(observer));
+}
+
+template<typename T, typename... Options>
+std::size_t Subject<T, Options...>::getDirtyCount() const
+{
+    return Impl::getDirtyCount();
+}
+
+template<typename T, typename... Options>
+std::size_t Subject<T, Options...>::drain(std::size_t max)
+{
+    return Impl::drain(max);
+}
+
+#ifdef OBSERVERPATTERN_INSTRUMENTATION
+template<typename T, typename... Options>
+SubjectStatsSnapshot Subject<T, Options...>::getStats() const
+{
+    return Impl::getStats();
+}
+#endif
+
+#ifdef OBSERVERPATTERN_JOURNAL
+template<typename T, typename... Options>
+void Subject<T, Options...>::setJournalId(std::uint32_t id)
+{
+    Impl::setJournalId(id);
+}
+
+template<typename T, typename... Options>
+std::uint32_t Subject<T, Options...>::getJournalId() const
+{
+    return Impl::getJournalId();
+}
+#endif
+
+template<typename T, typename... Options>
+void Subject<T, Options...>::notify(long msg) const
+{
+    tapped(msg);
+    Impl::notify(msg);
+}
+
+template<typename T, typename... Options>
+void Subject<T, Options...>::notifyBatch(const long *msgs, std::size_t count) const
+{
+    notifyBatch(MessageSpan(msgs, count));
+}
+
+template<typename T, typename... Options>
+void Subject<T, Options...>::notifyBatch(MessageSpan msgs) const
+{
+    if (!msgs.empty())
+    {
+        for (auto it = msgs.begin(); it != msgs.end(); ++it)
+        {
+            tapped(*it);
+        }
+        Impl::notifyBatch(msgs);                                // observers never get an empty batch
+    }
+}
+
+template<typename T, typename... Options>
+void Subject<T, Options...>::notifyAsync(long msg) const
+{
+    tapped(msg);                                                // when queued, not when delivered
+    Impl::notifyAsync(Message(msg));
+}
+
+template<typename T, typename... Options>
+template<typename E>
+typename std::enable_if<IsEventOf<E, typename Subject<T, Options...>::EventTypes>::value>::type
+Subject<T, Options...>::notify(const E &event) const
+{
+    Impl::template notifyEvent<E, &Subject::template deliver<E>>(event);
+}
+
+template<typename T, typename... Options>
+bool Subject<T, Options...>::notifyUntilConsumed(long msg) const
+{
+    tapped(msg);                                                // whether an observer consumes it or not
+    return Impl::notifyUntilConsumed(msg);
+}
+
+template<typename T, typename... Options>
+template<typename E>
+typename std::enable_if<IsEventOf<E, typename Subject<T, Options...>::EventTypes>::value, bool>::type
+Subject<T, Options...>::notifyUntilConsumed(const E &event) const
+{
+    return Impl::template notifyEventUntilConsumed<E, &Subject::template deliver<E>>(event);
+}
+
+template<typename T, typename... Options>
+template<typename E>
+typename std::enable_if<IsEventOf<typename std::decay<E>::type, typename Subject<T, Options...>::EventTypes>::value>::type
+Subject<T, Options...>::notifyAsync(E &&event) const
+{
+    // one copy or move into the message, inline if small, shared by all observers otherwise
+    typedef typename std::decay<E>::type Event;
+    Impl::notifyAsync(Message::of<Event, &Subject::template deliver<Event>>(std::forward<E>(event)));
+}
+
+template<typename T, typename... Options>
+void Subject<T, Options...>::notifyParallel(long msg) const
+{
+    tapped(msg);
+    Impl::notifyParallel(msg);
+}
+
+template<typename T, typename... Options>
+template<typename E>
+typename std::enable_if<IsEventOf<E, typename Subject<T, Options...>::EventTypes>::value>::type
+Subject<T, Options...>::notifyParallel(const E &event) const
+{
+    Impl::template notifyEventParallel<E, &Subject::template deliver<E>>(event);
+}
+
+template<typename T, typename... Options>
+template<typename E>
+bool Subject<T, Options...>::deliver(ObserverImpl *observer, const E &event)
+{
+    // MUST not use reinterpret_cast
+    return static_cast<EventHandler<E>*>(static_cast<ObserverType*>(observer))->update(event);
+}
+
+template<typename T, typename... Options>
+void Subject<T, Options...>::tapped(long msg) const
+{
+    // chosen at compile time, other subjects keep their size and pay nothing
+    tapped(msg, std::integral_constant<bool, std::is_base_of<MessageTap, T>::value>());
+}
+
+template<typename T, typename... Options>
+void Subject<T, Options...>::tapped(long msg, std::true_type) const
+{
+    static_cast<const MessageTap*>(static_cast<const T*>(this))->tap(msg);
+}
+
+template<typename T, typename... Options>
+void Subject<T, Options...>::tapped(long, std::false_type) const {}
+
+
+
+template<typename T, typename... Events>
+Observer<T, Events...>::Observer() {}
+
+template<typename T, typename... Events>
+Observer<T, Events...>::~Observer() 
 {
     // Observer itself MUST not invoke stopObserve in its destrctor,
     // otherwise uninit of base class gets invoked, not that of derived class.
@@ -276,29 +4075,33 @@ Observer<T>::~Observer()
     // otherwise dangling pointer may occur.
 }
 
-template<typename T>
-T* Observer<T>::getSubject() const
+template<typename T, typename... Events>
+T* Observer<T, Events...>::getSubject() const
 {
     // MUST not use reinterpret_cast
-    return static_cast<T*>(static_cast<Subject<T>*>(ObserverImpl::getSubject()));
+    typedef decltype(subjectOf(static_cast<T*>(nullptr))) SubjectPtr;
+    return static_cast<T*>(static_cast<SubjectPtr>(ObserverImpl::getSubject()));
 }
 
-template<typename T>
-bool Observer<T>::startObserve(T *subject) 
+template<typename T, typename... Events>
+bool Observer<T, Events...>::startObserve(T *subject, MessageMask messages, int priority)
 {
+    typedef typename std::remove_pointer<decltype(subjectOf(subject))>::type SubjectType;
+    static_assert(std::is_same<typename SubjectType::EventTypes, EventList<Events...>>::value,
+                  "Observer MUST handle the same events as its Subject");
     // MUST not use reinterpret_cast
-    return ObserverImpl::startObserve(static_cast<SubjectImpl*>(static_cast<Subject<T>*>(subject)));
+    return ObserverImpl::startObserve(static_cast<SubjectImpl*>(subjectOf(subject)), messages, priority);
 }
 
-template<typename T>
-bool Observer<T>::stopObserve(T *subject)
+template<typename T, typename... Events>
+bool Observer<T, Events...>::stopObserve(T *subject)
 {
     // MUST not use reinterpret_cast
-    return ObserverImpl::stopObserve(static_cast<SubjectImpl*>(static_cast<Subject<T>*>(subject)));
+    return ObserverImpl::stopObserve(static_cast<SubjectImpl*>(subjectOf(subject)));
 }
 
-template<typename T>
-void Observer<T>::stopObserve()
+template<typename T, typename... Events>
+void Observer<T, Events...>::stopObserve()
 {
     // Observer itself MUST not invoke stopObserve in its destrctor,
     // otherwise uninit of base class gets invoked, not that of derived class.
@@ -307,16 +4110,23 @@ void Observer<T>::stopObserve()
     ObserverImpl::stopObserve();
 }
 
-template<typename T>
-bool Observer<T>::init()
+template<typename T, typename... Events>
+bool Observer<T, Events...>::init()
 {
     return false;                                               // default do nothing
 }
 
-template<typename T>
-bool Observer<T>::uninit()
+template<typename T, typename... Events>
+bool Observer<T, Events...>::uninit()
 {
     return false;                                               // default do nothing
 }
 
+template<typename T, typename... Events>
+template<typename... Options>
+Subject<T, Options...>* Observer<T, Events...>::subjectOf(Subject<T, Options...> *subject)
+{
+    return subject;                                             // derived-to-base, Options deduced
+}
+
 #endif // OBSERVERPATTERN_HPP
@@ -0,0 +1,219 @@
+#ifndef RATELIMIT_HPP
+#define RATELIMIT_HPP
+
+#include "ObserverPattern.hpp"
+#include "TimerWheel.hpp"
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+
+enum class RateLimit                                            // how a rate-limited observer spaces its receive
+{
+    Throttle,                                                   // at most one receive per interval
+    Debounce                                                    // receive once the subject is quiet for an interval
+};
+
+enum class RateEdge                                             // which end of a burst is received
+{
+    Leading,                                                    // the first message, at once, on the publisher thread
+    Trailing,                                                   // the latest message, at the end, on the thread of the wheel
+    Both                                                        // both, a burst of one message is received once
+};
+
+template<typename T>
+class RateLimitedObserver : public Observer<T>, private WheelTimer // update on every notify, receive at the edges only
+{
+    public:
+        template<typename Rep, typename Period>
+        RateLimitedObserver(RateLimit limit, const std::chrono::duration<Rep, Period> &interval, RateEdge edge = RateEdge::Both,
+                            TimerWheel &wheel = TimerWheel::instance()); // constructor
+        virtual ~RateLimitedObserver();                         // destrctor, virtual
+        bool update(long msg) override final;                   // publisher thread, receive at a leading edge, else hold msg, whether received
+        RateLimit getLimit() const;                             // throttle or debounce
+        RateEdge getEdge() const;                               // edges received
+        std::chrono::nanoseconds getInterval() const;           // length of the interval
+        std::uint64_t getSuppressed() const;                    // messages never received, replaced by a later one or dropped
+
+    protected:
+        virtual void receive(long msg) = 0;                     // react to msg at an edge, pure virtual
+        bool init() override;                                   // open, invoked after start observing
+        bool uninit() override;                                 // close and cancel the timer, invoked before stop observing
+
+    private:
+        RateLimitedObserver(const RateLimitedObserver&) = delete; // disable copy from left value
+        RateLimitedObserver(const RateLimitedObserver&&) = delete; // disable copy from right value
+        RateLimitedObserver& operator=(const RateLimitedObserver&) = delete; // disable assign from left value
+        RateLimitedObserver& operator=(const RateLimitedObserver&&) = delete; // disable assign from right value
+
+        void expired(std::chrono::steady_clock::time_point now) override; // wheel thread, end of interval
+        bool leading() const;                                   // whether the leading edge is received
+        bool trailing() const;                                  // whether the trailing edge is received
+
+        const RateLimit m_limit;                                // throttle or debounce
+        const RateEdge m_edge;                                  // edges received
+        const std::chrono::nanoseconds m_interval;              // length of the interval
+        TimerWheel &m_wheel;                                    // wheel of the timer
+        mutable std::mutex m_lock;                              // guard all below, update and expired may race
+        std::chrono::steady_clock::time_point m_deadline;       // end of the interval, moved by debounce without touching the wheel
+        long m_latest;                                          // latest message held
+        bool m_pending;                                         // m_latest not received yet
+        bool m_armed;                                           // interval running, timer scheduled or expiring
+        bool m_closed;                                          // not observing, nothing scheduled
+        std::uint64_t m_suppressed;                             // messages never received
+};
+
+
+
+template<typename T>
+template<typename Rep, typename Period>
+RateLimitedObserver<T>::RateLimitedObserver(RateLimit limit, const std::chrono::duration<Rep, Period> &interval, RateEdge edge,
+                                            TimerWheel &wheel):
+    m_limit(limit), m_edge(edge), m_interval(std::chrono::duration_cast<std::chrono::nanoseconds>(interval)), m_wheel(wheel),
+    m_latest(0), m_pending(false), m_armed(false), m_closed(false), m_suppressed(0) {}
+
+template<typename T>
+RateLimitedObserver<T>::~RateLimitedObserver()
+{
+    Observer<T>::stopObserve();
+    m_wheel.cancel(this);                                       // expired MUST not run on a destroyed observer
+}
+
+template<typename T>
+bool RateLimitedObserver<T>::update(long msg)
+{
+    const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        if (m_closed)
+        {
+            return false;
+        }
+        if (m_armed)
+        {
+            // inside an interval, only the latest message is kept
+            if (m_pending)
+            {
+                ++m_suppressed;
+            }
+            m_latest = msg;
+            m_pending = true;
+            if (m_limit == RateLimit::Debounce)
+            {
+                m_deadline = now + m_interval;                  // quiet period restarts, the timer catches up when it expires
+            }
+            return false;
+        }
+        // first message of a burst opens an interval, scheduled under the lock so uninit never misses it
+        m_armed = true;
+        m_deadline = now + m_interval;
+        m_wheel.schedule(this, m_deadline);
+        if (!leading())
+        {
+            m_latest = msg;
+            m_pending = true;
+            return false;
+        }
+    }
+    receive(msg);
+    return true;
+}
+
+template<typename T>
+RateLimit RateLimitedObserver<T>::getLimit() const
+{
+    return m_limit;
+}
+
+template<typename T>
+RateEdge RateLimitedObserver<T>::getEdge() const
+{
+    return m_edge;
+}
+
+template<typename T>
+std::chrono::nanoseconds RateLimitedObserver<T>::getInterval() const
+{
+    return m_interval;
+}
+
+template<typename T>
+std::uint64_t RateLimitedObserver<T>::getSuppressed() const
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    return m_suppressed;
+}
+
+template<typename T>
+bool RateLimitedObserver<T>::init()
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    m_closed = false;
+    return true;
+}
+
+template<typename T>
+bool RateLimitedObserver<T>::uninit()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_closed = true;
+        m_pending = false;                                      // a held message is dropped, not received late
+        m_armed = false;
+    }
+    m_wheel.cancel(this);                                       // waits for expired running on the wheel thread
+    return true;
+}
+
+template<typename T>
+void RateLimitedObserver<T>::expired(std::chrono::steady_clock::time_point now)
+{
+    long msg = 0;
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        if (m_closed || !m_armed)
+        {
+            return;
+        }
+        if (m_limit == RateLimit::Debounce && m_deadline > now)
+        {
+            m_wheel.schedule(this, m_deadline);                 // not quiet yet, once per expiry rather than per update
+            return;
+        }
+        const bool deliver = m_pending && trailing();
+        if (m_pending && !deliver)
+        {
+            ++m_suppressed;                                     // leading only, the rest of the burst is dropped
+        }
+        m_pending = false;
+        if (deliver && m_limit == RateLimit::Throttle)
+        {
+            // a trailing receive of a throttle starts the next interval, messages right after it wait
+            m_deadline = now + m_interval;
+            m_wheel.schedule(this, m_deadline);
+        }
+        else
+        {
+            m_armed = false;                                    // the next message opens a new interval
+        }
+        if (!deliver)
+        {
+            return;
+        }
+        msg = m_latest;
+    }
+    receive(msg);
+}
+
+template<typename T>
+bool RateLimitedObserver<T>::leading() const
+{
+    return m_edge != RateEdge::Trailing;
+}
+
+template<typename T>
+bool RateLimitedObserver<T>::trailing() const
+{
+    return m_edge != RateEdge::Leading;
+}
+
+#endif // RATELIMIT_HPP
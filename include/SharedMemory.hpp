@@ -0,0 +1,682 @@
+#ifndef SHAREDMEMORY_HPP
+#define SHAREDMEMORY_HPP
+
+// Linux only, consumers sleep on a futex shared between processes
+
+#if !defined(__linux__)
+#error "SharedMemory.hpp needs Linux"
+#endif
+
+#include "ObserverPattern.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <limits>
+#include <string>
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+enum class SharedRingState                                      // what a consumer knows of the publisher of its ring
+{
+    Detached,                                                   // not attached to a ring
+    Live,                                                       // publisher process running
+    Closed,                                                     // publisher closed the ring, attach again to follow a new one
+    PublisherLost                                               // publisher process died without closing, a new one may take the ring over
+};
+
+class SharedRing                                                // broadcast ring of message ids in POSIX shared memory, publishers in one process, consumers in any
+{
+    public:
+        static const std::size_t MaxConsumers = 64;             // consumers attached at once, over all processes
+
+        SharedRing();                                           // constructor, not open
+        ~SharedRing();                                          // destrctor, close
+        bool create(const char *name, std::size_t capacity);    // publisher, create ring name, or take it over from a dead publisher, false if failed or its publisher is alive
+        bool attach(const char *name);                          // consumer, map ring name and take a consumer slot, false if missing, not ready or full
+        void close();                                           // publisher marks closed, wakes and unlinks, consumer frees its slot, both unmap
+        void push(long msg);                                    // publisher, any thread, lock-free, overwrite the oldest message, wake consumers asleep
+        bool pop(long &msg);                                    // consumer, take the next message, false if none, messages overwritten are skipped and counted
+        template<typename Rep, typename Period>
+        bool wait(const std::chrono::duration<Rep, Period> &timeout); // consumer, sleep until a message is ready, woken, timed out, closed or publisher lost, whether ready
+        void wake();                                            // make wait return now, consumers of the ring in other processes wake spuriously
+        SharedRingState getState() const;                       // consumer, state of the publisher
+        std::size_t getConsumers() const;                       // consumers alive, slots of dead ones are freed
+        std::size_t getCapacity() const;                        // messages kept before the oldest is overwritten
+        std::uint64_t getPushed() const;                        // messages pushed so far, by all publishers of the ring
+        std::uint64_t getLost() const;                          // consumer, messages overwritten before popped
+        bool isOpen() const;                                    // between create or attach and close
+        bool isPublisher() const;                               // opened by create
+
+    private:
+        SharedRing(const SharedRing&) = delete;                 // disable copy from left value
+        SharedRing& operator=(const SharedRing&) = delete;      // disable assign from left value
+
+        static const std::uint64_t Magic = 0x474e5248535f504fULL; // "OP_SHRNG", written last by the creator
+
+        struct Consumer                                         // slot of one consumer
+        {
+            std::atomic<std::uint32_t> m_pid;                   // process of the consumer, 0 if free
+            std::atomic<std::uint32_t> m_sleeping;              // counted in m_sleepers, dropped when a dead consumer is reclaimed
+        };
+
+        struct Header                                           // first bytes of the shared memory, cells follow
+        {
+            std::atomic<std::uint64_t> m_magic;                 // Magic once ready
+            std::uint64_t m_capacity;                           // cells, a power of 2
+            std::atomic<std::uint32_t> m_publisher;             // process of the publisher, 0 once closed
+            std::atomic<std::uint32_t> m_closed;                // closed by the publisher
+            std::atomic<std::uint64_t> m_abandoned;             // positions below were claimed by dead publishers, unwritten ones are skipped
+            char m_pad0[64];                                    // keep the head on its own cache line
+            std::atomic<std::uint64_t> m_head;                  // next position to push
+            char m_pad1[64];
+            std::atomic<std::uint32_t> m_signal;                // futex word, bumped when consumers sleep and a message is pushed
+            std::atomic<std::uint32_t> m_sleepers;              // consumers asleep or about to
+            char m_pad2[64];
+            Consumer m_consumers[MaxConsumers];                 // consumer slots
+        };
+
+        struct Cell                                             // one message, a seqlock
+        {
+            std::atomic<std::uint64_t> m_sequence;              // position + 1 once written, changed while written
+            std::atomic<std::int64_t> m_msg;                    // message id
+        };
+
+        bool map(int file, std::size_t size);                   // map size bytes of file, its whole size if 0, close file, whether mapped
+        bool valid();                                           // whether a ring of this version is mapped, set m_mask
+        bool ready() const;                                     // consumer, whether pop may find a message
+        bool claimSlot();                                       // consumer, take a free slot or one of a dead consumer
+        void reclaim(Consumer &consumer) const;                 // free the slot of a dead consumer
+        void signal();                                          // wake every consumer asleep
+        static bool alive(std::uint32_t pid);                   // whether process pid runs
+        static std::size_t cellsOffset();                       // bytes before the first cell
+        static std::chrono::nanoseconds livenessInterval();     // longest sleep before the publisher is checked
+        static long futex(std::atomic<std::uint32_t> *word, int op, std::uint32_t value, const timespec *timeout);
+
+        std::string m_name;                                     // name of the shared memory
+        void *m_map;                                            // shared memory mapped, nullptr if not open
+        std::size_t m_mapSize;                                  // bytes mapped
+        Header *m_header;                                       // header of the ring
+        Cell *m_cells;                                          // cells of the ring
+        std::uint64_t m_mask;                                   // capacity - 1
+        bool m_publisher;                                       // opened by create
+        Consumer *m_slot;                                       // slot of this consumer, nullptr for the publisher
+        std::uint64_t m_cursor;                                 // consumer, next position to pop
+        std::uint64_t m_lost;                                   // consumer, messages overwritten before popped
+        std::atomic<bool> m_woken;                              // wake invoked
+};
+
+template<typename T, typename... Options>
+class SharedMemorySubject : public Subject<T, Options...>, public MessageTap // every message id notified is also pushed to a shared ring, for observers in other processes
+{
+    public:
+        SharedMemorySubject();                                  // constructor, not published
+        virtual ~SharedMemorySubject() = 0;                     // destrctor, pure virtual, unpublish
+        bool publish(const char *name, std::size_t capacity = 4096); // push every notify to ring name from now on, take it over if its publisher died, false if failed
+        void unpublish();                                       // close the ring, consumers see it closed
+        bool isPublished() const;                               // between publish and unpublish
+        std::size_t getConsumers() const;                       // consumers attached and alive
+
+    private:
+        SharedMemorySubject(const SharedMemorySubject&) = delete; // disable copy from left value
+        SharedMemorySubject(const SharedMemorySubject&&) = delete; // disable copy from right value
+        SharedMemorySubject& operator=(const SharedMemorySubject&) = delete; // disable assign from left value
+        SharedMemorySubject& operator=(const SharedMemorySubject&&) = delete; // disable assign from right value
+
+        void tap(long msg) const override;                      // push msg to the ring if published, before local observers get it
+
+        mutable SharedRing m_ring;                              // ring published to, MUST not be opened or closed during notify
+};
+
+class SharedMemoryProxy                                         // in a consumer process, dispatches the messages of a shared ring to a local subject
+{
+    public:
+        typedef std::function<void(long msg)> Target;           // receives the messages of the ring
+
+        SharedMemoryProxy();                                    // constructor, not open
+        ~SharedMemoryProxy();                                   // destrctor, close
+        bool open(const char *name);                            // attach to ring name, messages pushed from now on, false if missing, not ready or full
+        void close();                                           // detach, binding kept
+        void bind(Target target);                               // dispatch into target
+        template<typename T, typename... Options>
+        void bind(const Subject<T, Options...> *subject);       // dispatch as notify on subject, its observers update as if it notified
+        std::size_t dispatch(std::size_t max = std::numeric_limits<std::size_t>::max()); // invoke the target with up to max messages, number dispatched
+        template<typename Rep, typename Period>
+        std::size_t waitAndDispatch(const std::chrono::duration<Rep, Period> &timeout,
+                                    std::size_t max = std::numeric_limits<std::size_t>::max()); // sleep until a message is pushed, then dispatch
+        void wake();                                            // make waitAndDispatch return now, e.g. to stop the consumer thread
+        SharedRingState getState() const;                       // state of the publisher, waitAndDispatch returns 0 unless Live
+        std::uint64_t getLost() const;                          // messages overwritten before dispatched
+
+    private:
+        SharedMemoryProxy(const SharedMemoryProxy&) = delete;   // disable copy from left value
+        SharedMemoryProxy& operator=(const SharedMemoryProxy&) = delete; // disable assign from left value
+
+        SharedRing m_ring;                                      // ring attached to
+        Target m_target;                                        // receives the messages, empty if not bound
+};
+
+
+
+inline SharedRing::SharedRing():
+    m_map(nullptr), m_mapSize(0), m_header(nullptr), m_cells(nullptr), m_mask(0), m_publisher(false), m_slot(nullptr),
+    m_cursor(0), m_lost(0), m_woken(false) {}
+
+inline SharedRing::~SharedRing()
+{
+    close();
+}
+
+inline bool SharedRing::create(const char *name, std::size_t capacity)
+{
+    if (m_map || !name || capacity == 0)
+    {
+        return false;                                           // already open or invalid argument
+    }
+
+    std::uint64_t cells = 2;                                    // the ring needs two cells at least
+    while (cells < capacity)
+    {
+        cells <<= 1;
+    }
+    const std::size_t size = cellsOffset() + static_cast<std::size_t>(cells) * sizeof(Cell);
+    const std::uint32_t self = static_cast<std::uint32_t>(::getpid());
+    int file = ::shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (file >= 0)
+    {
+        // new ring, zero filled by ftruncate, consumers wait for the magic
+        if (::ftruncate(file, static_cast<off_t>(size)) != 0)
+        {
+            ::close(file);
+            ::shm_unlink(name);
+            return false;
+        }
+        if (!map(file, size))
+        {
+            ::shm_unlink(name);
+            return false;
+        }
+        m_header->m_capacity = cells;
+        m_header->m_publisher.store(self);
+        m_header->m_magic.store(Magic);
+        m_mask = cells - 1;
+    }
+    else
+    {
+        // existing ring, taken over only if its publisher died without closing
+        file = errno == EEXIST ? ::shm_open(name, O_RDWR, 0600) : -1;
+        if (file < 0 || !map(file, 0) || !valid())
+        {
+            close();
+            return false;                                       // not a ring of this version, or its creator has not finished
+        }
+        std::uint32_t previous = m_header->m_publisher.load();
+        if ((previous && alive(previous)) || !m_header->m_publisher.compare_exchange_strong(previous, self))
+        {
+            close();
+            return false;                                       // publisher alive, or another process took it over first
+        }
+        // order matters, m_abandoned MUST be set before the first push of the new publisher
+        m_header->m_abandoned.store(m_header->m_head.load());
+        m_header->m_closed.store(0);
+        for (std::size_t i = 0; i < MaxConsumers; ++i)
+        {
+            reclaim(m_header->m_consumers[i]);
+        }
+    }
+    m_name = name;
+    m_publisher = true;
+    return true;
+}
+
+inline bool SharedRing::attach(const char *name)
+{
+    if (m_map || !name)
+    {
+        return false;                                           // already open or invalid argument
+    }
+
+    const int file = ::shm_open(name, O_RDWR, 0600);
+    if (file < 0 || !map(file, 0) || !valid())
+    {
+        close();
+        return false;                                           // missing, or its creator has not finished
+    }
+    if (!claimSlot())
+    {
+        close();
+        return false;                                           // as many consumers as slots
+    }
+    m_name = name;
+    m_cursor = m_header->m_head.load();                         // messages pushed before are not seen
+    m_lost = 0;
+    return true;
+}
+
+inline void SharedRing::close()
+{
+    if (!m_map)
+    {
+        return;                                                 // not open
+    }
+
+    if (m_publisher)
+    {
+        std::uint32_t self = static_cast<std::uint32_t>(::getpid());
+        if (m_header->m_publisher.compare_exchange_strong(self, 0))
+        {
+            m_header->m_closed.store(1);
+            signal();                                           // consumers asleep see it closed
+            ::shm_unlink(m_name.c_str());                       // mapped consumers keep the memory, a new publisher gets a new ring
+        }
+    }
+    else if (m_slot)
+    {
+        if (m_slot->m_sleeping.exchange(0))
+        {
+            m_header->m_sleepers.fetch_sub(1);
+        }
+        m_slot->m_pid.store(0);
+    }
+    ::munmap(m_map, m_mapSize);
+    m_map = nullptr;
+    m_mapSize = 0;
+    m_header = nullptr;
+    m_cells = nullptr;
+    m_mask = 0;
+    m_publisher = false;
+    m_slot = nullptr;
+    m_name.clear();
+}
+
+inline void SharedRing::push(long msg)
+{
+    // seqlock per cell, a consumer that reads while the cell is rewritten sees the sequence change
+    const std::uint64_t position = m_header->m_head.fetch_add(1);
+    Cell &cell = m_cells[position & m_mask];
+    cell.m_sequence.store(0);
+    cell.m_msg.store(msg);
+    cell.m_sequence.store(position + 1);
+    // order matters, the sequence MUST be stored before m_sleepers is loaded,
+    // a consumer raises m_sleepers before it checks the cell
+    if (m_header->m_sleepers.load())
+    {
+        signal();                                               // no system call while every consumer is busy
+    }
+}
+
+inline bool SharedRing::pop(long &msg)
+{
+    for (;;)
+    {
+        Cell &cell = m_cells[m_cursor & m_mask];
+        const std::uint64_t sequence = cell.m_sequence.load();
+        if (sequence == m_cursor + 1)
+        {
+            const std::int64_t value = cell.m_msg.load();
+            if (cell.m_sequence.load() != sequence)
+            {
+                continue;                                       // rewritten while read, lapped
+            }
+            msg = static_cast<long>(value);
+            ++m_cursor;
+            return true;
+        }
+        if (sequence > m_cursor + 1)
+        {
+            // lapped by the publisher, resume at the oldest message still in the ring
+            const std::uint64_t head = m_header->m_head.load();
+            const std::uint64_t oldest = head > m_mask + 1 ? head - (m_mask + 1) : 0;
+            const std::uint64_t next = oldest > m_cursor ? oldest : m_cursor + 1;
+            m_lost += next - m_cursor;
+            m_cursor = next;
+            continue;
+        }
+        if (m_cursor < m_header->m_abandoned.load())
+        {
+            ++m_lost;                                           // claimed by a publisher that died before writing it
+            ++m_cursor;
+            continue;
+        }
+        return false;                                           // not pushed yet, or being written
+    }
+}
+
+template<typename Rep, typename Period>
+bool SharedRing::wait(const std::chrono::duration<Rep, Period> &timeout)
+{
+    const std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + timeout;
+    // order matters, m_sleepers MUST be raised before the cell is checked,
+    // a publisher stores the cell before it checks m_sleepers
+    m_header->m_sleepers.fetch_add(1);
+    m_slot->m_sleeping.store(1);
+    bool woken = false;
+    while (!ready() && !(woken = m_woken.exchange(false)) && getState() == SharedRingState::Live)
+    {
+        const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        if (now >= deadline)
+        {
+            break;
+        }
+        // a publisher dying while consumers sleep never wakes them, sleep in slices to check it
+        const std::uint32_t signal = m_header->m_signal.load();
+        if (ready())
+        {
+            break;
+        }
+        const std::chrono::nanoseconds slice = std::min<std::chrono::nanoseconds>(deadline - now, livenessInterval());
+        timespec relative;
+        relative.tv_sec = static_cast<time_t>(slice.count() / 1000000000);
+        relative.tv_nsec = static_cast<long>(slice.count() % 1000000000);
+        futex(&m_header->m_signal, FUTEX_WAIT, signal, &relative); // returns at once if a push bumped m_signal
+    }
+    if (m_slot->m_sleeping.exchange(0))
+    {
+        m_header->m_sleepers.fetch_sub(1);
+    }
+    return !woken && ready();
+}
+
+inline void SharedRing::wake()
+{
+    m_woken.store(true);
+    if (m_header)
+    {
+        signal();
+    }
+}
+
+inline SharedRingState SharedRing::getState() const
+{
+    if (!m_map)
+    {
+        return SharedRingState::Detached;
+    }
+    const std::uint32_t publisher = m_header->m_publisher.load();
+    if (m_header->m_closed.load() || !publisher)
+    {
+        return SharedRingState::Closed;
+    }
+    // a pid reused by another process reads as alive, liveness is a hint
+    return alive(publisher) ? SharedRingState::Live : SharedRingState::PublisherLost;
+}
+
+inline std::size_t SharedRing::getConsumers() const
+{
+    if (!m_map)
+    {
+        return 0;
+    }
+    std::size_t count = 0;
+    for (std::size_t i = 0; i < MaxConsumers; ++i)
+    {
+        Consumer &consumer = m_header->m_consumers[i];
+        reclaim(consumer);
+        count += consumer.m_pid.load() != 0;
+    }
+    return count;
+}
+
+inline std::size_t SharedRing::getCapacity() const
+{
+    return m_map ? static_cast<std::size_t>(m_mask + 1) : 0;
+}
+
+inline std::uint64_t SharedRing::getPushed() const
+{
+    return m_map ? m_header->m_head.load() : 0;
+}
+
+inline std::uint64_t SharedRing::getLost() const
+{
+    return m_lost;
+}
+
+inline bool SharedRing::isOpen() const
+{
+    return m_map != nullptr;
+}
+
+inline bool SharedRing::isPublisher() const
+{
+    return m_publisher;
+}
+
+inline bool SharedRing::map(int file, std::size_t size)
+{
+    struct stat status;
+    if (!size && ::fstat(file, &status) == 0)
+    {
+        size = static_cast<std::size_t>(status.st_size);        // 0 while the creator has not sized it yet
+    }
+    void *map = size >= cellsOffset() ? ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, file, 0) : MAP_FAILED;
+    ::close(file);                                              // the mapping stays valid
+    if (map == MAP_FAILED)
+    {
+        return false;
+    }
+    m_map = map;
+    m_mapSize = size;
+    m_header = static_cast<Header*>(map);
+    m_cells = reinterpret_cast<Cell*>(static_cast<char*>(map) + cellsOffset());
+    return true;
+}
+
+inline bool SharedRing::valid()
+{
+    // order matters, the creator writes the magic last
+    if (m_header->m_magic.load() != Magic)
+    {
+        return false;
+    }
+    const std::uint64_t capacity = m_header->m_capacity;
+    if (capacity < 2 || (capacity & (capacity - 1)) || cellsOffset() + capacity * sizeof(Cell) > m_mapSize)
+    {
+        return false;
+    }
+    m_mask = capacity - 1;
+    return true;
+}
+
+inline bool SharedRing::ready() const
+{
+    const std::uint64_t sequence = m_cells[m_cursor & m_mask].m_sequence.load();
+    return sequence >= m_cursor + 1 || m_cursor < m_header->m_abandoned.load();
+}
+
+inline bool SharedRing::claimSlot()
+{
+    const std::uint32_t self = static_cast<std::uint32_t>(::getpid());
+    for (std::size_t i = 0; i < MaxConsumers; ++i)
+    {
+        Consumer &consumer = m_header->m_consumers[i];
+        reclaim(consumer);
+        std::uint32_t free = 0;
+        if (consumer.m_pid.compare_exchange_strong(free, self))
+        {
+            m_slot = &consumer;
+            return true;
+        }
+    }
+    return false;
+}
+
+inline void SharedRing::reclaim(Consumer &consumer) const
+{
+    std::uint32_t pid = consumer.m_pid.load();
+    if (!pid || alive(pid))
+    {
+        return;
+    }
+    // a consumer killed in wait leaves m_sleepers raised, pushes would wake nobody forever
+    if (consumer.m_sleeping.exchange(0))
+    {
+        m_header->m_sleepers.fetch_sub(1);
+    }
+    consumer.m_pid.compare_exchange_strong(pid, 0);
+}
+
+inline void SharedRing::signal()
+{
+    m_header->m_signal.fetch_add(1);
+    futex(&m_header->m_signal, FUTEX_WAKE, INT_MAX, nullptr);
+}
+
+inline bool SharedRing::alive(std::uint32_t pid)
+{
+    return ::kill(static_cast<pid_t>(pid), 0) == 0 || errno == EPERM;
+}
+
+inline std::size_t SharedRing::cellsOffset()
+{
+    return (sizeof(Header) + 63) / 64 * 64;
+}
+
+inline std::chrono::nanoseconds SharedRing::livenessInterval()
+{
+    return std::chrono::milliseconds(100);
+}
+
+inline long SharedRing::futex(std::atomic<std::uint32_t> *word, int op, std::uint32_t value, const timespec *timeout)
+{
+    // not FUTEX_PRIVATE_FLAG, the word is shared between processes
+    return ::syscall(SYS_futex, reinterpret_cast<std::uint32_t*>(word), op, value, timeout, nullptr, 0);
+}
+
+
+
+template<typename T, typename... Options>
+SharedMemorySubject<T, Options...>::SharedMemorySubject() {}
+
+template<typename T, typename... Options>
+SharedMemorySubject<T, Options...>::~SharedMemorySubject()
+{
+    unpublish();
+}
+
+template<typename T, typename... Options>
+bool SharedMemorySubject<T, Options...>::publish(const char *name, std::size_t capacity)
+{
+    unpublish();
+    return m_ring.create(name, capacity);
+}
+
+template<typename T, typename... Options>
+void SharedMemorySubject<T, Options...>::unpublish()
+{
+    m_ring.close();
+}
+
+template<typename T, typename... Options>
+bool SharedMemorySubject<T, Options...>::isPublished() const
+{
+    return m_ring.isOpen();
+}
+
+template<typename T, typename... Options>
+std::size_t SharedMemorySubject<T, Options...>::getConsumers() const
+{
+    return m_ring.getConsumers();
+}
+
+template<typename T, typename... Options>
+void SharedMemorySubject<T, Options...>::tap(long msg) const
+{
+    // pushed first, remote observers never wait for local updates,
+    // every notify entry point of Subject taps, also through Subject<T, Options...>*
+    if (m_ring.isOpen())
+    {
+        m_ring.push(msg);
+    }
+}
+
+
+
+inline SharedMemoryProxy::SharedMemoryProxy() {}
+
+inline SharedMemoryProxy::~SharedMemoryProxy()
+{
+    close();
+}
+
+inline bool SharedMemoryProxy::open(const char *name)
+{
+    close();
+    return m_ring.attach(name);
+}
+
+inline void SharedMemoryProxy::close()
+{
+    m_ring.close();
+}
+
+inline void SharedMemoryProxy::bind(Target target)
+{
+    m_target = std::move(target);
+}
+
+template<typename T, typename... Options>
+void SharedMemoryProxy::bind(const Subject<T, Options...> *subject)
+{
+    // notify is protected, Subject befriends SharedMemoryProxy
+    m_target = [subject](long msg) { subject->notify(msg); };
+}
+
+inline std::size_t SharedMemoryProxy::dispatch(std::size_t max)
+{
+    if (!m_ring.isOpen())
+    {
+        return 0;
+    }
+    std::size_t count = 0;
+    long msg = 0;
+    while (count < max && m_ring.pop(msg))
+    {
+        ++count;
+        if (m_target)
+        {
+            m_target(msg);                                      // not bound, messages are dropped
+        }
+    }
+    return count;
+}
+
+template<typename Rep, typename Period>
+std::size_t SharedMemoryProxy::waitAndDispatch(const std::chrono::duration<Rep, Period> &timeout, std::size_t max)
+{
+    const std::size_t count = dispatch(max);
+    if (count || !m_ring.isOpen())
+    {
+        return count;                                           // busy, no wait
+    }
+    m_ring.wait(timeout);
+    return dispatch(max);
+}
+
+inline void SharedMemoryProxy::wake()
+{
+    m_ring.wake();
+}
+
+inline SharedRingState SharedMemoryProxy::getState() const
+{
+    return m_ring.getState();
+}
+
+inline std::uint64_t SharedMemoryProxy::getLost() const
+{
+    return m_ring.getLost();
+}
+
+#endif // SHAREDMEMORY_HPP
@@ -0,0 +1,134 @@
+#ifndef STATICSUBJECT_HPP
+#define STATICSUBJECT_HPP
+
+#include <cstddef>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+template<typename O, typename T, typename E>
+class HasStaticUpdate                                           // whether O has bool update(T&, const E&)
+{
+    private:
+        template<typename U>
+        static auto test(int) -> decltype(std::declval<U&>().update(std::declval<T&>(), std::declval<const E&>()), std::true_type());
+        template<typename U>
+        static std::false_type test(...);
+
+    public:
+        static const bool value = decltype(test<O>(0))::value;
+};
+
+template<typename O, typename T, typename E, bool = HasStaticUpdate<O, T, E>::value>
+struct StaticUpdate                                             // invoke update of O, skipped if O does not handle E
+{
+    static const bool nothrow = true;
+    static void invoke(O&, T&, const E&) noexcept {}
+};
+
+template<typename O, typename T, typename E>
+struct StaticUpdate<O, T, E, true>
+{
+    static const bool nothrow = noexcept(std::declval<O&>().update(std::declval<T&>(), std::declval<const E&>()));
+    static void invoke(O &observer, T &subject, const E &event) noexcept(nothrow)
+    {
+        observer.update(subject, event);                        // not virtual, inlined into notify
+    }
+};
+
+template<typename T, typename E, typename... Observers>
+struct StaticNothrow;                                           // whether all updates of Observers for E are noexcept
+
+template<typename T, typename E>
+struct StaticNothrow<T, E> : std::true_type {};
+
+template<typename T, typename E, typename O, typename... Rest>
+struct StaticNothrow<T, E, O, Rest...> :
+    std::integral_constant<bool, StaticUpdate<O, T, E>::nothrow && StaticNothrow<T, E, Rest...>::value> {};
+
+template<std::size_t I, std::size_t N>
+struct StaticDispatch                                           // unrolled loop over the observers, in order
+{
+    template<typename Tuple, typename T, typename E>
+    static void notify(Tuple &observers, T &subject, const E &event)
+        noexcept(noexcept(StaticUpdate<typename std::tuple_element<I, Tuple>::type, T, E>::invoke(std::get<I>(observers), subject, event))
+                 && noexcept(StaticDispatch<I + 1, N>::notify(observers, subject, event)))
+    {
+        StaticUpdate<typename std::tuple_element<I, Tuple>::type, T, E>::invoke(std::get<I>(observers), subject, event);
+        StaticDispatch<I + 1, N>::notify(observers, subject, event);
+    }
+};
+
+template<std::size_t N>
+struct StaticDispatch<N, N>
+{
+    template<typename Tuple, typename T, typename E>
+    static void notify(Tuple&, T&, const E&) noexcept {}
+};
+
+template<typename T, typename... Observers>
+class StaticSubject                                             // fixed set of observers, known at compile time
+{
+    public:
+        typedef std::tuple<Observers...> ObserverTuple;         // observers, held by value
+
+        constexpr StaticSubject();                              // constructor, observers default constructed
+        explicit constexpr StaticSubject(const Observers&... observers); // constructor, observers copied
+        template<std::size_t I>
+        typename std::tuple_element<I, ObserverTuple>::type& getObserver(); // I-th observer
+        template<std::size_t I>
+        constexpr const typename std::tuple_element<I, ObserverTuple>::type& getObserver() const; // I-th observer
+        static constexpr std::size_t size();                    // number of observers
+
+    protected:
+        ~StaticSubject() = default;                             // destrctor, not virtual, no deletion through base, trivial so a literal type
+        void notify(long msg) noexcept(StaticNothrow<T, long, Observers...>::value); // notify all observers handling long
+        template<typename E>
+        void notify(const E &event) noexcept(StaticNothrow<T, E, Observers...>::value); // notify all observers handling E
+
+    private:
+        ObserverTuple m_observers;                              // observers, no heap allocation
+};
+
+
+
+template<typename T, typename... Observers>
+constexpr StaticSubject<T, Observers...>::StaticSubject(): m_observers() {}
+
+template<typename T, typename... Observers>
+constexpr StaticSubject<T, Observers...>::StaticSubject(const Observers&... observers): m_observers(observers...) {}
+
+template<typename T, typename... Observers>
+template<std::size_t I>
+typename std::tuple_element<I, std::tuple<Observers...>>::type& StaticSubject<T, Observers...>::getObserver()
+{
+    return std::get<I>(m_observers);
+}
+
+template<typename T, typename... Observers>
+template<std::size_t I>
+constexpr const typename std::tuple_element<I, std::tuple<Observers...>>::type& StaticSubject<T, Observers...>::getObserver() const
+{
+    return std::get<I>(m_observers);
+}
+
+template<typename T, typename... Observers>
+constexpr std::size_t StaticSubject<T, Observers...>::size()
+{
+    return sizeof...(Observers);
+}
+
+template<typename T, typename... Observers>
+void StaticSubject<T, Observers...>::notify(long msg) noexcept(StaticNothrow<T, long, Observers...>::value)
+{
+    StaticDispatch<0, sizeof...(Observers)>::notify(m_observers, static_cast<T&>(*this), msg);
+}
+
+template<typename T, typename... Observers>
+template<typename E>
+void StaticSubject<T, Observers...>::notify(const E &event) noexcept(StaticNothrow<T, E, Observers...>::value)
+{
+    StaticDispatch<0, sizeof...(Observers)>::notify(m_observers, static_cast<T&>(*this), event);
+}
+
+#endif // STATICSUBJECT_HPP
@@ -0,0 +1,268 @@
+#ifndef SUBSCRIPTIONGRAPH_HPP
+#define SUBSCRIPTIONGRAPH_HPP
+
+#include "ObserverPattern.hpp"
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+
+struct SubscriptionRecord                                       // one observer of a subject, fixed size
+{
+    std::uint64_t m_messages;                                   // MessageMask bits
+    std::uint32_t m_subject;                                    // id of the subject
+    std::uint32_t m_observer;                                   // id of the observer
+    std::int32_t m_priority;                                    // order among observers of the subject
+    std::uint32_t m_reserved;                                   // 0
+};
+
+struct SubscriptionHeader                                       // first bytes of a saved graph, records follow
+{
+    char m_magic[8];                                            // "OPWIRE1", with the terminating 0
+    std::uint32_t m_recordSize;                                 // sizeof(SubscriptionRecord)
+    std::uint32_t m_reserved;                                   // 0
+    std::uint64_t m_records;                                    // records in the file
+};
+
+class SubscriptionGraph                                         // subjects and observers by id, wired in bulk, saved and restored in linear time
+{
+    public:
+        SubscriptionGraph();                                    // constructor, nothing registered
+        template<typename T, typename... Options>
+        bool addSubject(std::uint32_t id, Subject<T, Options...> *subject); // register subject as id, false if nullptr or id taken
+        template<typename T, typename... Events>
+        bool addObserver(std::uint32_t id, Observer<T, Events...> *observer); // register observer as id, false if nullptr, id taken or registered
+        bool connect(std::uint32_t subject, std::uint32_t observer, MessageMask messages = MessageMask(), int priority = 0); // queue observer for subject, false if an id is unknown or the types differ
+        std::size_t wire(ObserverInit init = ObserverInit::Immediate); // add the queued observers, one bulk add per subject, number added
+        std::size_t initObservers();                            // init observers of registered subjects added with ObserverInit::Deferred, number initialized
+        std::vector<SubscriptionRecord> snapshot() const;       // observers of registered subjects by subject id, in notify order, unregistered ones skipped
+        std::size_t restore(const std::vector<SubscriptionRecord> &records, ObserverInit init = ObserverInit::Immediate); // connect and wire records, unknown ids skipped, number added
+        bool save(const char *path) const;                      // write snapshot to path, false if failed
+        std::size_t load(const char *path, ObserverInit init = ObserverInit::Immediate); // restore a file written by save, number added, 0 if missing or not a graph
+        std::size_t getPending() const;                         // observers connected, not wired yet
+
+    private:
+        SubscriptionGraph(const SubscriptionGraph&) = delete;   // disable copy from left value
+        SubscriptionGraph& operator=(const SubscriptionGraph&) = delete; // disable assign from left value
+
+        struct SubjectEntry                                     // one registered subject
+        {
+            SubjectImpl *m_subject;                             // the subject
+            const void *m_type;                                 // key of its observer type
+        };
+        struct ObserverEntry                                    // one registered observer
+        {
+            ObserverImpl *m_observer;                           // the observer
+            const void *m_type;                                 // key of its type
+        };
+
+        std::vector<std::uint32_t> subjectIds() const;          // ids of subjects in ascending order, the same order on every run
+        template<typename O>
+        static const void* typeOf();                            // key of type O, without RTTI
+
+        std::unordered_map<std::uint32_t, SubjectEntry> m_subjects; // subjects by id, MUST outlive the graph
+        std::unordered_map<std::uint32_t, ObserverEntry> m_observers; // observers by id, MUST outlive the graph
+        std::unordered_map<const ObserverImpl*, std::uint32_t> m_ids; // ids of observers, for snapshot
+        std::vector<SubscriptionRecord> m_pending;              // connected, not wired yet, in connect order
+};
+
+
+
+inline SubscriptionGraph::SubscriptionGraph() {}
+
+template<typename T, typename... Options>
+bool SubscriptionGraph::addSubject(std::uint32_t id, Subject<T, Options...> *subject)
+{
+    if (!subject || m_subjects.count(id))
+    {
+        return false;                                           // nullptr or id taken
+    }
+    const SubjectEntry registered = { static_cast<SubjectImpl*>(subject), typeOf<typename Subject<T, Options...>::ObserverType>() };
+    m_subjects[id] = registered;
+    return true;
+}
+
+template<typename T, typename... Events>
+bool SubscriptionGraph::addObserver(std::uint32_t id, Observer<T, Events...> *observer)
+{
+    if (!observer || m_observers.count(id) || m_ids.count(static_cast<ObserverImpl*>(observer)))
+    {
+        return false;                                           // nullptr, id taken or registered under another id
+    }
+    const ObserverEntry registered = { static_cast<ObserverImpl*>(observer), typeOf<Observer<T, Events...>>() };
+    m_observers[id] = registered;
+    m_ids[registered.m_observer] = id;
+    return true;
+}
+
+inline bool SubscriptionGraph::connect(std::uint32_t subject, std::uint32_t observer, MessageMask messages, int priority)
+{
+    auto s = m_subjects.find(subject);
+    auto o = m_observers.find(observer);
+    if (s == m_subjects.end() || o == m_observers.end() || s->second.m_type != o->second.m_type)
+    {
+        return false;                                           // unknown id, or an observer of another subject type
+    }
+    const SubscriptionRecord record = { messages.bits(), subject, observer, priority, 0 };
+    m_pending.push_back(record);
+    return true;
+}
+
+inline std::size_t SubscriptionGraph::wire(ObserverInit init)
+{
+    // grouped by subject in connect order, each subject then attaches all of its observers in one pass
+    std::vector<SubscriptionRecord> pending;
+    pending.swap(m_pending);
+    std::unordered_map<SubjectImpl*, std::vector<SubjectImpl::Subscribed>> observers;
+    std::vector<SubjectImpl*> order;
+    for (auto it = pending.begin(); it != pending.end(); ++it)
+    {
+        SubjectImpl *subject = m_subjects[it->m_subject].m_subject;
+        std::vector<SubjectImpl::Subscribed> &added = observers[subject];
+        if (added.empty())
+        {
+            order.push_back(subject);
+        }
+        const SubjectImpl::Subscribed subscribed = { m_observers[it->m_observer].m_observer, it->m_messages, it->m_priority };
+        added.push_back(subscribed);
+    }
+    std::size_t count = 0;
+    for (auto it = order.begin(); it != order.end(); ++it)
+    {
+        count += (*it)->addAll(observers[*it], init);
+    }
+    return count;
+}
+
+inline std::size_t SubscriptionGraph::initObservers()
+{
+    const std::vector<std::uint32_t> ids = subjectIds();
+    std::size_t count = 0;
+    for (auto it = ids.begin(); it != ids.end(); ++it)
+    {
+        count += m_subjects.find(*it)->second.m_subject->initObservers();
+    }
+    return count;
+}
+
+inline std::vector<SubscriptionRecord> SubscriptionGraph::snapshot() const
+{
+    const std::vector<std::uint32_t> ids = subjectIds();        // same file for the same graph
+    std::vector<SubscriptionRecord> records;
+    std::vector<SubjectImpl::Subscribed> observers;
+    for (auto id = ids.begin(); id != ids.end(); ++id)
+    {
+        observers.clear();
+        m_subjects.find(*id)->second.m_subject->subscriptions(observers);
+        for (auto it = observers.begin(); it != observers.end(); ++it)
+        {
+            auto observer = m_ids.find(it->m_observer);
+            if (observer == m_ids.end())
+            {
+                continue;                                       // not registered, cannot be found on restore
+            }
+            const SubscriptionRecord record = { it->m_messages, *id, observer->second, it->m_priority, 0 };
+            records.push_back(record);
+        }
+    }
+    return records;
+}
+
+inline std::size_t SubscriptionGraph::restore(const std::vector<SubscriptionRecord> &records, ObserverInit init)
+{
+    // in notify order already, so a serial subject appends without sorting
+    m_pending.reserve(m_pending.size() + records.size());
+    for (auto it = records.begin(); it != records.end(); ++it)
+    {
+        connect(it->m_subject, it->m_observer, MessageMask::fromBits(it->m_messages), it->m_priority);
+    }
+    return wire(init);
+}
+
+inline bool SubscriptionGraph::save(const char *path) const
+{
+    if (!path)
+    {
+        return false;                                           // nullptr, invalid argument
+    }
+
+    const std::vector<SubscriptionRecord> records = snapshot();
+    std::FILE *file = std::fopen(path, "wb");
+    if (!file)
+    {
+        return false;
+    }
+    SubscriptionHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.m_magic, "OPWIRE1", 8);
+    header.m_recordSize = sizeof(SubscriptionRecord);
+    header.m_records = records.size();
+    bool written = std::fwrite(&header, sizeof(header), 1, file) == 1;
+    if (written && !records.empty())
+    {
+        written = std::fwrite(records.data(), sizeof(SubscriptionRecord), records.size(), file) == records.size();
+    }
+    return std::fclose(file) == 0 && written;
+}
+
+inline std::size_t SubscriptionGraph::load(const char *path, ObserverInit init)
+{
+    if (!path)
+    {
+        return 0;                                               // nullptr, invalid argument
+    }
+
+    std::FILE *file = std::fopen(path, "rb");
+    if (!file)
+    {
+        return 0;
+    }
+    SubscriptionHeader header;
+    std::vector<SubscriptionRecord> records;
+    bool valid = std::fread(&header, sizeof(header), 1, file) == 1 && std::memcmp(header.m_magic, "OPWIRE1", 8) == 0 &&
+                 header.m_recordSize == sizeof(SubscriptionRecord);
+    if (valid)
+    {
+        // one read for all records, the count is trusted only as far as the file goes
+        std::fseek(file, 0, SEEK_END);
+        const long size = std::ftell(file);
+        valid = size >= 0 && header.m_records <= (static_cast<std::uint64_t>(size) - sizeof(header)) / sizeof(SubscriptionRecord);
+        if (valid)
+        {
+            records.resize(static_cast<std::size_t>(header.m_records));
+            std::fseek(file, sizeof(header), SEEK_SET);
+            valid = records.empty() || std::fread(records.data(), sizeof(SubscriptionRecord), records.size(), file) == records.size();
+        }
+    }
+    std::fclose(file);
+    return valid ? restore(records, init) : 0;
+}
+
+inline std::size_t SubscriptionGraph::getPending() const
+{
+    return m_pending.size();
+}
+
+inline std::vector<std::uint32_t> SubscriptionGraph::subjectIds() const
+{
+    std::vector<std::uint32_t> ids;
+    ids.reserve(m_subjects.size());
+    for (auto it = m_subjects.begin(); it != m_subjects.end(); ++it)
+    {
+        ids.push_back(it->first);
+    }
+    std::sort(ids.begin(), ids.end());
+    return ids;
+}
+
+template<typename O>
+const void* SubscriptionGraph::typeOf()
+{
+    static const char key = 0;                                  // one per type O
+    return &key;
+}
+
+#endif // SUBSCRIPTIONGRAPH_HPP
@@ -0,0 +1,247 @@
+#ifndef THREADPOOL_HPP
+#define THREADPOOL_HPP
+
+#include <vector>
+#include <deque>
+#include <memory>
+#include <functional>
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+#include <thread>
+
+class Executor                                                  // runs tasks, interface
+{
+    public:
+        virtual ~Executor();                                    // destrctor, virtual
+        virtual void execute(std::function<void()> task) = 0;   // run task some time later, pure virtual
+};
+
+class ThreadPool : public Executor                              // work-stealing thread pool
+{
+    public:
+        typedef std::function<void(std::exception_ptr error)> ErrorHandler; // receives the exception of a task, on its worker thread
+
+        explicit ThreadPool(unsigned threads = 0);              // constructor, 0 for one thread per core
+        virtual ~ThreadPool();                                  // destrctor, run pending tasks then join
+        void execute(std::function<void()> task) override;      // queue task, local to the worker if invoked by one
+        unsigned size() const;                                  // number of worker threads
+        void setErrorHandler(ErrorHandler handler);             // invoked when a task throws, nullptr to only count it
+        std::uint64_t getErrors() const;                        // number of tasks that threw
+        static ThreadPool& instance();                          // shared pool, created on first use
+
+    private:
+        ThreadPool(const ThreadPool&) = delete;                 // disable copy from left value
+        ThreadPool(const ThreadPool&&) = delete;                // disable copy from right value
+        ThreadPool& operator=(const ThreadPool&) = delete;      // disable assign from left value
+        ThreadPool& operator=(const ThreadPool&&) = delete;     // disable assign from right value
+
+        struct Worker                                           // queue owned by one worker thread
+        {
+            std::mutex m_lock;                                  // guard m_tasks
+            std::deque<std::function<void()>> m_tasks;          // owner pops back, thieves pop front
+        };
+
+        void run(unsigned index);                               // loop of worker thread
+        bool pop(unsigned index, std::function<void()> &task);  // own task first, then steal
+        void failed(std::exception_ptr error);                  // count the exception of a task, pass it to the handler
+        static const ThreadPool*& currentPool();                // pool of current worker thread, nullptr if none
+        static unsigned& currentIndex();                        // index of current worker thread
+
+        std::vector<std::unique_ptr<Worker>> m_workers;         // one queue per worker thread
+        std::vector<std::thread> m_threads;                     // worker threads
+        std::atomic<std::size_t> m_queued;                      // tasks queued, not taken yet
+        std::atomic<unsigned> m_next;                           // round robin for external submission
+        std::mutex m_idleLock;                                  // guard m_stopping and m_idle
+        std::condition_variable m_idle;                         // wake idle workers
+        bool m_stopping;                                        // destrctor invoked
+        mutable std::mutex m_errorLock;                         // guard m_errorHandler
+        ErrorHandler m_errorHandler;                            // receives exceptions of tasks, nullptr if none
+        std::atomic<std::uint64_t> m_errors;                    // tasks that threw
+};
+
+inline Executor::~Executor() {}
+
+
+
+inline ThreadPool::ThreadPool(unsigned threads): m_queued(0), m_next(0), m_stopping(false), m_errors(0)
+{
+    if (threads == 0)
+    {
+        threads = std::thread::hardware_concurrency();
+    }
+    if (threads == 0)
+    {
+        threads = 1;                                            // unknown concurrency
+    }
+
+    for (unsigned i = 0; i < threads; ++i)
+    {
+        m_workers.push_back(std::unique_ptr<Worker>(new Worker));
+    }
+    // order matters, all queues MUST exist before any worker starts stealing
+    for (unsigned i = 0; i < threads; ++i)
+    {
+        m_threads.push_back(std::thread(&ThreadPool::run, this, i));
+    }
+}
+
+inline ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_idleLock);
+        m_stopping = true;
+    }
+    m_idle.notify_all();
+    for (auto it = m_threads.begin(); it != m_threads.end(); ++it)
+    {
+        it->join();                                             // workers leave once all queues are empty
+    }
+}
+
+inline void ThreadPool::execute(std::function<void()> task)
+{
+    unsigned index = 0;
+    if (currentPool() == this)
+    {
+        index = currentIndex();                                 // keep it local, hot in cache
+    }
+    else
+    {
+        index = m_next.fetch_add(1) % m_workers.size();
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_workers[index]->m_lock);
+        m_workers[index]->m_tasks.push_back(std::move(task));
+    }
+    m_queued.fetch_add(1);
+    {
+        // lock so that a worker can not miss the wake-up between its check and its wait
+        std::lock_guard<std::mutex> lock(m_idleLock);
+    }
+    m_idle.notify_one();
+}
+
+inline unsigned ThreadPool::size() const
+{
+    return static_cast<unsigned>(m_threads.size());
+}
+
+inline void ThreadPool::setErrorHandler(ErrorHandler handler)
+{
+    std::lock_guard<std::mutex> lock(m_errorLock);
+    m_errorHandler = std::move(handler);
+}
+
+inline std::uint64_t ThreadPool::getErrors() const
+{
+    return m_errors.load();
+}
+
+inline ThreadPool& ThreadPool::instance()
+{
+    static ThreadPool pool;
+    return pool;
+}
+
+inline void ThreadPool::run(unsigned index)
+{
+    currentPool() = this;
+    currentIndex() = index;
+    std::function<void()> task;
+    for (;;)
+    {
+        if (pop(index, task))
+        {
+            // an exception leaving the thread would terminate the process, the worker goes on with the next task
+            try
+            {
+                task();
+            }
+            catch (...)
+            {
+                failed(std::current_exception());
+            }
+            task = nullptr;                                     // release captures before sleeping
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(m_idleLock);
+        m_idle.wait(lock, [this] { return m_queued.load() > 0 || m_stopping; });
+        if (m_stopping && m_queued.load() == 0)
+        {
+            break;
+        }
+    }
+    currentPool() = nullptr;
+}
+
+inline bool ThreadPool::pop(unsigned index, std::function<void()> &task)
+{
+    if (m_queued.load() == 0)
+    {
+        return false;                                           // nothing anywhere
+    }
+
+    const std::size_t count = m_workers.size();
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        Worker &worker = *m_workers[(index + i) % count];
+        std::lock_guard<std::mutex> lock(worker.m_lock);
+        if (worker.m_tasks.empty())
+        {
+            continue;
+        }
+        if (i == 0)
+        {
+            task = std::move(worker.m_tasks.back());            // own queue, newest first
+            worker.m_tasks.pop_back();
+        }
+        else
+        {
+            task = std::move(worker.m_tasks.front());           // steal oldest from others
+            worker.m_tasks.pop_front();
+        }
+        m_queued.fetch_sub(1);
+        return true;
+    }
+    return false;
+}
+
+inline void ThreadPool::failed(std::exception_ptr error)
+{
+    m_errors.fetch_add(1);
+    ErrorHandler handler;
+    {
+        std::lock_guard<std::mutex> lock(m_errorLock);
+        handler = m_errorHandler;                               // copied, the handler may set another one
+    }
+    if (handler)
+    {
+        try
+        {
+            handler(error);
+        }
+        catch (...)
+        {
+            // nowhere left to report it
+        }
+    }
+}
+
+inline const ThreadPool*& ThreadPool::currentPool()
+{
+    static thread_local const ThreadPool *pool = nullptr;
+    return pool;
+}
+
+inline unsigned& ThreadPool::currentIndex()
+{
+    static thread_local unsigned index = 0;
+    return index;
+}
+
+#endif // THREADPOOL_HPP
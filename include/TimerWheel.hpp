@@ -0,0 +1,321 @@
+#ifndef TIMERWHEEL_HPP
+#define TIMERWHEEL_HPP
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+
+class WheelTimer                                                // entry of a timer wheel, lives in its owner, interface
+{
+    // TimerWheel links and unlinks timers
+    friend class TimerWheel;
+    public:
+        WheelTimer();                                           // constructor, not scheduled
+        virtual ~WheelTimer();                                  // destrctor, virtual, MUST be cancelled before
+
+    protected:
+        virtual void expired(std::chrono::steady_clock::time_point now) = 0; // deadline reached, now of the wheel, pure virtual
+
+    private:
+        WheelTimer(const WheelTimer&) = delete;                 // disable copy from left value
+        WheelTimer& operator=(const WheelTimer&) = delete;      // disable assign from left value
+
+        WheelTimer *m_prev;                                     // previous in the slot
+        WheelTimer *m_next;                                     // next in the slot
+        WheelTimer **m_slot;                                    // head of the slot, nullptr if not scheduled
+        std::uint64_t m_tick;                                   // tick of the deadline
+};
+
+class TimerWheel                                                // hierarchical timing wheel, O(1) schedule and cancel
+{
+    public:
+        explicit TimerWheel(std::chrono::nanoseconds resolution = std::chrono::milliseconds(1),
+                            bool threaded = true);              // constructor, advanced by own thread unless threaded is false
+        ~TimerWheel();                                          // destrctor, stop own thread, drop timers scheduled
+        void schedule(WheelTimer *timer, std::chrono::steady_clock::time_point deadline); // expire timer at deadline or a tick later, move if scheduled
+        bool cancel(WheelTimer *timer);                         // unschedule timer, wait if expiring on another thread, whether it was scheduled
+        std::size_t advance(std::chrono::steady_clock::time_point now); // expire timers due by now on the calling thread, not threaded only, number expired
+        std::size_t getScheduled() const;                       // number of timers scheduled
+        std::chrono::nanoseconds getResolution() const;         // length of a tick
+        static TimerWheel& instance();                          // shared wheel with own thread, created on first use
+
+    private:
+        TimerWheel(const TimerWheel&) = delete;                 // disable copy from left value
+        TimerWheel(const TimerWheel&&) = delete;                // disable copy from right value
+        TimerWheel& operator=(const TimerWheel&) = delete;      // disable assign from left value
+        TimerWheel& operator=(const TimerWheel&&) = delete;     // disable assign from right value
+
+        static const unsigned Levels = 4;                       // 2^32 ticks ahead, 49 days at 1 ms
+        static const unsigned SlotBits = 8;                     // 256 slots per level
+        static const std::uint64_t SlotMask = (1u << SlotBits) - 1;
+
+        void insert(WheelTimer *timer);                         // link timer in the slot of its tick, locked
+        static void unlink(WheelTimer *timer);                  // unlink timer from its slot, locked
+        bool cascade(unsigned level);                           // move timers of the current slot of level down, whether level wrapped, locked
+        void run();                                             // loop of own thread
+        std::uint64_t tickOf(std::chrono::steady_clock::time_point time) const; // tick that time falls in
+        std::chrono::steady_clock::time_point timeOf(std::uint64_t tick) const; // start of tick
+
+        const std::chrono::nanoseconds m_resolution;            // length of a tick
+        const std::chrono::steady_clock::time_point m_origin;   // time of tick 0
+        mutable std::mutex m_lock;                              // guard all below
+        std::condition_variable m_changed;                      // timer scheduled, timer expired or stopping
+        WheelTimer *m_slots[Levels][1u << SlotBits];            // heads of slots
+        std::uint64_t m_tick;                                   // last tick advanced to
+        std::size_t m_scheduled;                                // timers scheduled
+        const WheelTimer *m_expiring;                           // timer whose expired runs now, nullptr if none
+        std::thread::id m_expiringThread;                       // thread running m_expiring
+        bool m_stopping;                                        // destrctor invoked
+        std::thread m_thread;                                   // own thread, not joinable unless threaded
+};
+
+
+
+inline WheelTimer::WheelTimer(): m_prev(nullptr), m_next(nullptr), m_slot(nullptr), m_tick(0) {}
+
+inline WheelTimer::~WheelTimer() {}
+
+
+
+inline TimerWheel::TimerWheel(std::chrono::nanoseconds resolution, bool threaded):
+    m_resolution(resolution.count() > 0 ? resolution : std::chrono::nanoseconds(1)),
+    m_origin(std::chrono::steady_clock::now()), m_tick(0), m_scheduled(0), m_expiring(nullptr), m_stopping(false)
+{
+    for (unsigned level = 0; level < Levels; ++level)
+    {
+        for (std::uint64_t slot = 0; slot <= SlotMask; ++slot)
+        {
+            m_slots[level][slot] = nullptr;
+        }
+    }
+    if (threaded)
+    {
+        m_thread = std::thread(&TimerWheel::run, this);         // order matters, every member MUST be ready
+    }
+}
+
+inline TimerWheel::~TimerWheel()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_stopping = true;
+    }
+    m_changed.notify_all();
+    if (m_thread.joinable())
+    {
+        m_thread.join();
+    }
+    for (unsigned level = 0; level < Levels; ++level)
+    {
+        for (std::uint64_t slot = 0; slot <= SlotMask; ++slot)
+        {
+            while (m_slots[level][slot])
+            {
+                unlink(m_slots[level][slot]);                   // never expire
+            }
+        }
+    }
+}
+
+inline void TimerWheel::schedule(WheelTimer *timer, std::chrono::steady_clock::time_point deadline)
+{
+    // rounded up, a timer never expires early
+    const std::chrono::nanoseconds offset = std::chrono::duration_cast<std::chrono::nanoseconds>(deadline - m_origin);
+    const std::uint64_t tick = offset.count() <= 0 ? 0 :
+        static_cast<std::uint64_t>((offset.count() + m_resolution.count() - 1) / m_resolution.count());
+    bool first = false;
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        if (timer->m_slot)
+        {
+            unlink(timer);
+            --m_scheduled;
+        }
+        if (!m_scheduled && !m_expiring)
+        {
+            // empty and not advancing, skip the ticks spent idle instead of walking them
+            const std::uint64_t current = tickOf(std::chrono::steady_clock::now());
+            m_tick = current > m_tick ? current : m_tick;
+        }
+        timer->m_tick = tick > m_tick ? tick : m_tick + 1;      // due already, expires at the next tick
+        insert(timer);
+        first = m_scheduled++ == 0;
+    }
+    if (first)
+    {
+        m_changed.notify_all();                                 // own thread sleeps while nothing is scheduled
+    }
+}
+
+inline bool TimerWheel::cancel(WheelTimer *timer)
+{
+    std::unique_lock<std::mutex> lock(m_lock);
+    const bool scheduled = timer->m_slot != nullptr;
+    if (scheduled)
+    {
+        unlink(timer);
+        --m_scheduled;
+    }
+    // expired may still run on another thread, the owner MUST not be destroyed before it returns
+    m_changed.wait(lock, [this, timer]
+    {
+        return m_expiring != timer || m_expiringThread == std::this_thread::get_id();
+    });
+    return scheduled;
+}
+
+inline std::size_t TimerWheel::advance(std::chrono::steady_clock::time_point now)
+{
+    const std::uint64_t target = tickOf(now);
+    std::size_t expired = 0;
+    std::unique_lock<std::mutex> lock(m_lock);
+    while (m_tick < target)
+    {
+        if (!m_scheduled)
+        {
+            m_tick = target;                                    // nothing to expire on the way
+            break;
+        }
+        ++m_tick;
+        const std::uint64_t index = m_tick & SlotMask;
+        if (index == 0)
+        {
+            // a lower level wrapped, the next slot of each higher level comes down
+            for (unsigned level = 1; level < Levels && cascade(level); ++level) {}
+        }
+        while (WheelTimer *timer = m_slots[0][index])
+        {
+            unlink(timer);
+            --m_scheduled;
+            ++expired;
+            m_expiring = timer;
+            m_expiringThread = std::this_thread::get_id();
+            const std::chrono::steady_clock::time_point time = timeOf(m_tick);
+            lock.unlock();                                      // expired may schedule or cancel
+            try
+            {
+                timer->expired(time);
+            }
+            catch (...)
+            {
+                lock.lock();
+                m_expiring = nullptr;
+                m_changed.notify_all();
+                throw;
+            }
+            lock.lock();
+            m_expiring = nullptr;
+            m_changed.notify_all();
+        }
+    }
+    return expired;
+}
+
+inline std::size_t TimerWheel::getScheduled() const
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    return m_scheduled;
+}
+
+inline std::chrono::nanoseconds TimerWheel::getResolution() const
+{
+    return m_resolution;
+}
+
+inline TimerWheel& TimerWheel::instance()
+{
+    static TimerWheel wheel;
+    return wheel;
+}
+
+inline void TimerWheel::insert(WheelTimer *timer)
+{
+    // the level is chosen by distance, the slot by the bits of the tick at that level
+    const std::uint64_t delta = timer->m_tick - m_tick;
+    unsigned level = 0;
+    while (level + 1 < Levels && delta >> (SlotBits * (level + 1)))
+    {
+        ++level;
+    }
+    std::uint64_t tick = timer->m_tick;
+    if (level == Levels - 1 && delta >> (SlotBits * Levels))
+    {
+        tick = m_tick + (std::uint64_t(1) << (SlotBits * Levels)) - 1; // too far, parked at the horizon and cascaded again
+    }
+    WheelTimer **slot = &m_slots[level][(tick >> (SlotBits * level)) & SlotMask];
+    timer->m_prev = nullptr;
+    timer->m_next = *slot;
+    if (*slot)
+    {
+        (*slot)->m_prev = timer;
+    }
+    *slot = timer;
+    timer->m_slot = slot;
+}
+
+inline void TimerWheel::unlink(WheelTimer *timer)
+{
+    if (timer->m_prev)
+    {
+        timer->m_prev->m_next = timer->m_next;
+    }
+    else
+    {
+        *timer->m_slot = timer->m_next;
+    }
+    if (timer->m_next)
+    {
+        timer->m_next->m_prev = timer->m_prev;
+    }
+    timer->m_prev = timer->m_next = nullptr;
+    timer->m_slot = nullptr;
+}
+
+inline bool TimerWheel::cascade(unsigned level)
+{
+    const std::uint64_t index = (m_tick >> (SlotBits * level)) & SlotMask;
+    WheelTimer *timer = m_slots[level][index];
+    m_slots[level][index] = nullptr;
+    while (timer)
+    {
+        WheelTimer *next = timer->m_next;
+        insert(timer);                                          // closer now, lands on a lower level
+        timer = next;
+    }
+    return index == 0;
+}
+
+inline void TimerWheel::run()
+{
+    std::unique_lock<std::mutex> lock(m_lock);
+    while (!m_stopping)
+    {
+        if (!m_scheduled)
+        {
+            m_changed.wait(lock);                               // no tick while nothing is scheduled
+            continue;
+        }
+        // ticks skipped while asleep are caught up by advance, in one call
+        const std::chrono::steady_clock::time_point next = timeOf(m_tick + 1);
+        lock.unlock();
+        std::this_thread::sleep_until(next);
+        advance(std::chrono::steady_clock::now());
+        lock.lock();
+    }
+}
+
+inline std::uint64_t TimerWheel::tickOf(std::chrono::steady_clock::time_point time) const
+{
+    const std::chrono::nanoseconds offset = std::chrono::duration_cast<std::chrono::nanoseconds>(time - m_origin);
+    return offset.count() <= 0 ? 0 : static_cast<std::uint64_t>(offset.count() / m_resolution.count());
+}
+
+inline std::chrono::steady_clock::time_point TimerWheel::timeOf(std::uint64_t tick) const
+{
+    return m_origin + std::chrono::duration_cast<std::chrono::steady_clock::duration>(m_resolution * tick);
+}
+
+#endif // TIMERWHEEL_HPP
@@ -0,0 +1,714 @@
+// observerpattern_bench: measures the cost of the library, prints CSV or JSON
+//
+// usage: observerpattern_bench [--json] [--max-observers N]
+//
+// every row has the same columns, so that results of two versions can be diffed
+// or loaded into a spreadsheet:
+//   benchmark  what is measured
+//   mode       serial, concurrent, parallel, intrusive, static, multi, hub or engine
+//   n          fan-out, churn size or length of the cycle
+//   iterations repetitions timed
+//   ns_per_op  mean nanoseconds per operation
+//   p50_ns     median nanoseconds per operation, 0 if not sampled, includes reading the clock
+//   p99_ns     99th percentile nanoseconds per operation, 0 if not sampled
+//   bytes      heap bytes per element, 0 if not measured, depth for propagation
+//   extra      benchmark specific, see each benchmark
+
+#include "ObserverPattern.hpp"
+#include "MultiObserver.hpp"
+#include "StaticSubject.hpp"
+#include "EventHub.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <vector>
+
+namespace
+{
+
+std::atomic<std::size_t> AllocatedBytes(0);                    // heap bytes allocated so far, never decreased
+
+struct Result
+{
+    const char *m_benchmark;
+    const char *m_mode;
+    std::size_t m_n;
+    std::size_t m_iterations;
+    double m_nsPerOp;
+    double m_p50;
+    double m_p99;
+    double m_bytes;
+    double m_extra;
+};
+
+std::vector<Result> Results;
+
+typedef std::chrono::steady_clock Clock;
+
+double elapsedNs(Clock::time_point start)
+{
+    return static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count());
+}
+
+void record(const char *benchmark, const char *mode, std::size_t n, std::size_t iterations,
+            double totalNs, std::vector<double> samples = std::vector<double>(), double bytes = 0, double extra = 0)
+{
+    Result result = { benchmark, mode, n, iterations, iterations ? totalNs / iterations : 0, 0, 0, bytes, extra };
+    if (!samples.empty())
+    {
+        std::sort(samples.begin(), samples.end());
+        result.m_p50 = samples[samples.size() / 2];
+        result.m_p99 = samples[std::min(samples.size() - 1, samples.size() * 99 / 100)];
+    }
+    Results.push_back(result);
+    std::fprintf(stderr, "%-12s %-10s n=%-8zu %12.1f ns/op\n", benchmark, mode, n, result.m_nsPerOp);
+}
+
+std::size_t iterationsFor(std::size_t fanOut)
+{
+    // roughly the same number of updates for every fan-out, at least a few notify
+    const std::size_t updates = 4000000;
+    return std::max<std::size_t>(8, updates / std::max<std::size_t>(1, fanOut));
+}
+
+void keep(const void *p)
+{
+    // stop the optimizer from dropping a result
+#if defined(_MSC_VER)
+    static const void *volatile sink;
+    sink = p;
+#else
+    asm volatile("" : : "g"(p) : "memory");
+#endif
+}
+
+class SerialNode : public Subject<SerialNode>
+{
+    public:
+        void fire() { notify(1); }
+};
+
+class ConcurrentNode : public Subject<ConcurrentNode, ConcurrentPolicy>
+{
+    public:
+        void fire() { notify(1); }
+};
+
+class ParallelNode : public Subject<ParallelNode, ConcurrentPolicy>
+{
+    public:
+        void fire() { notifyParallel(1); }
+};
+
+class IntrusiveNode : public Subject<IntrusiveNode, IntrusivePolicy>
+{
+    public:
+        void fire() { notify(1); }
+};
+
+template<typename T>
+class CountingObserver : public Observer<T>
+{
+    public:
+        ~CountingObserver() { this->stopObserve(); }
+        bool update(long) override { ++m_count; return true; }
+        std::size_t m_count = 0;
+
+    protected:
+        bool init() override { return true; }
+        bool uninit() override { return true; }
+        bool threadSafeUpdate() const override { return true; } // each observer is updated by one thread per notify
+};
+
+class BatchNode : public Subject<BatchNode>
+{
+    public:
+        void fire(const std::vector<long> &msgs)
+        {
+            for (auto it = msgs.begin(); it != msgs.end(); ++it)
+            {
+                notify(*it);
+            }
+        }
+        void fireBatch(const std::vector<long> &msgs) { notifyBatch(msgs.data(), msgs.size()); }
+};
+
+class BatchCounter : public Observer<BatchNode>
+{
+    public:
+        ~BatchCounter() { stopObserve(); }
+        bool update(long msg) override { m_sum += msg; return true; }
+        bool updateBatch(MessageSpan msgs) override
+        {
+            for (auto it = msgs.begin(); it != msgs.end(); ++it)
+            {
+                m_sum += *it;                                   // inlined, no virtual call per message
+            }
+            return true;
+        }
+        long m_sum = 0;
+};
+
+class MultiCounter : public MultiObserver<SerialNode>
+{
+    public:
+        ~MultiCounter() { stopObserve(); }
+        bool update(SerialNode*, long) override { ++m_count; return true; }
+        std::size_t m_count = 0;
+};
+
+class StaticNode;
+
+struct StaticCounter
+{
+    bool update(StaticNode&, long) noexcept { ++m_count; return true; }
+    std::size_t m_count = 0;
+};
+
+class StaticNode : public StaticSubject<StaticNode, StaticCounter, StaticCounter, StaticCounter, StaticCounter,
+                                       StaticCounter, StaticCounter, StaticCounter, StaticCounter>
+{
+    public:
+        void fire() { notify(1L); }
+};
+
+class RingNode : public Subject<RingNode>, public Observer<RingNode>
+{
+    public:
+        explicit RingNode(std::size_t *updates): m_updates(updates), m_value(0), m_depth(0) {}
+        ~RingNode() { Observer<RingNode>::stopObserve(); }
+        void setValue(long value, std::size_t depth)
+        {
+            // like DualRole, notify only on change, so that the cycle ends
+            if (m_value != value)
+            {
+                m_value = value;
+                m_depth = depth;
+                notify(1);
+            }
+        }
+        std::size_t getDepth() const { return m_depth; }
+        bool update(long) override
+        {
+            ++*m_updates;
+            RingNode *subject = getSubject();
+            setValue(subject->m_value, subject->m_depth + 1);
+            return true;
+        }
+
+    protected:
+        bool init() override { return true; }
+        bool uninit() override { return true; }
+
+    private:
+        std::size_t *m_updates;
+        long m_value;
+        std::size_t m_depth;                                    // nested notify, or steps from the origin for the engine
+};
+
+template<typename T>
+void benchNotify(const char *mode, std::size_t fanOut)
+{
+    // one addObservers, a concurrent subject would copy its snapshot for each addObserver,
+    // bytes include the list of observers given to it
+    std::vector<std::unique_ptr<CountingObserver<T>>> observers;
+    std::vector<CountingObserver<T>*> added;
+    observers.reserve(fanOut);
+    added.reserve(fanOut);
+    const std::size_t before = AllocatedBytes.load();
+    for (std::size_t i = 0; i < fanOut; ++i)
+    {
+        observers.push_back(std::unique_ptr<CountingObserver<T>>(new CountingObserver<T>));
+        added.push_back(observers.back().get());
+    }
+    T subject;                                                  // destroyed first, stops all observers in one pass
+    subject.addObservers(added.begin(), added.end());
+    const double bytes = static_cast<double>(AllocatedBytes.load() - before) / fanOut;
+
+    const std::size_t iterations = iterationsFor(fanOut);
+    subject.fire();                                             // warm up
+    auto start = Clock::now();
+    for (std::size_t i = 0; i < iterations; ++i)
+    {
+        subject.fire();
+    }
+    const double total = elapsedNs(start);
+
+    // latency, sampled apart so that reading the clock does not count in the mean
+    std::vector<double> samples;
+    samples.reserve(iterations);
+    for (std::size_t i = 0; i < iterations; ++i)
+    {
+        auto one = Clock::now();
+        subject.fire();
+        samples.push_back(elapsedNs(one));
+    }
+    // extra: nanoseconds per delivered update
+    record("notify", mode, fanOut, iterations, total, samples, bytes, total / iterations / fanOut);
+}
+
+void benchNotifyMulti(std::size_t fanOut)
+{
+    SerialNode subject;
+    std::vector<std::unique_ptr<MultiCounter>> observers;
+    observers.reserve(fanOut);
+    const std::size_t before = AllocatedBytes.load();
+    for (std::size_t i = 0; i < fanOut; ++i)
+    {
+        observers.push_back(std::unique_ptr<MultiCounter>(new MultiCounter));
+        observers.back()->startObserve(&subject);
+    }
+    const double bytes = static_cast<double>(AllocatedBytes.load() - before) / fanOut;
+
+    const std::size_t iterations = iterationsFor(fanOut);
+    auto start = Clock::now();
+    for (std::size_t i = 0; i < iterations; ++i)
+    {
+        subject.fire();
+    }
+    const double total = elapsedNs(start);
+    record("notify", "multi", fanOut, iterations, total, std::vector<double>(), bytes, total / iterations / fanOut);
+}
+
+void benchNotifyStatic()
+{
+    StaticNode subject;
+    const std::size_t iterations = 4000000;
+    auto start = Clock::now();
+    for (std::size_t i = 0; i < iterations; ++i)
+    {
+        subject.fire();
+        keep(&subject);
+    }
+    const double total = elapsedNs(start);
+    record("notify", "static", StaticNode::size(), iterations, total, std::vector<double>(), 0, total / iterations / StaticNode::size());
+}
+
+void benchNotifyHub(std::size_t fanOut)
+{
+    EventHub hub;
+    std::vector<std::size_t> counts(fanOut);
+    const std::size_t before = AllocatedBytes.load();
+    for (std::size_t i = 0; i < fanOut; ++i)
+    {
+        hub.subscribe(0, static_cast<EventHub::ObserverId>(i));
+    }
+    hub.commit();
+    const double bytes = static_cast<double>(AllocatedBytes.load() - before) / fanOut;
+
+    auto deliver = [&counts](EventHub::ObserverId observer, EventHub::SubjectId, long) { ++counts[observer]; };
+    const std::size_t iterations = iterationsFor(fanOut);
+    auto start = Clock::now();
+    for (std::size_t i = 0; i < iterations; ++i)
+    {
+        hub.publish(0, 1, deliver);
+    }
+    const double total = elapsedNs(start);
+    keep(counts.data());
+    record("notify", "hub", fanOut, iterations, total, std::vector<double>(), bytes, total / iterations / fanOut);
+}
+
+void benchPublishBatch(std::size_t subjects)
+{
+    // one observer per subject, every subject publishes once per batch, extra: nanoseconds per subscribe in bulk
+    EventHub hub;
+    std::vector<EventHub::Subscription> subscriptions(subjects);
+    std::vector<EventHub::Publication> batch(subjects);
+    for (std::size_t i = 0; i < subjects; ++i)
+    {
+        subscriptions[i].m_subject = static_cast<EventHub::SubjectId>(i);
+        subscriptions[i].m_observer = static_cast<EventHub::ObserverId>(i);
+        batch[i].m_subject = static_cast<EventHub::SubjectId>(i);
+        batch[i].m_msg = 1;
+    }
+    const std::size_t before = AllocatedBytes.load();
+    auto start = Clock::now();
+    hub.subscribe(subscriptions.data(), subscriptions.size());
+    hub.commit();
+    const double subscribeNs = elapsedNs(start);
+    const double bytes = static_cast<double>(AllocatedBytes.load() - before) / subjects;
+
+    std::size_t delivered = 0;
+    auto deliver = [&delivered](EventHub::ObserverId, EventHub::SubjectId, long) { ++delivered; };
+    const std::size_t iterations = std::max<std::size_t>(1, 2000000 / subjects);
+    start = Clock::now();
+    for (std::size_t i = 0; i < iterations; ++i)
+    {
+        hub.publishBatch(batch.data(), batch.size(), deliver);
+    }
+    const double total = elapsedNs(start);
+    keep(&delivered);
+    record("publish_batch", "hub", subjects, iterations * subjects, total, std::vector<double>(), bytes, subscribeNs / subjects);
+}
+
+void benchNotifyBatch(std::size_t batchSize)
+{
+    // 100 observers, the same messages notified one by one or in one notifyBatch, extra: nanoseconds per message per observer
+    const std::size_t fanOut = 100;
+    BatchNode subject;
+    std::vector<std::unique_ptr<BatchCounter>> observers;
+    for (std::size_t i = 0; i < fanOut; ++i)
+    {
+        observers.push_back(std::unique_ptr<BatchCounter>(new BatchCounter));
+        observers.back()->startObserve(&subject);
+    }
+    std::vector<long> msgs(batchSize);
+    for (std::size_t i = 0; i < batchSize; ++i)
+    {
+        msgs[i] = static_cast<long>(i % 8);
+    }
+
+    const std::size_t iterations = std::max<std::size_t>(16, 20000000 / (fanOut * batchSize));
+    for (int batched = 0; batched < 2; ++batched)
+    {
+        auto start = Clock::now();
+        for (std::size_t i = 0; i < iterations; ++i)
+        {
+            if (batched)
+            {
+                subject.fireBatch(msgs);
+            }
+            else
+            {
+                subject.fire(msgs);
+            }
+        }
+        const double total = elapsedNs(start);
+        keep(observers.front().get());
+        record("notify_batch", batched ? "batched" : "per_message", batchSize, iterations, total, std::vector<double>(), 0,
+               total / iterations / batchSize / fanOut);
+    }
+}
+
+template<typename T>
+void benchChurn(const char *mode, std::size_t count)
+{
+    // extra: nanoseconds per removal, ns_per_op is per addition
+    T subject;
+    std::vector<std::unique_ptr<CountingObserver<T>>> observers;
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        observers.push_back(std::unique_ptr<CountingObserver<T>>(new CountingObserver<T>));
+    }
+    const std::size_t rounds = std::max<std::size_t>(1, 200000 / count);
+    double addNs = 0;
+    double removeNs = 0;
+    for (std::size_t r = 0; r < rounds; ++r)
+    {
+        auto start = Clock::now();
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            subject.addObserver(observers[i].get());
+        }
+        addNs += elapsedNs(start);
+        start = Clock::now();
+        for (std::size_t i = 0; i < count; i += 2)
+        {
+            subject.removeObserver(observers[i].get());         // every other one, from the middle
+        }
+        for (std::size_t i = 1; i < count; i += 2)
+        {
+            subject.removeObserver(observers[i].get());
+        }
+        removeNs += elapsedNs(start);
+    }
+    const std::size_t ops = rounds * count;
+    record("churn", mode, count, ops, addNs, std::vector<double>(), 0, removeNs / ops);
+}
+
+template<typename T>
+void benchAddObservers(const char *mode, std::size_t count)
+{
+    // observers of 4 priorities interleaved, added in one addObservers per priority or one by one,
+    // extra: nanoseconds per observer one by one, ns_per_op is per observer in bulk
+    std::vector<std::unique_ptr<CountingObserver<T>>> observers;
+    std::vector<std::vector<CountingObserver<T>*>> byPriority(4);
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        observers.push_back(std::unique_ptr<CountingObserver<T>>(new CountingObserver<T>));
+        byPriority[i % 4].push_back(observers.back().get());
+    }
+    const std::size_t rounds = std::max<std::size_t>(1, 100000 / count);
+    double bulkNs = 0;
+    double singleNs = 0;
+    for (std::size_t r = 0; r < rounds; ++r)
+    {
+        {
+            T subject;
+            auto start = Clock::now();
+            for (int priority = 0; priority < 4; ++priority)
+            {
+                subject.addObservers(byPriority[priority].begin(), byPriority[priority].end(), MessageMask(), priority);
+            }
+            bulkNs += elapsedNs(start);
+            for (std::size_t i = 0; i < count; ++i)
+            {
+                subject.removeObserver(observers[i].get());
+            }
+        }
+        {
+            T subject;
+            auto start = Clock::now();
+            for (std::size_t i = 0; i < count; ++i)
+            {
+                subject.addObserver(observers[i].get(), MessageMask(), static_cast<int>(i % 4));
+            }
+            singleNs += elapsedNs(start);
+            for (std::size_t i = 0; i < count; ++i)
+            {
+                subject.removeObserver(observers[i].get());
+            }
+        }
+    }
+    const std::size_t ops = rounds * count;
+    record("add_observers", mode, count, ops, bulkNs, std::vector<double>(), 0, singleNs / ops);
+}
+
+template<typename T>
+void benchGetObservers(const char *mode, std::size_t fanOut)
+{
+    // ns_per_op: getObservers alone, extra: getObservers and a full iteration
+    T subject;
+    std::vector<std::unique_ptr<CountingObserver<T>>> observers;
+    for (std::size_t i = 0; i < fanOut; ++i)
+    {
+        observers.push_back(std::unique_ptr<CountingObserver<T>>(new CountingObserver<T>));
+        observers.back()->startObserve(&subject);
+    }
+    const std::size_t iterations = 1000000;
+    auto start = Clock::now();
+    for (std::size_t i = 0; i < iterations; ++i)
+    {
+        auto view = subject.getObservers();
+        keep(&view);
+    }
+    const double viewNs = elapsedNs(start);
+
+    const std::size_t walks = iterationsFor(fanOut);
+    std::size_t seen = 0;
+    start = Clock::now();
+    for (std::size_t i = 0; i < walks; ++i)
+    {
+        auto view = subject.getObservers();
+        for (auto observer : view)
+        {
+            seen += observer != nullptr;
+        }
+    }
+    const double walkNs = elapsedNs(start);
+    keep(&seen);
+    record("getObservers", mode, fanOut, iterations, viewNs, std::vector<double>(), 0, walkNs / walks);
+}
+
+template<typename T, typename O>
+std::size_t firstSubscriptionBytes()
+{
+    // heap bytes the subject and the observer take for their first subscription
+    T subject;
+    O observer;
+    const std::size_t before = AllocatedBytes.load();
+    subject.addObserver(&observer);
+    return AllocatedBytes.load() - before;
+}
+
+std::size_t firstMultiSubscriptionBytes()
+{
+    SerialNode subject;
+    MultiCounter observer;
+    const std::size_t before = AllocatedBytes.load();
+    observer.startObserve(&subject);
+    return AllocatedBytes.load() - before;
+}
+
+void benchMemory()
+{
+    // bytes: sizeof the object, extra: heap bytes of its first subscription, counted once for both sides
+    struct Size
+    {
+        const char *m_mode;
+        std::size_t m_subject;
+        std::size_t m_observer;
+        std::size_t m_heap;
+    };
+    const Size sizes[] = {
+        { "serial", sizeof(SerialNode), sizeof(CountingObserver<SerialNode>), firstSubscriptionBytes<SerialNode, CountingObserver<SerialNode>>() },
+        { "concurrent", sizeof(ConcurrentNode), sizeof(CountingObserver<ConcurrentNode>),
+          firstSubscriptionBytes<ConcurrentNode, CountingObserver<ConcurrentNode>>() },
+        { "intrusive", sizeof(IntrusiveNode), sizeof(CountingObserver<IntrusiveNode>),
+          firstSubscriptionBytes<IntrusiveNode, CountingObserver<IntrusiveNode>>() },
+        { "multi", sizeof(SerialNode), sizeof(MultiCounter), firstMultiSubscriptionBytes() },
+        { "static", sizeof(StaticNode), sizeof(StaticCounter), 0 },   // wired at compile time, no heap
+    };
+    for (const Size &size : sizes)
+    {
+        record("sizeof_subject", size.m_mode, 1, 0, 0, std::vector<double>(), static_cast<double>(size.m_subject),
+               static_cast<double>(size.m_heap));
+        record("sizeof_observer", size.m_mode, 1, 0, 0, std::vector<double>(), static_cast<double>(size.m_observer),
+               static_cast<double>(size.m_heap));
+    }
+}
+
+void benchPropagation(std::size_t length)
+{
+    // a cycle of length RingNode, each one observes the previous one
+    // nested: every update notifies from inside notify, engine: breadth-first from a work queue
+    // bytes: depth reached, extra: updates per run
+    for (int engine = 0; engine < 2; ++engine)
+    {
+        std::size_t updates = 0;
+        std::vector<std::unique_ptr<RingNode>> ring;
+        for (std::size_t i = 0; i < length; ++i)
+        {
+            ring.push_back(std::unique_ptr<RingNode>(new RingNode(&updates)));
+        }
+        for (std::size_t i = 0; i < length; ++i)
+        {
+            ring[i]->startObserve(ring[(i + length - 1) % length].get());
+        }
+
+        const std::size_t iterations = std::max<std::size_t>(16, 200000 / length);
+        std::size_t depth = 0;
+        auto start = Clock::now();
+        for (std::size_t i = 0; i < iterations; ++i)
+        {
+            if (engine)
+            {
+                PropagationEngine propagation;
+                propagation.run([&ring, i] { ring[0]->setValue(static_cast<long>(i) + 1, 0); });
+                depth = std::max<std::size_t>(depth, propagation.getStats().m_depth);
+            }
+            else
+            {
+                ring[0]->setValue(static_cast<long>(i) + 1, 0);
+                depth = std::max<std::size_t>(depth, ring[length - 1]->getDepth());
+            }
+        }
+        const double total = elapsedNs(start);
+        record(engine ? "propagation_engine" : "propagation_nested", engine ? "engine" : "serial", length, iterations,
+               total, std::vector<double>(), static_cast<double>(depth), static_cast<double>(updates) / iterations);
+    }
+}
+
+void print(bool json)
+{
+    if (json)
+    {
+        std::printf("[\n");
+        for (std::size_t i = 0; i < Results.size(); ++i)
+        {
+            const Result &r = Results[i];
+            std::printf("  {\"benchmark\": \"%s\", \"mode\": \"%s\", \"n\": %zu, \"iterations\": %zu, "
+                        "\"ns_per_op\": %.3f, \"p50_ns\": %.1f, \"p99_ns\": %.1f, \"bytes\": %.1f, \"extra\": %.3f}%s\n",
+                        r.m_benchmark, r.m_mode, r.m_n, r.m_iterations, r.m_nsPerOp, r.m_p50, r.m_p99, r.m_bytes, r.m_extra,
+                        i + 1 < Results.size() ? "," : "");
+        }
+        std::printf("]\n");
+        return;
+    }
+    std::printf("benchmark,mode,n,iterations,ns_per_op,p50_ns,p99_ns,bytes,extra\n");
+    for (const Result &r : Results)
+    {
+        std::printf("%s,%s,%zu,%zu,%.3f,%.1f,%.1f,%.1f,%.3f\n",
+                    r.m_benchmark, r.m_mode, r.m_n, r.m_iterations, r.m_nsPerOp, r.m_p50, r.m_p99, r.m_bytes, r.m_extra);
+    }
+}
+
+} // namespace
+
+// kept out of line, inlined they pair malloc with operator delete or operator new with free, -Wmismatched-new-delete
+#if defined(_MSC_VER)
+#define BENCH_NOINLINE __declspec(noinline)
+#else
+#define BENCH_NOINLINE __attribute__((noinline))
+#endif
+
+BENCH_NOINLINE void* operator new(std::size_t size)
+{
+    AllocatedBytes.fetch_add(size, std::memory_order_relaxed);
+    if (void *p = std::malloc(size ? size : 1))
+    {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+BENCH_NOINLINE void operator delete(void *p) noexcept
+{
+    std::free(p);
+}
+
+BENCH_NOINLINE void operator delete(void *p, std::size_t) noexcept
+{
+    std::free(p);
+}
+
+int main(int argc, char *argv[])
+{
+    bool json = false;
+    std::size_t maxObservers = 1000000;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (std::strcmp(argv[i], "--json") == 0)
+        {
+            json = true;
+        }
+        else if (std::strcmp(argv[i], "--max-observers") == 0 && i + 1 < argc)
+        {
+            maxObservers = static_cast<std::size_t>(std::strtoull(argv[++i], nullptr, 10));
+        }
+        else
+        {
+            std::fprintf(stderr, "usage: %s [--json] [--max-observers N]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    for (std::size_t fanOut = 1; fanOut <= maxObservers; fanOut *= 10)
+    {
+        benchNotify<SerialNode>("serial", fanOut);
+        benchNotify<ConcurrentNode>("concurrent", fanOut);
+        benchNotify<ParallelNode>("parallel", fanOut);
+        benchNotify<IntrusiveNode>("intrusive", fanOut);
+        benchNotifyMulti(fanOut);
+        benchNotifyHub(fanOut);
+    }
+    benchNotifyStatic();
+    for (std::size_t count = 1; count <= std::min<std::size_t>(maxObservers, 10000); count *= 10)
+    {
+        benchChurn<SerialNode>("serial", count);
+        benchChurn<ConcurrentNode>("concurrent", count);
+        benchChurn<IntrusiveNode>("intrusive", count);
+    }
+    for (std::size_t count = 10; count <= std::min<std::size_t>(maxObservers, 10000); count *= 10)
+    {
+        benchAddObservers<SerialNode>("serial", count);
+        benchAddObservers<ConcurrentNode>("concurrent", count);
+        benchAddObservers<IntrusiveNode>("intrusive", count);
+    }
+    for (std::size_t fanOut = 1; fanOut <= std::min<std::size_t>(maxObservers, 10000); fanOut *= 100)
+    {
+        benchGetObservers<SerialNode>("serial", fanOut);
+        benchGetObservers<ConcurrentNode>("concurrent", fanOut);
+        benchGetObservers<IntrusiveNode>("intrusive", fanOut);
+    }
+    benchMemory();
+    for (std::size_t subjects = 1000; subjects <= maxObservers; subjects *= 10)
+    {
+        benchPublishBatch(subjects);
+    }
+    for (std::size_t batchSize = 1; batchSize <= 1000; batchSize *= 10)
+    {
+        benchNotifyBatch(batchSize);
+    }
+    for (std::size_t length = 2; length <= 512; length *= 4)
+    {
+        benchPropagation(length);
+    }
+    print(json);
+    return 0;
+}
@@ -0,0 +1,184 @@
+// observerpattern_coroutine: AwaitableObserver of Coroutine.hpp, C++20 only
+//
+// usage: observerpattern_coroutine
+//
+// prints what each coroutine receives, returns 1 if any check fails
+
+#include "Coroutine.hpp"
+#include <coroutine>
+#include <cstdio>
+#include <exception>
+#include <functional>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace
+{
+
+int Failures = 0;
+
+void check(bool passed, const char *what)
+{
+    std::printf("%s: %s\n", what, passed ? "ok" : "FAILED");
+    Failures += passed ? 0 : 1;
+}
+
+class Task                                                      // coroutine started at once, its frame destroyed with the task
+{
+    public:
+        struct promise_type
+        {
+            Task get_return_object() { return Task(std::coroutine_handle<promise_type>::from_promise(*this)); }
+            std::suspend_never initial_suspend() noexcept { return {}; }
+            std::suspend_always final_suspend() noexcept { return {}; }
+            void return_void() {}
+            void unhandled_exception() { std::terminate(); }
+        };
+
+        Task(Task &&other) noexcept: m_handle(other.m_handle) { other.m_handle = nullptr; }
+        ~Task() { if (m_handle) m_handle.destroy(); }               // also while suspended in an await
+        bool done() const { return m_handle.done(); }
+
+    private:
+        explicit Task(std::coroutine_handle<promise_type> handle): m_handle(handle) {}
+        Task(const Task&) = delete;
+        Task& operator=(const Task&) = delete;
+
+        std::coroutine_handle<promise_type> m_handle;
+};
+
+class ManualExecutor : public Executor                          // runs tasks when told, on the calling thread
+{
+    public:
+        void execute(std::function<void()> task) override { m_tasks.push_back(std::move(task)); }
+        std::size_t run()
+        {
+            std::vector<std::function<void()>> tasks;
+            tasks.swap(m_tasks);
+            for (auto it = tasks.begin(); it != tasks.end(); ++it)
+            {
+                (*it)();
+            }
+            return tasks.size();
+        }
+
+    private:
+        std::vector<std::function<void()>> m_tasks;
+};
+
+class Door : public Subject<Door>
+{
+    public:
+        void open() const { notify(Opened); }
+        void close() const { notify(Closed); }
+        void knock() const { notify(Knocked); }
+
+        static constexpr long Opened = 1;
+        static constexpr long Closed = 2;
+        static constexpr long Knocked = 3;
+};
+
+Task waitOnce(AwaitableObserver<Door> &observer, MessageMask messages, std::optional<long> &received)
+{
+    received = co_await observer.next(messages);
+}
+
+Task collect(AwaitableObserver<Door>::Stream &stream, std::string &received)
+{
+    while (auto msg = co_await stream.next())
+    {
+        received += std::to_string(*msg);
+    }
+    received += ".";                                            // closed and drained
+}
+
+void nextTest()
+{
+    Door door;
+    AwaitableObserver<Door> observer;
+    observer.startObserve(&door);
+    std::optional<long> opened, any;
+    Task waitOpened = waitOnce(observer, { Door::Opened }, opened);
+    Task waitAny = waitOnce(observer, MessageMask(), any);
+    check(observer.getWaiting() == 2, "next: two coroutines waiting");
+    door.knock();                                               // only the second one waits for it
+    check(!opened && any == Door::Knocked && waitAny.done(), "next: resumed by the messages awaited only");
+    door.open();
+    check(opened == Door::Opened && waitOpened.done() && observer.getWaiting() == 0, "next: resumed inline before notify returns");
+}
+
+void streamTest()
+{
+    Door door;
+    AwaitableObserver<Door> observer;
+    observer.startObserve(&door);
+    std::string received;
+    AwaitableObserver<Door>::Stream stream(observer, { Door::Opened, Door::Closed });
+    door.open();                                                // queued, no coroutine awaits yet
+    door.knock();
+    door.close();
+    check(stream.getQueued() == 2, "stream: messages queued before the first await");
+    Task consumer = collect(stream, received);                  // takes both at once, then waits
+    door.open();
+    check(received == "121", "stream: every matching message in order");
+    door.removeObserver(&observer);                             // closes, the loop ends
+    check(received == "121." && consumer.done(), "stream: empty message once closed and drained");
+}
+
+void closeTest()
+{
+    Door door;
+    AwaitableObserver<Door> observer;
+    observer.startObserve(&door);
+    std::optional<long> received = Door::Knocked;
+    Task waiting = waitOnce(observer, MessageMask(), received);
+    door.removeObserver(&observer);                             // uninit closes the observer
+    check(!received && waiting.done(), "close: waiting coroutine resumed with an empty message");
+
+    AwaitableObserver<Door> closed;
+    std::optional<long> late = Door::Knocked;
+    closed.close();
+    Task after = waitOnce(closed, MessageMask(), late);
+    check(!late && after.done(), "close: next on a closed observer does not suspend");
+}
+
+void destroyTest()
+{
+    Door door;
+    AwaitableObserver<Door> observer;
+    observer.startObserve(&door);
+    std::optional<long> received;
+    {
+        Task abandoned = waitOnce(observer, MessageMask(), received);
+        check(observer.getWaiting() == 1 && !abandoned.done(), "destroy: coroutine suspended in next");
+    }                                                           // frame destroyed while suspended, unlinked
+    check(observer.getWaiting() == 0, "destroy: waiter unlinked with its frame");
+    door.open();                                                // no dangling waiter to resume
+    check(!received, "destroy: notify after the frame is gone resumes nothing");
+}
+
+void postedTest()
+{
+    Door door;
+    ManualExecutor executor;
+    AwaitableObserver<Door> observer(Resumption::Posted, &executor);
+    observer.startObserve(&door);
+    std::optional<long> received;
+    Task waiting = waitOnce(observer, MessageMask(), received);
+    door.close();
+    check(!received && !waiting.done(), "posted: notify returns before the coroutine resumes");
+    check(executor.run() == 1 && received == Door::Closed && waiting.done(), "posted: resumed on the executor");
+}
+
+} // namespace
+
+int main()
+{
+    nextTest();
+    streamTest();
+    closeTest();
+    destroyTest();
+    postedTest();
+    return Failures ? 1 : 0;
+}
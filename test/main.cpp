@@ -1,9 +1,34 @@
 #include "ValueEntity.h"
 #include "ValueMonitor.h"
 #include "DualRole.h"
+#include "MultiObserver.hpp"
+#include "StaticSubject.hpp"
+#include "Mailbox.hpp"
+#include "EventHub.hpp"
+#include "RateLimit.hpp"
+#include "Computed.hpp"
+#include "SubscriptionGraph.hpp"
+#ifdef __linux__
+#include "SharedMemory.hpp"
+#endif
 #include <iostream>
+#include <atomic>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
 using std::cout;
 
+int Failures = 0;
+
+void check(bool passed, const char *what)
+{
+    // a guarantee the demos rely on, main returns 1 if any does not hold
+    cout << what << ": " << (passed ? "ok" : "FAILED") << "\n";
+    Failures += passed ? 0 : 1;
+}
+
 void printObservers(const ValueEntity &valueEntity)
 {
     auto observers = valueEntity.getObservers();
@@ -38,7 +63,7 @@ void entityMonitorDemo()
 {
     auto ve = new ValueEntity(0);
     auto vm1 = new ValueMonitor;
-    ve->addObserver(vm1);   // equivalent to vm1->startObserve(ve);
+    ve->addObserver(vm1, {ValueEntity::ValueChanged});  // equivalent to vm1->startObserve(ve, {ValueEntity::ValueChanged});
     auto vm2 = new ValueMonitor;
     vm2->startObserve(ve);  // equivalent to ve->addObserver(vm2);
     while (ve->getValue() < 3)
@@ -65,6 +90,20 @@ void entityMonitorDemo()
     vm2 = nullptr;
 }
 
+void batchDemo()
+{
+    ValueEntity ve(0);
+    ValueMonitor vm;
+    vm.startObserve(&ve);
+    {
+        auto batch = ve.beginBatch();   // observers are notified once when batch goes out of scope
+        while (ve.getValue() < 3)
+        {
+            ve.setValue(ve.getValue() + 1);
+        }
+    }
+}
+
 void dualRoleDemo()
 {
     // dr3 observes dr2, dr2 observes dr1, dr1 observes dr3
@@ -79,9 +118,828 @@ void dualRoleDemo()
 	dr3.setValue(5);
 }
 
+void propagationDemo()
+{
+    // same cycle as dualRoleDemo, propagated from a work queue instead of recursion
+    DualRole dr1(0);
+    DualRole dr2(1);
+    DualRole dr3(2);
+    dr3.startObserve(&dr2);
+    dr2.startObserve(&dr1);
+    dr1.startObserve(&dr3);
+    PropagationEngine engine;
+    engine.run([&dr1] { dr1.setValue(6); });
+    const PropagationEngine::Stats &stats = engine.getStats();
+    cout << "propagation notified " << stats.m_notified << " times, "
+            << stats.m_updates << " updates, " << stats.m_revisits << " revisits, depth "
+            << stats.m_depth << "\n";
+}
+
+class SumMonitor : public MultiObserver<ValueEntity>
+{
+    public:
+        ~SumMonitor() { stopObserve(); }
+        bool update(ValueEntity *subject, long) override
+        {
+            int sum = 0;
+            for (auto edge = getEdges(); edge; edge = edge->getNext())
+            {
+                sum += edge->getTarget()->getValue();
+            }
+            cout << "SumMonitor: ValueEntity[" << subject->getId() << "] changed, sum of "
+                    << getSubjectCount() << " is " << sum << "\n";
+            return true;
+        }
+};
+
+void multiObserverDemo()
+{
+    ValueEntity ve1(1);
+    SumMonitor sm;
+    {
+        ValueEntity ve2(2);
+        sm.startObserve(&ve1);
+        sm.startObserve(&ve2);
+        ve1.setValue(10);
+        ve2.setValue(20);
+    }                               // ve2 leaves, sm keeps observing ve1
+    ve1.setValue(30);
+}
+
+class Counter;
+
+struct CountPrinter
+{
+    bool update(Counter &counter, long msg) noexcept;
+};
+
+class Counter : public StaticSubject<Counter, CountPrinter>
+{
+    public:
+        constexpr Counter(): m_nCount(0) {}
+        constexpr int getCount() const { return m_nCount; }
+        void increase() { ++m_nCount; notify(ValueEntity::ValueChanged); }   // update of CountPrinter inlined here
+
+    private:
+        int m_nCount;
+};
+
+bool CountPrinter::update(Counter &counter, long) noexcept
+{
+    cout << "Counter " << counter.getCount() << "\n";
+    return true;
+}
+
+void staticSubjectDemo()
+{
+    constexpr Counter initial;                                  // a literal type, built at compile time
+    static_assert(initial.getCount() == 0 && Counter::size() == 1, "static subject not constexpr");
+    Counter counter;
+    counter.increase();
+    counter.increase();
+}
+
+class KeyInput : public Subject<KeyInput>
+{
+    public:
+        bool press(long key) const { return notifyUntilConsumed(key); }
+};
+
+class KeyHandler : public Observer<KeyInput>
+{
+    public:
+        KeyHandler(const char *name, long key): m_name(name), m_key(key) {}
+        ~KeyHandler() { stopObserve(); }
+        bool update(long key) override
+        {
+            cout << "KeyHandler " << m_name << ": key " << key << (key == m_key ? " consumed" : " passed") << "\n";
+            return key == m_key;                                // true stops the handlers after this one
+        }
+
+    private:
+        const char *m_name;
+        long m_key;
+};
+
+void priorityDemo()
+{
+    KeyInput input;
+    KeyHandler editor("editor", 2);
+    KeyHandler shortcut("shortcut", 1);
+    editor.startObserve(&input);
+    shortcut.startObserve(&input, MessageMask(), 10);           // asks first, though observing later
+    input.press(1);
+    input.press(2);
+}
+
+class ValueLog : public MailboxObserver<ValueEntity>
+{
+    public:
+        ValueLog(): MailboxObserver<ValueEntity>(64, MailboxOverflow::Conflate) {}
+        ~ValueLog() { stopObserve(); }
+
+    protected:
+        void receive(long msg) override
+        {
+            cout << "ValueLog: message " << msg << ", value " << getSubject()->getValue() << "\n";
+        }
+};
+
+void mailboxDemo()
+{
+    ValueEntity ve(3);
+    ValueLog log;
+    log.startObserve(&ve);
+    ve.setValue(1);
+    ve.setValue(2);
+    ve.setValue(3);                 // the publisher only queues, never waits for the log
+    log.drain();                    // normally on the consumer thread of the log
+    cout << "ValueLog: " << log.getConflated() << " conflated\n";
+}
+
+class Gauge : public Subject<Gauge, VersionedPolicy>
+{
+    public:
+        Gauge(): m_level(0) {}
+        int getLevel() const { return m_level; }
+        void setLevel(int level) { m_level = level; notify(LevelChanged); }
+
+        static const long LevelChanged = 1;
+
+    private:
+        int m_level;
+};
+
+class GaugeDisplay : public Observer<Gauge>
+{
+    public:
+        explicit GaugeDisplay(const char *name): m_name(name) {}
+        ~GaugeDisplay() { stopObserve(); }
+        bool update(long) override
+        {
+            cout << "GaugeDisplay " << m_name << ": level " << getSubject()->getLevel()
+                 << " at version " << getSubject()->getVersion() << "\n";
+            return true;
+        }
+
+    private:
+        const char *m_name;
+};
+
+void versionedDemo()
+{
+    Gauge gauge;
+    GaugeDisplay fast("fast"), slow("slow");
+    fast.startObserve(&gauge);
+    slow.startObserve(&gauge);
+    gauge.setLevel(1);
+    gauge.drain();                  // both dirty, each updated once
+    gauge.setLevel(2);
+    gauge.setLevel(3);
+    gauge.setLevel(4);              // versions 2 and 3 are never seen
+    gauge.pull(&fast);              // fast read the level itself, only slow is left
+    cout << "Gauge: " << gauge.getDirtyCount() << " dirty\n";
+    gauge.drain();
+}
+
+void eventHubDemo()
+{
+    // entities and monitors are plain ids, no object per subscription
+    EventHub hub;
+    const EventHub::Subscription subscriptions[] = { { 0, 100 }, { 1, 100 }, { 1, 101 }, { 2, 102 } };
+    hub.subscribe(subscriptions, 4);
+    hub.removeObserver(102);
+    const EventHub::Publication batch[] = { { 1, ValueEntity::ValueChanged }, { 0, ValueEntity::ValueChanged }, { 2, ValueEntity::ValueChanged } };
+    hub.publishBatch(batch, 3, [](EventHub::ObserverId observer, EventHub::SubjectId subject, long msg)
+    {
+        cout << "EventHub: monitor " << observer << " got message " << msg << " of entity " << subject << "\n";
+    });
+}
+
+class Ticker : public Subject<Ticker>
+{
+    public:
+        void publish(const std::vector<long> &ticks) { notifyBatch(ticks.data(), ticks.size()); }
+        void tick(long msg) { notify(msg); }
+
+        static const long Trade = 1;
+        static const long Quote = 2;
+        static const long Halt = 100;                       // out of [0, 62], shares bit 63 of MessageMask
+        static const long Resume = 200;
+};
+
+class TradeTape : public Observer<Ticker>
+{
+    public:
+        ~TradeTape() { stopObserve(); }
+        bool update(long) override { return false; }
+        bool updateBatch(MessageSpan msgs) override
+        {
+            cout << "TradeTape: " << msgs.size() << " trades in one batch\n";
+            return true;
+        }
+};
+
+class TickPrinter : public Observer<Ticker>
+{
+    public:
+        ~TickPrinter() { stopObserve(); }
+        bool update(long msg) override
+        {
+            cout << "TickPrinter: tick " << msg << "\n";   // no updateBatch, one update per message
+            return true;
+        }
+};
+
+class HaltAlarm : public Observer<Ticker>
+{
+    public:
+        HaltAlarm(): m_halts(0), m_others(0) {}
+        ~HaltAlarm() { stopObserve(); }
+        bool update(long msg) override
+        {
+            ++(msg == Ticker::Halt ? m_halts : m_others);
+            return true;
+        }
+        int getHalts() const { return m_halts; }
+        int getOthers() const { return m_others; }
+
+    private:
+        int m_halts;
+        int m_others;                                       // any other id, none expected
+};
+
+void notifyBatchDemo()
+{
+    Ticker ticker;
+    TradeTape tape;
+    TickPrinter printer;
+    HaltAlarm alarm;
+    tape.startObserve(&ticker, {Ticker::Trade});    // gets the trades only, still in one call
+    printer.startObserve(&ticker);
+    alarm.startObserve(&ticker, {Ticker::Halt});
+    ticker.publish({ Ticker::Trade, Ticker::Quote, Ticker::Trade });
+    ticker.publish({ Ticker::Halt, Ticker::Resume });
+    ticker.tick(Ticker::Resume);
+    ticker.tick(-5);
+    check(alarm.getHalts() == 1 && alarm.getOthers() == 0, "HaltAlarm: ids out of [0, 62] told apart");
+}
+
+class QuoteDisplay : public Observer<Computed<int>>
+{
+    public:
+        explicit QuoteDisplay(const char *name): m_name(name) {}
+        ~QuoteDisplay() { stopObserve(); }
+        bool update(long) override
+        {
+            cout << "QuoteDisplay: " << m_name << " " << getSubject()->get() << "\n";  // never a mix of old and new inputs
+            return true;
+        }
+
+    private:
+        const char *m_name;
+};
+
+void computedDemo()
+{
+    // two diamonds, quote and spread depend on bid and ask, both depend on the same entity
+    ValueEntity mid(100);
+    Computed<int> bid([&mid] { return mid.getValue() - 1; });
+    Computed<int> ask([&mid] { return mid.getValue() + 1; });
+    Computed<int> quote([&bid, &ask] { return (bid.get() + ask.get()) / 2; });
+    Computed<int> spread([&bid, &ask] { return ask.get() - bid.get(); });
+    bid.dependOn(&mid);
+    ask.dependOn(&mid);
+    quote.dependOn(&bid);
+    quote.dependOn(&ask);
+    spread.dependOn(&bid);
+    spread.dependOn(&ask);
+    QuoteDisplay quoteDisplay("quote");
+    QuoteDisplay spreadDisplay("spread");
+    quoteDisplay.startObserve(&quote);
+    spreadDisplay.startObserve(&spread);
+    mid.setValue(101);              // quote notified once, spread recomputed but unchanged, not notified
+    mid.setValue(102);
+    cout << "Computed: bid " << bid.getComputations() << ", quote " << quote.getComputations()
+            << ", spread " << spread.getComputations() << " computations\n";
+}
+
+void subscriptionGraphDemo()
+{
+    // ids stay the same across restarts, pointers do not
+    ValueEntity pressure(1);
+    ValueEntity flow(2);
+    ValueMonitor monitors[3];
+    SubscriptionGraph graph;
+    graph.addSubject(1, &pressure);
+    graph.addSubject(2, &flow);
+    for (std::uint32_t id = 0; id < 3; ++id)
+    {
+        graph.addObserver(10 + id, &monitors[id]);
+    }
+    graph.connect(1, 10);
+    graph.connect(1, 11);
+    graph.connect(2, 12);
+    graph.wire(ObserverInit::Deferred);     // no init until the whole graph is wired
+    graph.initObservers();
+    graph.save("observerpattern_graph.bin");
+
+    pressure.removeObserver(&monitors[0]);  // unwired, as after a restart
+    pressure.removeObserver(&monitors[1]);
+    flow.removeObserver(&monitors[2]);
+    const std::size_t restored = graph.load("observerpattern_graph.bin");
+    cout << "SubscriptionGraph: " << restored << " observers restored\n";
+    std::remove("observerpattern_graph.bin");
+    pressure.setValue(3);
+}
+
+class ValueDashboard : public RateLimitedObserver<ValueEntity>
+{
+    public:
+        explicit ValueDashboard(TimerWheel &wheel):
+            RateLimitedObserver<ValueEntity>(RateLimit::Throttle, std::chrono::milliseconds(100), RateEdge::Both, wheel) {}
+        ~ValueDashboard() { stopObserve(); }
+
+    protected:
+        void receive(long) override
+        {
+            cout << "ValueDashboard: value " << getSubject()->getValue() << "\n";
+        }
+};
+
+void rateLimitDemo()
+{
+    // advanced by hand on the thread of the entity, so receive never runs on another thread
+    TimerWheel wheel(std::chrono::milliseconds(1), false);
+    ValueEntity ve(0);
+    ValueDashboard dashboard(wheel);
+    dashboard.startObserve(&ve);
+    for (int value = 1; value <= 5; ++value)
+    {
+        ve.setValue(value);         // 1 at once, 2 to 5 held, 5 at the end of the interval
+    }
+    wheel.advance(std::chrono::steady_clock::now() + std::chrono::seconds(1));
+    cout << "ValueDashboard: " << dashboard.getSuppressed() << " suppressed\n";
+}
+
+class Sensor : public Subject<Sensor, ConcurrentPolicy>
+{
+    public:
+        void sample(long reading) const { notify(reading); }
+};
+
+class SampleCounter : public Observer<Sensor>
+{
+    public:
+        SampleCounter(): m_samples(0) {}
+        ~SampleCounter() { stopObserve(); }
+        bool update(long) override { m_samples.fetch_add(1); return true; }     // on any notifying thread
+        long getSamples() const { return m_samples.load(); }
+
+    private:
+        std::atomic<long> m_samples;
+};
+
+class SampleLimit : public Observer<Sensor>
+{
+    public:
+        explicit SampleLimit(long limit): m_limit(limit), m_samples(0), m_stopped(-1) {}
+        ~SampleLimit() { stopObserve(); }
+        bool update(long) override
+        {
+            if (m_samples.fetch_add(1) + 1 == m_limit)
+            {
+                stopObserve();      // inside its own update, other threads may still be notifying
+                m_stopped.store(m_samples.load());              // updates on other threads are done once it returns
+            }
+            return true;
+        }
+        long getSamples() const { return m_samples.load(); }
+        long getStopped() const { return m_stopped.load(); }
+
+    private:
+        const long m_limit;
+        std::atomic<long> m_samples;
+        std::atomic<long> m_stopped;                            // samples when stopObserve returned, -1 before
+};
+
+void concurrentDemo()
+{
+    Sensor sensor;
+    SampleCounter counter, late;
+    SampleLimit limit(100);
+    counter.startObserve(&sensor);
+    limit.startObserve(&sensor);
+    late.startObserve(&sensor);
+    std::vector<std::thread> samplers;
+    for (int t = 0; t < 4; ++t)
+    {
+        samplers.push_back(std::thread([&sensor] { for (long i = 0; i < 1000; ++i) sensor.sample(i); }));
+    }
+    sensor.removeObserver(&late);   // while the samplers notify, no update after that
+    const long removed = late.getSamples();
+    for (auto it = samplers.begin(); it != samplers.end(); ++it)
+    {
+        it->join();
+    }
+    cout << "SampleCounter: " << counter.getSamples() << " samples, "
+         << sensor.getObservers().size() << " observer left, limit " << (limit.getSubject() ? "observing" : "reached") << "\n";
+    check(counter.getSamples() == 4000, "SampleCounter: every sample of every thread");
+    check(late.getSamples() == removed, "SampleCounter: no update after removeObserver returned");
+    check(limit.getSamples() == limit.getStopped(), "SampleLimit: no update after stopObserve returned in its own update");
+}
+
+class Feed : public Subject<Feed, ConcurrentPolicy>
+{
+    public:
+        void post(long item) const { notifyAsync(item); }  // returns at once, delivered on the executor
+};
+
+class FeedReader : public Observer<Feed>
+{
+    public:
+        FeedReader(): m_read(0) {}
+        ~FeedReader() { stopObserve(); }
+        bool update(long item) override
+        {
+            m_items += " " + std::to_string(item);             // one update at a time per observer, in posting order
+            m_read.fetch_add(1);
+            return true;
+        }
+        const std::string& getItems() const { return m_items; }
+        long getRead() const { return m_read.load(); }
+
+    private:
+        std::string m_items;
+        std::atomic<long> m_read;
+};
+
+void asyncDemo()
+{
+    ThreadPool pool(2);             // MUST outlive the feed, whose destrctor flushes
+    Feed feed;
+    feed.setExecutor(&pool);
+    FeedReader reader, dropped;
+    reader.startObserve(&feed);
+    dropped.startObserve(&feed);
+    for (long item = 1; item <= 5; ++item)
+    {
+        feed.post(item);
+    }
+    feed.removeObserver(&dropped); // deliveries still pending are dropped, none runs after this
+    const long read = dropped.getRead();
+    feed.flush();
+    cout << "FeedReader:" << reader.getItems() << "\n";
+    check(reader.getItems() == " 1 2 3 4 5", "FeedReader: every item, in posting order");
+    check(dropped.getRead() == read, "FeedReader: no update after removeObserver returned");
+}
+
+struct PriceChanged
+{
+    std::string m_symbol;
+    double m_price;
+};
+
+struct TradingHalted
+{
+    std::string m_symbol;
+};
+
+class Exchange : public Subject<Exchange, PriceChanged, TradingHalted>
+{
+    public:
+        void quote(const std::string &symbol, double price) const { notify(PriceChanged{ symbol, price }); }
+        void halt(const std::string &symbol) const { notify(TradingHalted{ symbol }); }
+};
+
+class QuoteBoard : public Observer<Exchange, PriceChanged, TradingHalted>
+{
+    public:
+        explicit QuoteBoard(const char *name): m_name(name), m_last(nullptr) {}
+        ~QuoteBoard() { stopObserve(); }
+        bool update(const PriceChanged &event) override
+        {
+            cout << "QuoteBoard " << m_name << ": " << event.m_symbol << " at " << event.m_price << "\n";
+            m_last = &event;
+            return true;
+        }
+        bool update(const TradingHalted &event) override
+        {
+            cout << "QuoteBoard " << m_name << ": " << event.m_symbol << " halted\n";
+            return true;
+        }
+        const PriceChanged* getLast() const { return m_last; }     // valid during notify only
+
+    private:
+        const char *m_name;
+        const PriceChanged *m_last;
+};
+
+class QuoteCheck : public Observer<Exchange, PriceChanged, TradingHalted>
+{
+    public:
+        explicit QuoteCheck(const QuoteBoard &board): m_board(board) {}
+        ~QuoteCheck() { stopObserve(); }
+        bool update(const PriceChanged &event) override
+        {
+            cout << "QuoteCheck: " << (m_board.getLast() == &event ? "same event object" : "a copy") << "\n";
+            return true;
+        }
+        bool update(const TradingHalted &) override { return false; }
+
+    private:
+        const QuoteBoard &m_board;
+};
+
+void typedEventDemo()
+{
+    Exchange exchange;
+    QuoteBoard board("main");
+    QuoteCheck check(board);
+    board.startObserve(&exchange);
+    check.startObserve(&exchange);  // after the board, sees the event it just got
+    exchange.quote("ACME", 12.5);
+    exchange.halt("ACME");
+}
+
+class Cell : public Subject<Cell, IntrusivePolicy>
+{
+    public:
+        void set(long value) const { notify(value); }
+};
+
+class CellWatch : public Observer<Cell>
+{
+    public:
+        CellWatch(const char *name, bool once): m_name(name), m_once(once) {}
+        ~CellWatch() { stopObserve(); }
+        bool update(long value) override
+        {
+            cout << "CellWatch " << m_name << ": value " << value << "\n";
+            if (m_once)
+            {
+                stopObserve();      // unlinks itself, the observers after it are still notified
+            }
+            return true;
+        }
+
+    private:
+        const char *m_name;
+        bool m_once;
+};
+
+void intrusiveDemo()
+{
+    // a sheet of cells, most never observed, each only the pointer to its first observer
+    std::vector<Cell> sheet(1000);
+    CellWatch audit("audit", true), display("display", false);
+    display.startObserve(&sheet[7]);
+    audit.startObserve(&sheet[7], MessageMask(), 1);     // links itself in front of display
+    sheet[7].set(1);
+    sheet[7].set(2);
+    cout << "Cell: " << sheet.size() << " cells of " << sizeof(Cell) << " bytes\n";
+}
+
+class Grid : public Subject<Grid, ConcurrentPolicy>
+{
+    public:
+        Grid() { setParallelism(64, 256); }               // chunks of 64 observers once there are 256
+        void tick() const { notifyParallel(1); }
+};
+
+class GridNode : public Observer<Grid>
+{
+    public:
+        explicit GridNode(std::atomic<long> &updates): m_updates(updates) {}
+        ~GridNode() { stopObserve(); }
+        bool update(long) override { m_updates.fetch_add(1); return true; }
+
+    protected:
+        bool threadSafeUpdate() const override { return true; }    // any worker, at the same time as others
+
+    private:
+        std::atomic<long> &m_updates;
+};
+
+class GridRecorder : public Observer<Grid>
+{
+    public:
+        GridRecorder(): m_thread() {}
+        ~GridRecorder() { stopObserve(); }
+        bool update(long) override { m_thread = std::this_thread::get_id(); return true; }
+        std::thread::id getThread() const { return m_thread; }
+
+    private:
+        std::thread::id m_thread;                               // not thread-safe, updated on the notifying thread
+};
+
+void parallelDemo()
+{
+    std::atomic<long> updates(0);
+    std::vector<std::unique_ptr<GridNode>> nodes;
+    std::vector<GridNode*> added;
+    for (int i = 0; i < 1000; ++i)
+    {
+        nodes.push_back(std::unique_ptr<GridNode>(new GridNode(updates)));
+        added.push_back(nodes.back().get());
+    }
+    Grid grid;
+    GridRecorder recorder;
+    grid.addObservers(added.begin(), added.end());
+    recorder.startObserve(&grid);
+    grid.tick();                    // returns once all 1001 updates ran
+    cout << "Grid: " << updates.load() << " parallel updates, recorder updated on the "
+         << (recorder.getThread() == std::this_thread::get_id() ? "notifying" : "another") << " thread\n";
+}
+
+#ifdef __linux__
+class Thermometer : public SharedMemorySubject<Thermometer>
+{
+    public:
+        void measure(long reading) { notify(reading); }
+        void calibrate(long reading) { notifyUntilConsumed(reading); }
+        void measureSeries(long first, long last)
+        {
+            NotifyBatch batch = beginBatch(BatchMerge::KeepAll);
+            for (long reading = first; reading <= last; ++reading)
+            {
+                notify(reading);    // pushed now, local observers get it when the batch ends
+            }
+        }
+};
+
+class ThermometerMirror : public Subject<ThermometerMirror> {};
+
+class TemperatureLog : public Observer<ThermometerMirror>
+{
+    public:
+        ~TemperatureLog() { stopObserve(); }
+        bool update(long msg) override
+        {
+            cout << "TemperatureLog: reading " << msg << "\n";
+            return true;
+        }
+};
+
+void sharedMemoryDemo()
+{
+    // both ends in one process here, normally the proxy runs in the monitoring process
+    const std::string name = "/observerpattern_demo_" + std::to_string(::getpid());
+    Thermometer thermometer;
+    if (!thermometer.publish(name.c_str(), 64))
+    {
+        cout << "Thermometer: no shared memory\n";
+        return;
+    }
+    SharedMemoryProxy proxy;
+    ThermometerMirror mirror;
+    TemperatureLog log;
+    log.startObserve(&mirror);
+    proxy.open(name.c_str());
+    proxy.bind(&mirror);
+    thermometer.measure(21);
+    thermometer.measure(22);
+    thermometer.calibrate(23);
+    thermometer.measureSeries(24, 25);
+    proxy.waitAndDispatch(std::chrono::seconds(1));
+    thermometer.unpublish();
+    cout << "TemperatureLog: publisher " << (proxy.getState() == SharedRingState::Closed ? "closed" : "running") << "\n";
+}
+#endif
+
+#ifdef OBSERVERPATTERN_INSTRUMENTATION
+class Beacon : public Subject<Beacon, IntrusivePolicy>
+{
+    public:
+        void flash() { notify(1); }
+};
+
+class FlashCounter : public Observer<Beacon>
+{
+    public:
+        ~FlashCounter() { stopObserve(); }
+        bool update(long) override { return true; }
+};
+
+template<typename T>
+class OneShotMonitor : public MultiObserver<T>
+{
+    public:
+        ~OneShotMonitor() { this->stopObserve(); }
+        bool update(T *subject, long) override
+        {
+            this->stopObserve(subject);     // the edge deletes itself before update returns
+            return true;
+        }
+};
+
+void instrumentationDemo()
+{
+    ValueEntity ve(0);
+    ValueMonitor vm;
+    vm.startObserve(&ve);
+    ve.setValue(1);
+    ve.setValue(2);
+    ve.getStats().writeJson(cout);
+    cout << "\n";
+
+    // nothing is recorded for an observer gone in its own update, serial, versioned and intrusive store
+    Gauge gauge;
+    Beacon beacon;
+    OneShotMonitor<ValueEntity> veOnce;
+    OneShotMonitor<Gauge> gaugeOnce;
+    OneShotMonitor<Beacon> beaconOnce;
+    veOnce.startObserve(&ve);
+    gaugeOnce.startObserve(&gauge);
+    beaconOnce.startObserve(&beacon);
+    ve.setValue(3);
+    gauge.setLevel(1);
+    gauge.drain();
+    beacon.flash();
+    cout << "OneShotMonitor: observing " << veOnce.getSubjectCount() + gaugeOnce.getSubjectCount() + beaconOnce.getSubjectCount()
+         << ", ValueEntity notified " << ve.getStats().m_notifies << " times, " << ve.getStats().m_observers.size() << " observer left\n";
+
+    // scraped by a monitoring thread without a lock while the beacon notifies on this one
+    FlashCounter counter;
+    counter.startObserve(&beacon);
+    std::atomic<bool> done(false);
+    std::uint64_t seen = 0;
+    std::thread monitor([&beacon, &done, &seen]
+    {
+        while (!done.load())
+        {
+            seen = beacon.getStats().m_notifies;
+        }
+    });
+    for (int i = 0; i < 10000; ++i)
+    {
+        beacon.flash();
+    }
+    done.store(true);
+    monitor.join();
+    const SubjectStatsSnapshot stats = beacon.getStats();
+    check(seen <= stats.m_notifies && stats.m_observers.size() == 1 && stats.m_observers[0].m_updates == 10000,
+          "Beacon: stats read from a monitoring thread while notifying");
+}
+#endif
+
+#ifdef OBSERVERPATTERN_JOURNAL
+void journalDemo()
+{
+    const char *path = "observerpattern.journal";
+    ValueEntity ve(0);
+    ValueMonitor vm;
+    vm.startObserve(&ve);
+    ve.setJournalId(1);
+    JournalRecorder recorder;
+    recorder.start(path, 1024);
+    ve.setValue(1);
+    ve.setValue(2);
+    recorder.stop();
+
+    // offline, the same graph driven from the file
+    JournalReplayer replayer;
+    replayer.open(path);
+    for (std::size_t i = 0; i < replayer.size(); ++i)
+    {
+        cout << "Journal: subject " << replayer[i].m_subject << " message " << replayer[i].m_msg
+             << " fan-out " << replayer[i].m_fanOut << "\n";
+    }
+    replayer.bind(1, &ve);
+    replayer.replay();
+    std::remove(path);
+}
+#endif
+
 int main() 
 {
     entityMonitorDemo();
+    batchDemo();
     dualRoleDemo();
-    return 0;
+    propagationDemo();
+    multiObserverDemo();
+    staticSubjectDemo();
+    priorityDemo();
+    mailboxDemo();
+    eventHubDemo();
+    versionedDemo();
+    rateLimitDemo();
+    notifyBatchDemo();
+    computedDemo();
+    subscriptionGraphDemo();
+    concurrentDemo();
+    asyncDemo();
+    typedEventDemo();
+    intrusiveDemo();
+    parallelDemo();
+#ifdef __linux__
+    sharedMemoryDemo();
+#endif
+#ifdef OBSERVERPATTERN_INSTRUMENTATION
+    instrumentationDemo();
+#endif
+#ifdef OBSERVERPATTERN_JOURNAL
+    journalDemo();
+#endif
+    return Failures ? 1 : 0;
 }